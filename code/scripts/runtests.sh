@@ -15,8 +15,18 @@ fi
 total_tests=0
 passed_tests=0
 
+# Every reference result is a test, and some are checked again under other
+# engines, or restored from a checkpoint, which must give the same results.
+test_names=()
 for reference_results in ../ref/results/*.res; do
-    test_name="$(basename "$reference_results" .res)"
+    test_names+=("$(basename "$reference_results" .res)")
+done
+test_names+=(D.mix1.parallel D.mix1.checkpoint)
+checkpoint="$(mktemp)"
+
+for test_name in "${test_names[@]}"; do
+    reference_results="../ref/results/$test_name.res"
+    setup_args=()
     case "$test_name" in
         A.*)
             test_args=(-mode 1 "../traces/${test_name#A.}.mtr.gz")
@@ -33,15 +43,24 @@ for reference_results in ../ref/results/*.res; do
         D.mix1)
             test_args=(-mode 4 ../traces/bzip2.mtr.gz ../traces/libq.mtr.gz)
             ;;
-#        E.Q1.mix1)
-#            test_args=(-mode 4 -L2repl 2 -SWP_core0ways 4 ../traces/bzip2.mtr.gz ../traces/libq.mtr.gz)
-#            ;;
-#        E.Q2.mix1)
-#            test_args=(-mode 4 -L2repl 2 -SWP_core0ways 8 ../traces/bzip2.mtr.gz ../traces/libq.mtr.gz)
-#            ;;
-#        E.Q3.mix1)
-#            test_args=(-mode 4 -L2repl 2 -SWP_core0ways 12 ../traces/bzip2.mtr.gz ../traces/libq.mtr.gz)
-#            ;;
+        D.mix1.parallel)
+            reference_results=../ref/results/D.mix1.res
+            test_args=(-mode 4 -parallel 1 ../traces/bzip2.mtr.gz ../traces/libq.mtr.gz)
+            ;;
+        D.mix1.checkpoint)
+            reference_results=../ref/results/D.mix1.res
+            setup_args=(-mode 4 -save_checkpoint "$checkpoint" -checkpoint_inst 50000000 ../traces/bzip2.mtr.gz ../traces/libq.mtr.gz)
+            test_args=(-mode 4 -load_checkpoint "$checkpoint" ../traces/bzip2.mtr.gz ../traces/libq.mtr.gz)
+            ;;
+        E.Q1.mix1)
+            test_args=(-mode 4 -L2repl 2 -SWP_core0ways 4 ../traces/bzip2.mtr.gz ../traces/libq.mtr.gz)
+            ;;
+        E.Q2.mix1)
+            test_args=(-mode 4 -L2repl 2 -SWP_core0ways 8 ../traces/bzip2.mtr.gz ../traces/libq.mtr.gz)
+            ;;
+        E.Q3.mix1)
+            test_args=(-mode 4 -L2repl 2 -SWP_core0ways 12 ../traces/bzip2.mtr.gz ../traces/libq.mtr.gz)
+            ;;
         *) continue ;;
     esac
 
@@ -49,6 +68,9 @@ for reference_results in ../ref/results/*.res; do
     echo -n 'Running test '"$test_name"'...'
 
     results="$(mktemp)"
+    if [[ ${#setup_args[@]} -gt 0 ]]; then
+        ../src/sim "${setup_args[@]}" > /dev/null
+    fi
     ../src/sim "${test_args[@]}" | grep '^\(CYCLES\|CORE_\|MEMSYS_\|ICACHE_\|DCACHE_\|L2CACHE_\|DRAM_\)' > "$results"
 
     if diff -q "$results" "$reference_results" > /dev/null; then
@@ -64,5 +86,6 @@ for reference_results in ../ref/results/*.res; do
 
     rm -f "$results"
 done
+rm -f "$checkpoint"
 
 echo "$blue"'Passed '"$passed_tests"'/'"$total_tests"' tests'"$reset"
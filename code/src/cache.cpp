@@ -7,11 +7,44 @@
 // Defines the functions used to implement the cache.
 
 #include "cache.h"
+#include "checkpoint.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 // You may add any other #include directives you need here, but make sure they
 // compile on the reference machine!
 
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The number of bytes of tags compared by one SIMD compare. */
+#if defined(__AVX2__)
+#define CACHE_SIMD_BYTES 32
+#elif defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+#define CACHE_SIMD_BYTES 16
+#else
+#define CACHE_SIMD_BYTES 0
+#endif
+
+/** The number of tags of the given type compared by one SIMD compare. */
+#define CACHE_SIMD_LANES(tag_type)                                            \
+    (CACHE_SIMD_BYTES ? CACHE_SIMD_BYTES / sizeof(tag_type) : 1)
+
+/**
+ * Stands in for the replacement policy of a cache implementation that reads
+ * it from the cache at runtime.
+ */
+#define CACHE_ANY_POLICY (-1)
+
 ///////////////////////////////////////////////////////////////////////////////
 //                    EXTERNALLY DEFINED GLOBAL VARIABLES                    //
 ///////////////////////////////////////////////////////////////////////////////
@@ -21,7 +54,7 @@
  *
  * This can be used as a timestamp for implementing the LRU replacement policy.
  */
-extern uint64_t current_cycle;
+extern thread_local uint64_t current_cycle;
 
 /**
  * For static way partitioning, the quota of ways in each set that can be
@@ -33,16 +66,52 @@ extern uint64_t current_cycle;
  */
 extern unsigned int SWP_CORE0_WAYS;
 
+/** The number of cores being simulated. */
+extern unsigned int NUM_CORES;
+
+/**
+ * For dynamic way partitioning, the number of cycles between repartitions
+ * of the cache.
+ */
+extern uint64_t DWP_INTERVAL;
+
+/**
+ * The number of victims drawn from rand() so far, so that a simulation
+ * restored from a checkpoint can resume the same sequence.
+ */
+uint64_t cache_rand_draws;
+
 ///////////////////////////////////////////////////////////////////////////////
 //                           FUNCTION DEFINITIONS                            //
 ///////////////////////////////////////////////////////////////////////////////
 
+static void cache_specialize(Cache *c);
+static CacheUmon *cache_umon_new(Cache *c);
+
 // As described in cache.h, you are free to deviate from the suggested
 // implementation as you see fit.
 
 // The only restriction is that you must not remove cache_print_stats() or
 // modify its output format, since its output will be used for grading.
 
+/**
+ * Allocate zeroed memory for the lines of a cache. Pages are only backed by
+ * host memory once a line in them is written, so the sets a workload never
+ * touches cost nothing.
+ *
+ * @param size The number of bytes to allocate.
+ * @return A pointer to the memory.
+ */
+static void *cache_alloc(uint64_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        exit(1);
+    }
+    return p;
+}
+
 /**
  * Allocate and initialize a cache.
  *
@@ -74,67 +143,755 @@ Cache *cache_new(uint64_t size, uint64_t associativity, uint64_t line_size,
 
     cache->num_sets = size / (associativity * line_size);
 
-    cache->sets = (CacheSet *)calloc(cache->num_sets, sizeof(CacheSet));
-    if (!cache->sets) {
-        exit(1);
+    /* a power-of-two number of sets is split off a line address by a mask */
+    cache->set_mask = cache->num_sets - 1;
+    while (((uint64_t)1 << cache->set_shift) < cache->num_sets) {
+        cache->set_shift++;
     }
 
+    /*
+     * allocate one array per line field; all lines start out invalid. The
+     * tags start out 32 bits wide, and the SIMD compare of the last set may
+     * read one vector past its end.
+     */
+    uint64_t num_lines = (uint64_t)cache->num_sets * associativity;
+    cache->tags = cache_alloc(num_lines * sizeof(uint32_t) +
+                              CACHE_SIMD_BYTES);
+    cache->meta = (uint8_t *)cache_alloc(num_lines);
+    cache->rank = (uint8_t *)cache_alloc(num_lines);
+    cache->rank_cycle = (uint64_t *)cache_alloc(cache->num_sets *
+                                                sizeof(uint64_t));
+
     cache->replacement_policy = replacement_policy;
+    if (replacement_policy == TREE_PLRU &&
+        (associativity & (associativity - 1)) != 0) {
+        fprintf(stderr, "Error: tree PLRU needs a power-of-two "
+                        "associativity\n");
+        exit(1);
+    }
+
+    /* way-partitioned caches start out with the ways split evenly */
+    if (replacement_policy == SWP || replacement_policy == DWP) {
+        cache->quota = (unsigned int *)calloc(NUM_CORES, sizeof(unsigned int));
+        if (!cache->quota) {
+            exit(1);
+        }
+        for (unsigned int core = 0; core < NUM_CORES; core++) {
+            cache->quota[core] = associativity / NUM_CORES +
+                                 (core < associativity % NUM_CORES);
+        }
+    }
+    if (replacement_policy == SWP) {
+        unsigned int core0_ways = (SWP_CORE0_WAYS < associativity)
+                                      ? SWP_CORE0_WAYS
+                                      : associativity;
+        for (unsigned int core = 1; core < NUM_CORES; core++) {
+            unsigned int others = NUM_CORES - 1;
+            unsigned int left = associativity - core0_ways;
+            cache->quota[core] = left / others + (core - 1 < left % others);
+        }
+        cache->quota[0] = core0_ways;
+    }
+    if (replacement_policy == DWP) {
+        cache->umon = cache_umon_new(cache);
+    }
+
+    cache_specialize(cache);
 
 
     return cache;
 }
 
 /**
- * Access the cache at the given address.
+ * Switch a cache from 32-bit to 64-bit tags, once a line address with a tag
+ * too wide for 32 bits is installed.
+ *
+ * @param c The cache to widen the tags of.
+ */
+static void cache_widen_tags(Cache *c)
+{
+    uint64_t num_lines = (uint64_t)c->num_sets * c->num_ways;
+    const uint32_t *narrow = (const uint32_t *)c->tags;
+    uint64_t *wide = (uint64_t *)cache_alloc(num_lines * sizeof(uint64_t) +
+                                             CACHE_SIMD_BYTES);
+
+    /* only copy nonzero tags, so untouched sets stay unbacked */
+    for (uint64_t i = 0; i < num_lines; i++) {
+        if (narrow[i]) {
+            wide[i] = narrow[i];
+        }
+    }
+
+    munmap(c->tags, num_lines * sizeof(uint32_t) + CACHE_SIMD_BYTES);
+    c->tags = wide;
+    c->wide_tags = true;
+    cache_specialize(c);
+}
+
+/**
+ * Compare one SIMD vector of tags against a tag.
  *
- * Also update the cache statistics accordingly.
+ * @param tags The first tag to compare.
+ * @param tag The tag to compare against.
+ * @return A bit mask of the lanes whose tag equals tag.
+ */
+static inline unsigned int cache_match(const uint32_t *tags, uint32_t tag)
+{
+#if defined(__AVX2__)
+    __m256i v = _mm256_loadu_si256((const __m256i *)tags);
+    __m256i eq = _mm256_cmpeq_epi32(v, _mm256_set1_epi32((int)tag));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+#elif defined(__SSE2__)
+    __m128i v = _mm_loadu_si128((const __m128i *)tags);
+    __m128i eq = _mm_cmpeq_epi32(v, _mm_set1_epi32((int)tag));
+    return _mm_movemask_ps(_mm_castsi128_ps(eq));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+    uint32x4_t eq = vceqq_u32(vld1q_u32(tags), vdupq_n_u32(tag));
+    return vaddvq_u32(vandq_u32(eq, vld1q_u32(lane_bits)));
+#else
+    return *tags == tag;
+#endif
+}
+
+/** See cache_match(uint32_t *, uint32_t). */
+static inline unsigned int cache_match(const uint64_t *tags, uint64_t tag)
+{
+#if defined(__AVX2__)
+    __m256i v = _mm256_loadu_si256((const __m256i *)tags);
+    __m256i eq = _mm256_cmpeq_epi64(v, _mm256_set1_epi64x(tag));
+    return _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+#elif defined(__SSE2__)
+    /* SSE2 has no 64-bit compare: both 32-bit halves must match */
+    __m128i v = _mm_loadu_si128((const __m128i *)tags);
+    __m128i eq = _mm_cmpeq_epi32(v, _mm_set1_epi64x(tag));
+    eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_movemask_pd(_mm_castsi128_pd(eq));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    uint64x2_t eq = vceqq_u64(vld1q_u64(tags), vdupq_n_u64(tag));
+    return (vgetq_lane_u64(eq, 0) & 1) | (vgetq_lane_u64(eq, 1) & 2);
+#else
+    return *tags == tag;
+#endif
+}
+
+/**
+ * Find the way of a set whose tag matches the given tag.
  *
- * This is intended to be implemented in part A.
+ * Invalid lines have a tag of 0, which also matches tag 0: the reference
+ * implementation compares tags without checking the valid bit, and a hit on
+ * an empty way is kept so that results match it.
  *
- * @param c The cache to access.
- * @param line_addr The address of the cache line to access (in units of the
- *                  cache line size, i.e., excluding the line offset bits).
- * @param is_write Whether this access is a write.
- * @param core_id The CPU core ID that requested this access.
- * @return Whether the cache access was a hit or a miss.
+ * @tparam TAG The type of the cache's tags.
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ * @param c The cache to search.
+ * @param set_index The index of the cache set to search.
+ * @param tag The tag to look for.
+ * @return The index of the first matching way, or -1 if none matches.
  */
-CacheResult cache_access(Cache *c, uint64_t line_addr, bool is_write,
-                         unsigned int core_id)
+template <typename TAG, unsigned int WAYS>
+static inline int cache_lookup(Cache *c, uint64_t set_index, TAG tag)
 {
-    // TODO: Return HIT if the access hits in the cache, and MISS otherwise.
-    // TODO: If is_write is true, mark the resident line as dirty.
-    // TODO: Update the appropriate cache statistics.
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
+    const unsigned int lanes = CACHE_SIMD_LANES(TAG);
+    const TAG *tags = (const TAG *)c->tags + set_index * num_ways;
 
+    for (unsigned int way = 0; way < num_ways; way += lanes) {
+        unsigned int mask = cache_match(&tags[way], tag);
 
-    /* calculate tag and set_index */
-    unsigned int tag = line_addr / c->num_sets;
-    unsigned int set_index = line_addr % c->num_sets;
+        /* ignore lanes past the end of the set */
+        if (way + lanes > num_ways) {
+            mask &= (1u << (num_ways - way)) - 1;
+        }
+        if (mask) {
+            return way + __builtin_ctz(mask);
+        }
+    }
 
-//    printf("\t\tindex: %d, tag: %d, is_write: %d, core_id: %d\n", set_index, tag, is_write, core_id);
+    return -1;
+}
 
-    /* index the cache set */
-    CacheSet *set = &c->sets[set_index];
+/**
+ * Split a line address into its tag and set index.
+ *
+ * @tparam POW2_SETS Whether the number of sets is a power of two, in which
+ *                   case the split is a shift and a mask.
+ */
+template <bool POW2_SETS>
+static inline void cache_split(Cache *c, uint64_t line_addr, uint64_t *tag,
+                               uint64_t *set_index)
+{
+    if (POW2_SETS) {
+        *tag = line_addr >> c->set_shift;
+        *set_index = line_addr & c->set_mask;
+    } else {
+        *tag = line_addr / c->num_sets;
+        *set_index = line_addr % c->num_sets;
+    }
+}
 
-    /* update statistics */
-    c->stat_write_access += is_write;
-    c->stat_read_access += !is_write;
+/**
+ * Record that a line was accessed in the current cycle, for LRU.
+ *
+ * The lines of a set are ranked by the cycle of their last access: lines
+ * accessed in the same cycle share a rank, and the ranks of a set are kept
+ * dense, so they fit in a byte. The rank_cycle of a set is the cycle of its
+ * highest rank. This orders lines exactly like last-access timestamps would,
+ * including ties, which the reference results depend on.
+ *
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ * @param c The cache.
+ * @param set_index The index of the set of the line.
+ * @param way The way of the line.
+ */
+template <unsigned int WAYS>
+static inline void cache_touch_lru(Cache *c, uint64_t set_index,
+                                   unsigned int way)
+{
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
+    uint8_t *rank = &c->rank[set_index * num_ways];
+    uint8_t old_rank = rank[way];
+    uint8_t top = 0;
+    bool shared = false;
+
+#if defined(__SSE2__)
+    if (WAYS == 8 || WAYS == 16) {
+        /* lanes past the end of the set are 0 and are masked off */
+        __m128i r = (WAYS == 16) ? _mm_loadu_si128((const __m128i *)rank)
+                                 : _mm_loadl_epi64((const __m128i *)rank);
+        __m128i m = _mm_max_epu8(r, _mm_srli_si128(r, 8));
+        m = _mm_max_epu8(m, _mm_srli_si128(m, 4));
+        m = _mm_max_epu8(m, _mm_srli_si128(m, 2));
+        m = _mm_max_epu8(m, _mm_srli_si128(m, 1));
+        top = _mm_cvtsi128_si32(m) & 0xFF;
+
+        unsigned int same = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(r, _mm_set1_epi8(old_rank)));
+        shared = same & ((1u << WAYS) - 1) & ~(1u << way);
+    } else
+#endif
+    {
+        for (unsigned int i = 0; i < num_ways; i++) {
+            top = (rank[i] > top) ? rank[i] : top;
+            shared |= (i != way && rank[i] == old_rank);
+        }
+    }
+
+    /* the first access to the set this cycle opens a new rank */
+    if (c->rank_cycle[set_index] != current_cycle) {
+        c->rank_cycle[set_index] = current_cycle;
+        top++;
+    } else if (old_rank == top) {
+        return;
+    }
+    rank[way] = top;
+
+    /* close the gap if the line was the last one with its old rank */
+    if (shared) {
+        return;
+    }
+#if defined(__SSE2__)
+    if (WAYS == 8 || WAYS == 16) {
+        /* ranks never exceed 127, so a signed compare will do */
+        __m128i r = (WAYS == 16) ? _mm_loadu_si128((const __m128i *)rank)
+                                 : _mm_loadl_epi64((const __m128i *)rank);
+        r = _mm_add_epi8(r, _mm_cmpgt_epi8(r, _mm_set1_epi8(old_rank)));
+        if (WAYS == 16) {
+            _mm_storeu_si128((__m128i *)rank, r);
+        } else {
+            _mm_storel_epi64((__m128i *)rank, r);
+        }
+        return;
+    }
+#endif
+    for (unsigned int i = 0; i < num_ways; i++) {
+        rank[i] -= (rank[i] > old_rank);
+    }
+}
+
+/**
+ * Find the LRU way of a set whose lines are all valid: the way with the
+ * lowest rank, and of those the lowest way.
+ *
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ */
+template <unsigned int WAYS>
+static inline unsigned int cache_lru_way(Cache *c, uint64_t set_index)
+{
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
+    const uint8_t *rank = &c->rank[set_index * num_ways];
+
+#if defined(__SSE2__)
+    if (WAYS == 8 || WAYS == 16) {
+        __m128i r = (WAYS == 16) ? _mm_loadu_si128((const __m128i *)rank)
+                                 : _mm_or_si128(
+                                       _mm_loadl_epi64((const __m128i *)rank),
+                                       _mm_slli_si128(_mm_set1_epi8(-1), 8));
+        __m128i m = _mm_min_epu8(r, _mm_shuffle_epi32(r,
+                                                      _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm_min_epu8(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+        m = _mm_min_epu8(m, _mm_shufflelo_epi16(m, _MM_SHUFFLE(2, 3, 0, 1)));
+        m = _mm_min_epu8(m, _mm_srli_epi16(m, 8));
+        uint8_t min_rank = _mm_cvtsi128_si32(m) & 0xFF;
+        __m128i eq = _mm_cmpeq_epi8(r, _mm_set1_epi8(min_rank));
+        return __builtin_ctz(_mm_movemask_epi8(eq));
+    }
+#endif
+    unsigned int victim_index = 0;
+    for (unsigned int i = 1; i < num_ways; i++) {
+        if (rank[i] < rank[victim_index]) {
+            victim_index = i;
+        }
+    }
+    return victim_index;
+}
+
+/**
+ * Record that a line was accessed, for tree PLRU.
+ *
+ * The ways of a set are the leaves of a binary tree, whose num_ways - 1
+ * nodes (numbered from 1 at the root, heap-style) each hold a bit pointing
+ * towards the half to evict from next. The bits are packed into the rank
+ * bytes of the set.
+ *
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ */
+template <unsigned int WAYS>
+static inline void cache_touch_tree_plru(Cache *c, uint64_t set_index,
+                                         unsigned int way)
+{
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
+    uint8_t *bits = &c->rank[set_index * num_ways];
+
+    /* point every node on the way's path at the other half */
+    unsigned int node = 1;
+    for (unsigned int half = num_ways / 2; half; half /= 2) {
+        unsigned int right = (way & half) != 0;
+        unsigned int bit = node - 1;
+        if (right) {
+            bits[bit / 8] &= ~(1 << (bit % 8));
+        } else {
+            bits[bit / 8] |= 1 << (bit % 8);
+        }
+        node = 2 * node + right;
+    }
+}
+
+/**
+ * Find the way a tree PLRU set points at; see cache_touch_tree_plru().
+ *
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ */
+template <unsigned int WAYS>
+static inline unsigned int cache_tree_plru_way(Cache *c, uint64_t set_index)
+{
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
+    const uint8_t *bits = &c->rank[set_index * num_ways];
+
+    unsigned int node = 1;
+    unsigned int way = 0;
+    for (unsigned int half = num_ways / 2; half; half /= 2) {
+        unsigned int bit = node - 1;
+        unsigned int right = (bits[bit / 8] >> (bit % 8)) & 1;
+        way |= right ? half : 0;
+        node = 2 * node + right;
+    }
+    return way;
+}
+
+/**
+ * Record that a line was accessed, for bit PLRU: each way's rank byte is its
+ * MRU bit, and once every way's is set, all but the accessed way's are
+ * cleared.
+ *
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ */
+template <unsigned int WAYS>
+static inline void cache_touch_bit_plru(Cache *c, uint64_t set_index,
+                                        unsigned int way)
+{
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
+    uint8_t *mru = &c->rank[set_index * num_ways];
+
+    mru[way] = 1;
+    for (unsigned int i = 0; i < num_ways; i++) {
+        if (!mru[i]) {
+            return;
+        }
+    }
+    for (unsigned int i = 0; i < num_ways; i++) {
+        mru[i] = (i == way);
+    }
+}
+
+/**
+ * Update the replacement state of a set after one of its lines is accessed
+ * or installed.
+ *
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ * @tparam POLICY The replacement policy of the cache, or CACHE_ANY_POLICY if
+ *                only known at runtime.
+ * @param c The cache.
+ * @param set_index The index of the set of the line.
+ * @param way The way of the line.
+ */
+template <unsigned int WAYS, int POLICY>
+static inline void cache_touch(Cache *c, uint64_t set_index, unsigned int way)
+{
+    const int policy = (POLICY != CACHE_ANY_POLICY) ? POLICY
+                                                    : c->replacement_policy;
+
+    switch (policy) {
+        case LRU:
+        case SWP:
+        case DWP:
+            cache_touch_lru<WAYS>(c, set_index, way);
+            break;
+
+        case TREE_PLRU:
+            cache_touch_tree_plru<WAYS>(c, set_index, way);
+            break;
+
+        case BIT_PLRU:
+            cache_touch_bit_plru<WAYS>(c, set_index, way);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * Find the first invalid way of a set.
+ *
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ * @return The index of the way, or -1 if every line of the set is valid.
+ */
+template <unsigned int WAYS>
+static inline int cache_invalid_way(Cache *c, uint64_t set_index)
+{
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
+    const uint8_t *meta = &c->meta[set_index * num_ways];
+
+#if defined(__SSE2__)
+    if (WAYS == 8 || WAYS == 16) {
+        __m128i m = (WAYS == 16) ? _mm_loadu_si128((const __m128i *)meta)
+                                 : _mm_loadl_epi64((const __m128i *)meta);
+        __m128i invalid = _mm_cmpeq_epi8(
+            _mm_and_si128(m, _mm_set1_epi8(CACHE_META_VALID)),
+            _mm_setzero_si128());
+        unsigned int mask = _mm_movemask_epi8(invalid) & ((1u << WAYS) - 1);
+        return mask ? __builtin_ctz(mask) : -1;
+    }
+#endif
+    for (unsigned int i = 0; i < num_ways; i++) {
+        if (!(meta[i] & CACHE_META_VALID)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find the victim way of a full set of a way-partitioned cache (SWP or DWP).
+ *
+ * A core below its quota in the set takes a line from another core,
+ * preferring cores over their own quota; a core at or above its quota
+ * replaces one of its own lines. Either way, the LRU candidate is evicted.
+ *
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ * @param c The cache.
+ * @param set_index The index of the set.
+ * @param core_id The CPU core installing a line.
+ * @return The index of the victim way.
+ */
+template <unsigned int WAYS>
+static inline unsigned int cache_partition_way(Cache *c, uint64_t set_index,
+                                               unsigned int core_id)
+{
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
+    const uint8_t *meta = &c->meta[set_index * num_ways];
+    const uint8_t *rank = &c->rank[set_index * num_ways];
+
+    unsigned int count[CACHE_MAX_OWNERS] = {0};
+    for (unsigned int i = 0; i < num_ways; i++) {
+        count[meta[i] >> CACHE_META_OWNER_SHIFT]++;
+    }
+
+    /* the ways to choose from, in three rounds */
+    bool any_over_quota = false, any_own = false;
+    for (unsigned int i = 0; i < num_ways; i++) {
+        unsigned int owner = meta[i] >> CACHE_META_OWNER_SHIFT;
+        if (owner == core_id) {
+            any_own = true;
+        } else if (count[owner] > c->quota[owner]) {
+            any_over_quota = true;
+        }
+    }
+
+    /* 0: other cores' lines over their quota, 1: other cores' lines, 2: own */
+    unsigned int round;
+    if (count[core_id] < c->quota[core_id]) {
+        round = any_over_quota ? 0 : 1;
+    } else {
+        round = any_own ? 2 : 1;
+    }
+
+    unsigned int victim_index = num_ways;
+    for (unsigned int i = 0; i < num_ways; i++) {
+        unsigned int owner = meta[i] >> CACHE_META_OWNER_SHIFT;
+        bool candidate = (round == 2)
+                             ? owner == core_id
+                             : owner != core_id &&
+                                   (round == 1 ||
+                                    count[owner] > c->quota[owner]);
+        if (candidate && (victim_index == num_ways ||
+                          rank[i] < rank[victim_index])) {
+            victim_index = i;
+        }
+    }
+    return victim_index;
+}
+
+/**
+ * Allocate the utility monitor of a DWP cache.
+ *
+ * @param c The cache.
+ * @return A pointer to the utility monitor.
+ */
+static CacheUmon *cache_umon_new(Cache *c)
+{
+    CacheUmon *umon = (CacheUmon *)calloc(1, sizeof(CacheUmon));
+    if (!umon) {
+        exit(1);
+    }
+
+    umon->sample_stride = c->num_sets / CACHE_UMON_SETS;
+    if (umon->sample_stride == 0) {
+        umon->sample_stride = 1;
+    }
+    umon->num_samples = c->num_sets / umon->sample_stride;
+
+    uint64_t num_stacks = (uint64_t)NUM_CORES * umon->num_samples;
+    umon->stack = (uint64_t *)calloc(num_stacks * c->num_ways,
+                                     sizeof(uint64_t));
+    umon->depth = (unsigned int *)calloc(num_stacks, sizeof(unsigned int));
+    umon->hits = (unsigned long long *)calloc(
+        (uint64_t)NUM_CORES * c->num_ways, sizeof(unsigned long long));
+    if (!umon->stack || !umon->depth || !umon->hits) {
+        exit(1);
+    }
+
+    umon->next_repartition = DWP_INTERVAL;
+    return umon;
+}
+
+/**
+ * Divide the ways of a DWP cache among the cores with the lookahead
+ * algorithm of utility-based cache partitioning: every core gets one way,
+ * then the remaining ways go, a few at a time, to the core that gains the
+ * most hits per extra way according to its utility monitor.
+ *
+ * The hit counters are halved afterwards, so that older behavior counts
+ * less in later partitions.
+ *
+ * @param c The cache to repartition.
+ */
+static void cache_repartition(Cache *c)
+{
+    CacheUmon *umon = c->umon;
+    unsigned int num_ways = c->num_ways;
+
+    for (unsigned int core = 0; core < NUM_CORES; core++) {
+        c->quota[core] = (core < num_ways) ? 1 : 0;
+    }
+    unsigned int balance = (num_ways > NUM_CORES) ? num_ways - NUM_CORES : 0;
+
+    while (balance > 0) {
+        unsigned int best_core = 0;
+        unsigned int best_ways = 1;
+        double best_utility = -1.0;
+
+        for (unsigned int core = 0; core < NUM_CORES; core++) {
+            const unsigned long long *hits = &umon->hits[core * num_ways];
+            unsigned int alloc = c->quota[core];
+            unsigned long long gain = 0;
+
+            /* the best hits per way over every possible extra allocation */
+            for (unsigned int k = 1; k <= balance && alloc + k <= num_ways;
+                 k++) {
+                gain += hits[alloc + k - 1];
+                double utility = (double)gain / k;
+                if (utility > best_utility) {
+                    best_utility = utility;
+                    best_core = core;
+                    best_ways = k;
+                }
+            }
+        }
+
+        c->quota[best_core] += best_ways;
+        balance -= best_ways;
+    }
+
+    for (uint64_t i = 0; i < (uint64_t)NUM_CORES * num_ways; i++) {
+        umon->hits[i] /= 2;
+    }
+}
+
+/**
+ * Record an access in the utility monitor of a DWP cache, and repartition
+ * the cache if it is due.
+ *
+ * @param c The cache.
+ * @param line_addr The address of the accessed line.
+ * @param set_index The index of the set of the line.
+ * @param core_id The CPU core that requested the access.
+ */
+static void cache_umon_access(Cache *c, uint64_t line_addr,
+                              uint64_t set_index, unsigned int core_id)
+{
+    CacheUmon *umon = c->umon;
+
+    if (set_index % umon->sample_stride == 0 &&
+        set_index / umon->sample_stride < umon->num_samples) {
+        uint64_t stack_index = (uint64_t)core_id * umon->num_samples +
+                               set_index / umon->sample_stride;
+        uint64_t *stack = &umon->stack[stack_index * c->num_ways];
+        unsigned int *depth = &umon->depth[stack_index];
+
+        /* find the line's position in the core's private LRU stack */
+        unsigned int pos = 0;
+        while (pos < *depth && stack[pos] != line_addr) {
+            pos++;
+        }
+        if (pos < *depth) {
+            umon->hits[core_id * c->num_ways + pos]++;
+        } else if (*depth < c->num_ways) {
+            pos = (*depth)++;
+        } else {
+            pos = c->num_ways - 1;
+        }
+
+        /* move it to the top */
+        memmove(&stack[1], &stack[0], pos * sizeof(uint64_t));
+        stack[0] = line_addr;
+    }
+
+    if (current_cycle >= umon->next_repartition) {
+        cache_repartition(c);
+        umon->next_repartition = current_cycle + DWP_INTERVAL;
+    }
+}
+
+/**
+ * Find the victim way of a set; see cache_find_victim().
+ *
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ * @tparam POLICY The replacement policy of the cache, or CACHE_ANY_POLICY if
+ *                only known at runtime.
+ */
+template <unsigned int WAYS, int POLICY>
+static inline unsigned int cache_victim(Cache *c, uint64_t set_index,
+                                        unsigned int core_id)
+{
+    /* get num ways */
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
+    const int policy = (POLICY != CACHE_ANY_POLICY) ? POLICY
+                                                    : c->replacement_policy;
+
+    /* find victim */
+    unsigned int victim_index = 0;
+    switch (policy) {
+        case LRU:
+        case TREE_PLRU:
+        case BIT_PLRU: {
+            /* line is invalid -> return the first invalid */
+            int invalid = cache_invalid_way<WAYS>(c, set_index);
+            if (invalid >= 0) {
+                victim_index = invalid;
+                break;
+            }
+
+            /* if not invalid line found -> return (pseudo-)LRU */
+            if (policy == LRU) {
+                victim_index = cache_lru_way<WAYS>(c, set_index);
+            } else if (policy == TREE_PLRU) {
+                victim_index = cache_tree_plru_way<WAYS>(c, set_index);
+            } else {
+                const uint8_t *mru = &c->rank[set_index * num_ways];
+                while (victim_index + 1 < num_ways && mru[victim_index]) {
+                    victim_index++;
+                }
+            }
+            break;
+        }
 
-    /* check if in cache */
-    for (unsigned int i = 0; i < c->num_ways; i++) {
-        CacheLine *line = &set->ways[i];
 
-        if (line == NULL) {
-            continue;
+        case RANDOM: {
+            /* return a random line */
+            if (c->private_rand) {
+                victim_index = rand_r(&c->rand_state) % num_ways;
+            } else {
+                victim_index = rand() % num_ways;
+                cache_rand_draws++;
+            }
+            break;
         }
 
-        if (line->tag == tag) {
-            /* hit */
-            if (is_write) { line->dirty = true; }
-            line->last_access_time = current_cycle;
-            // no need to install on write, as it is being done by in memsys.cpp
-            return HIT;
+        case SWP:
+        case DWP: {
+            /* line is invalid -> return the first invalid */
+            int invalid = cache_invalid_way<WAYS>(c, set_index);
+            victim_index = (invalid >= 0)
+                               ? invalid
+                               : cache_partition_way<WAYS>(c, set_index,
+                                                           core_id);
+            break;
         }
+
+    }
+
+    return victim_index;
+}
+
+/**
+ * Access the cache at the given address; see cache_access().
+ *
+ * @tparam TAG The type of the cache's tags.
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ * @tparam POW2_SETS Whether the number of sets is a power of two.
+ * @tparam POLICY The replacement policy of the cache, or CACHE_ANY_POLICY if
+ *                only known at runtime.
+ */
+template <typename TAG, unsigned int WAYS, bool POW2_SETS, int POLICY>
+static CacheResult cache_access_impl(Cache *c, uint64_t line_addr,
+                                     bool is_write, unsigned int core_id)
+{
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
+
+    /* calculate tag and set_index */
+    uint64_t tag, set_index;
+    cache_split<POW2_SETS>(c, line_addr, &tag, &set_index);
+
+    /* update statistics */
+    c->stat_write_access += is_write;
+    c->stat_read_access += !is_write;
+
+    if ((POLICY == CACHE_ANY_POLICY || POLICY == DWP) && c->umon) {
+        cache_umon_access(c, line_addr, set_index, core_id);
+    }
+
+    /* check if in cache; a tag wider than the tags stored can't be */
+    int way = (tag == (TAG)tag) ? cache_lookup<TAG, WAYS>(c, set_index, tag)
+                                : -1;
+    if (way >= 0) {
+        /* hit */
+        uint64_t index = set_index * num_ways + way;
+        if (is_write) { c->meta[index] |= CACHE_META_DIRTY; }
+        cache_touch<WAYS, POLICY>(c, set_index, way);
+        // no need to install on write, as it is being done by in memsys.cpp
+        return HIT;
     }
 
     /* it's a MISS -> update miss stat */
@@ -145,54 +902,121 @@ CacheResult cache_access(Cache *c, uint64_t line_addr, bool is_write,
 }
 
 /**
- * Install the cache line with the given address.
+ * Install the cache line with the given address; see cache_install().
  *
- * Also update the cache statistics accordingly.
- *
- * This is intended to be implemented in part A.
- *
- * @param c The cache to install the line into.
- * @param line_addr The address of the cache line to install (in units of the
- *                  cache line size, i.e., excluding the line offset bits).
- * @param is_write Whether this install is triggered by a write.
- * @param core_id The CPU core ID that requested this access.
+ * @tparam TAG The type of the cache's tags.
+ * @tparam WAYS The associativity of the cache, or 0 if only known at runtime.
+ * @tparam POW2_SETS Whether the number of sets is a power of two.
+ * @tparam POLICY The replacement policy of the cache, or CACHE_ANY_POLICY if
+ *                only known at runtime.
  */
-void cache_install(Cache *c, uint64_t line_addr, bool is_write,
-                   unsigned int core_id)
+template <typename TAG, unsigned int WAYS, bool POW2_SETS, int POLICY>
+static void cache_install_impl(Cache *c, uint64_t line_addr, bool is_write,
+                               unsigned int core_id)
 {
-    // TODO: Use cache_find_victim() to determine the victim line to evict.
-    // TODO: Copy it into a last_evicted_line field in the cache in order to
-    //       track writebacks.
-    // TODO: Initialize the victim entry with the line to install.
-    // TODO: Update the appropriate cache statistics.
+    const unsigned int num_ways = WAYS ? WAYS : c->num_ways;
 
     /* calculate tag and set_index */
-    unsigned int tag = line_addr / c->num_sets;
-    unsigned int set_index = line_addr % c->num_sets;
-
-    /* index the cache set */
-    CacheSet *set = &c->sets[set_index];
+    uint64_t tag, set_index;
+    cache_split<POW2_SETS>(c, line_addr, &tag, &set_index);
+    if (tag != (TAG)tag) {
+        cache_widen_tags(c);
+        c->install(c, line_addr, is_write, core_id);
+        return;
+    }
 
     /* find victim */
-    unsigned int victim_index = cache_find_victim(c, set_index, core_id);
-    CacheLine *victim = &set->ways[victim_index];
+    unsigned int victim_index = cache_victim<WAYS, POLICY>(c, set_index,
+                                                           core_id);
+    uint64_t index = set_index * num_ways + victim_index;
+    TAG *tags = (TAG *)c->tags;
+    bool victim_valid = c->meta[index] & CACHE_META_VALID;
+    bool victim_dirty = c->meta[index] & CACHE_META_DIRTY;
 
     /* update statistics */
-    if (victim->valid && victim->dirty) {
+    if (victim_valid && victim_dirty) {
         c->stat_dirty_evicts++;
     }
 
     /* record last evicted line */
-    c->last_evicted_line = *victim;
+    CacheLine *evicted = &c->last_evicted_line;
+    evicted->valid = victim_valid;
+    evicted->dirty = victim_dirty;
+    evicted->tag = tags[index];
+    evicted->line_addr = POW2_SETS ? (evicted->tag << c->set_shift) | set_index
+                                   : evicted->tag * c->num_sets + set_index;
+    evicted->core_id = c->meta[index] >> CACHE_META_OWNER_SHIFT;
 
     /* install new line in cache */
-    victim->valid = true;
-    victim->dirty = is_write;
-    victim->tag = tag;
-    victim->line_addr = line_addr;
-    victim->core_id = core_id;
-    victim->last_access_time = current_cycle;
+    tags[index] = tag;
+    c->meta[index] = CACHE_META_VALID | (is_write ? CACHE_META_DIRTY : 0) |
+                     (core_id << CACHE_META_OWNER_SHIFT);
+    cache_touch<WAYS, POLICY>(c, set_index, victim_index);
+}
+
+/** One specialization of cache_access() and cache_install(). */
+typedef struct CacheImpl
+{
+    bool wide_tags;
+    unsigned int num_ways;
+    ReplacementPolicy replacement_policy;
+    CacheAccessFn access;
+    CacheInstallFn install;
+} CacheImpl;
+
+#define CACHE_IMPL(tag_type, ways, policy)                                    \
+    { sizeof(tag_type) == sizeof(uint64_t), ways, policy,                     \
+      &cache_access_impl<tag_type, ways, true, policy>,                       \
+      &cache_install_impl<tag_type, ways, true, policy> }
+
+/**
+ * The specializations for the common cache geometries (e.g., 32 KB 8-way L1
+ * caches and 512 KB to 4 MB 16-way L2 caches), all with a power-of-two number
+ * of sets. Any other cache uses the generic implementation.
+ */
+#define CACHE_IMPLS(tag_type, ways)                                           \
+    CACHE_IMPL(tag_type, ways, LRU), CACHE_IMPL(tag_type, ways, RANDOM),      \
+    CACHE_IMPL(tag_type, ways, TREE_PLRU),                                    \
+    CACHE_IMPL(tag_type, ways, BIT_PLRU), CACHE_IMPL(tag_type, ways, SWP),  \
+    CACHE_IMPL(tag_type, ways, DWP)
+
+static const CacheImpl cache_impls[] = {
+    CACHE_IMPLS(uint32_t, 4), CACHE_IMPLS(uint32_t, 8),
+    CACHE_IMPLS(uint32_t, 16), CACHE_IMPLS(uint64_t, 4),
+    CACHE_IMPLS(uint64_t, 8), CACHE_IMPLS(uint64_t, 16),
+};
+
+/**
+ * Pick the implementation of cache_access() and cache_install() for a cache:
+ * the specialization for its geometry and replacement policy if there is one,
+ * and the generic implementation otherwise.
+ *
+ * @param c The cache to pick the implementation for.
+ */
+static void cache_specialize(Cache *c)
+{
+    if (c->wide_tags) {
+        c->access = &cache_access_impl<uint64_t, 0, false, CACHE_ANY_POLICY>;
+        c->install = &cache_install_impl<uint64_t, 0, false, CACHE_ANY_POLICY>;
+    } else {
+        c->access = &cache_access_impl<uint32_t, 0, false, CACHE_ANY_POLICY>;
+        c->install = &cache_install_impl<uint32_t, 0, false, CACHE_ANY_POLICY>;
+    }
+
+    if (c->num_sets & (c->num_sets - 1)) {
+        return;
+    }
 
+    for (size_t i = 0; i < sizeof(cache_impls) / sizeof(cache_impls[0]); i++) {
+        const CacheImpl *impl = &cache_impls[i];
+        if (impl->wide_tags == c->wide_tags &&
+            impl->num_ways == c->num_ways &&
+            impl->replacement_policy == c->replacement_policy) {
+            c->access = impl->access;
+            c->install = impl->install;
+            return;
+        }
+    }
 }
 
 /**
@@ -214,59 +1038,109 @@ void cache_install(Cache *c, uint64_t line_addr, bool is_write,
 unsigned int cache_find_victim(Cache *c, unsigned int set_index,
                                unsigned int core_id)
 {
-    // TODO: Find a victim way in the given cache set according to the cache's
-    //       replacement policy.
-    // TODO: In part A, implement the LRU and random replacement policies.
-    // TODO: In part E, for extra credit, implement static way partitioning.
-    // TODO: In part F, for extra credit, implement dynamic way partitioning.
+    return cache_victim<0, CACHE_ANY_POLICY>(c, set_index, core_id);
+}
 
-    /* get num ways */
-    unsigned int num_ways = c->num_ways;
-    ReplacementPolicy  policy = c->replacement_policy;
+bool cache_probe(Cache *c, uint64_t line_addr)
+{
+    uint64_t tag, set_index;
+    cache_split<false>(c, line_addr, &tag, &set_index);
 
-    /* index the cache set */
-    CacheSet *set = &c->sets[set_index];
+    if (c->wide_tags) {
+        return cache_lookup<uint64_t, 0>(c, set_index, tag) >= 0;
+    }
+    return tag == (uint32_t)tag &&
+           cache_lookup<uint32_t, 0>(c, set_index, (uint32_t)tag) >= 0;
+}
 
-    /* find victim */
-    unsigned int victim_index = 0;
-    switch (policy) {
-        case LRU: {
-            /* find the least-recently-used line in set */
-            unsigned long long min_time = current_cycle;
-            for (unsigned int i = 0; i < num_ways; i++) {
-
-                /* line is invalid -> return the first invalid */
-                if (!set->ways[i].valid) {
-                    victim_index = i;
-                    break;
-                }
+/**
+ * Write a block of cache state to a checkpoint; see checkpoint_write().
+ */
+static bool cache_write_block(gzFile gz, void *data, uint64_t size)
+{
+    return checkpoint_write(gz, data, size);
+}
 
-                /* if not invalid line found -> return LRU */
-                if (set->ways[i].last_access_time < min_time) {
-                    min_time = set->ways[i].last_access_time;
-                    victim_index = i;
-                }
+/**
+ * Save or restore the state of a cache after its geometry, which is the same
+ * for both.
+ *
+ * @param c The cache.
+ * @param gz The checkpoint file.
+ * @param load Whether to restore the state rather than save it.
+ * @return Whether the state was written or read in full.
+ */
+static bool cache_transfer(Cache *c, gzFile gz, bool load)
+{
+    bool (*transfer)(gzFile, void *, uint64_t) =
+        load ? checkpoint_read : cache_write_block;
 
-            }
-            break;
-        }
+    uint64_t num_lines = (uint64_t)c->num_sets * c->num_ways;
+    bool ok = transfer(gz, c->tags,
+                       num_lines * (c->wide_tags ? sizeof(uint64_t)
+                                                 : sizeof(uint32_t))) &&
+              transfer(gz, c->meta, num_lines) &&
+              transfer(gz, c->rank, num_lines) &&
+              transfer(gz, c->rank_cycle, c->num_sets * sizeof(uint64_t)) &&
+              transfer(gz, &c->last_evicted_line, sizeof(CacheLine)) &&
+              transfer(gz, &c->stat_read_access, sizeof(c->stat_read_access)) &&
+              transfer(gz, &c->stat_read_miss, sizeof(c->stat_read_miss)) &&
+              transfer(gz, &c->stat_write_access,
+                       sizeof(c->stat_write_access)) &&
+              transfer(gz, &c->stat_write_miss, sizeof(c->stat_write_miss)) &&
+              transfer(gz, &c->stat_dirty_evicts,
+                       sizeof(c->stat_dirty_evicts));
 
+    if (ok && c->quota) {
+        ok = transfer(gz, c->quota, NUM_CORES * sizeof(unsigned int));
+    }
 
-        case RANDOM: {
-            /* return a random line */
-            victim_index = rand() % num_ways;
-            break;
-        }
+    if (ok && c->umon) {
+        CacheUmon *umon = c->umon;
+        uint64_t num_stacks = (uint64_t)NUM_CORES * umon->num_samples;
+        ok = transfer(gz, umon->stack,
+                      num_stacks * c->num_ways * sizeof(uint64_t)) &&
+             transfer(gz, umon->depth, num_stacks * sizeof(unsigned int)) &&
+             transfer(gz, umon->hits, (uint64_t)NUM_CORES * c->num_ways *
+                                          sizeof(unsigned long long)) &&
+             transfer(gz, &umon->next_repartition, sizeof(uint64_t));
+    }
 
-        case SWP: break;
+    return ok;
+}
 
-        case DWP: break;
+bool cache_save(Cache *c, gzFile gz)
+{
+    uint64_t geometry[5] = {c->num_sets, c->num_ways, c->line_size,
+                            (uint64_t)c->replacement_policy, c->wide_tags};
+    return checkpoint_write(gz, geometry, sizeof(geometry)) &&
+           cache_transfer(c, gz, false);
+}
 
+bool cache_load(Cache *c, gzFile gz)
+{
+    uint64_t geometry[5];
+    if (!checkpoint_read(gz, geometry, sizeof(geometry))) {
+        return false;
     }
 
+    if (geometry[0] != c->num_sets || geometry[1] != c->num_ways ||
+        geometry[2] != c->line_size ||
+        geometry[3] != (uint64_t)c->replacement_policy) {
+        fprintf(stderr, "Error: checkpoint has a %llu-set, %llu-way cache "
+                        "with replacement policy %llu where a %u-set, "
+                        "%u-way one with policy %d is configured\n",
+                (unsigned long long)geometry[0],
+                (unsigned long long)geometry[1],
+                (unsigned long long)geometry[3], c->num_sets, c->num_ways,
+                (int)c->replacement_policy);
+        return false;
+    }
 
-
-    return victim_index; // to suppress warning
+    if (geometry[4] && !c->wide_tags) {
+        cache_widen_tags(c);
+    }
+    return cache_transfer(c, gz, true);
 }
 
 /**
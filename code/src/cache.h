@@ -12,6 +12,7 @@
 #include "types.h"
 // You may add any other #include directives you need here, but make sure they
 // compile on the reference machine!
+#include <zlib.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 //                                 CONSTANTS                                 //
@@ -40,6 +41,12 @@ typedef enum ReplacementPolicyEnum
      * Part F asks you to implement this policy for extra credit.
      */
     DWP = 3,
+
+    /** Evict the way a binary tree of bits points at (tree pseudo-LRU). */
+    TREE_PLRU = 4,
+
+    /** Evict the first way whose MRU bit is clear (bit pseudo-LRU). */
+    BIT_PLRU = 5,
 } ReplacementPolicy;
 
 /**
@@ -50,6 +57,24 @@ typedef enum ReplacementPolicyEnum
  */
 #define MAX_WAYS_PER_CACHE_SET 16
 
+/** The bit of a line's metadata byte that is set if the line is dirty. */
+#define CACHE_META_DIRTY 0x1
+
+/** The bit of a line's metadata byte that is set if the line is valid. */
+#define CACHE_META_VALID 0x2
+
+/**
+ * The position of the CPU core that installed a line in its metadata byte,
+ * which takes up the bits above the flags.
+ */
+#define CACHE_META_OWNER_SHIFT 2
+
+/** The number of distinct owning CPU cores a line's metadata can record. */
+#define CACHE_MAX_OWNERS (1 << (8 - CACHE_META_OWNER_SHIFT))
+
+/** The number of sets sampled by the utility monitor of a DWP cache. */
+#define CACHE_UMON_SETS 32
+
 ///////////////////////////////////////////////////////////////////////////////
 //                              DATA STRUCTURES                              //
 ///////////////////////////////////////////////////////////////////////////////
@@ -64,19 +89,48 @@ typedef struct CacheLine
     uint64_t line_addr;
     uint64_t tag;
     unsigned int core_id;
-    uint64_t last_access_time;
 
 } CacheLine;
 
-/** A single cache set. */
-typedef struct CacheSet
+/**
+ * The utility monitor (UMON) of a cache with dynamic way partitioning.
+ *
+ * For a sample of the sets, it keeps the LRU stack each core would see if it
+ * had the whole cache to itself, and counts the hits at each stack position:
+ * hits at position p are the hits the core would lose with only p ways.
+ */
+typedef struct CacheUmon
 {
-    CacheLine ways[MAX_WAYS_PER_CACHE_SET];
+    /* every sample_stride-th set is sampled, num_samples sets in all */
+    unsigned int sample_stride;
+    unsigned int num_samples;
+
+    /**
+     * For each core and sampled set, the line addresses in its LRU stack,
+     * most recently used first, and the number of them.
+     */
+    uint64_t *stack;
+    unsigned int *depth;
 
-} CacheSet;
+    /* for each core, the hits at each stack position (halved periodically) */
+    unsigned long long *hits;
+
+    /* the cycle at which the cache is next repartitioned */
+    uint64_t next_repartition;
+} CacheUmon;
+
+typedef struct Cache Cache;
+
+/** An implementation of cache_access(). */
+typedef CacheResult (*CacheAccessFn)(Cache *c, uint64_t line_addr,
+                                     bool is_write, unsigned int core_id);
+
+/** An implementation of cache_install(). */
+typedef void (*CacheInstallFn)(Cache *c, uint64_t line_addr, bool is_write,
+                               unsigned int core_id);
 
 /** A single cache module. */
-typedef struct Cache
+struct Cache
 {
     // TODO: Define any other fields you need here.
     // Refer to Appendix A for details on other fields you will need here.
@@ -96,8 +150,66 @@ typedef struct Cache
     /* replacement policy being used */
     ReplacementPolicy replacement_policy;
 
-    /* the cache */
-    CacheSet *sets;
+    /**
+     * If num_sets is a power of two, the number of set index bits in a line
+     * address and a mask of them.
+     */
+    unsigned int set_shift;
+    uint64_t set_mask;
+
+    /**
+     * The implementations of cache_access() and cache_install() for this
+     * cache, specialized at compile time for its associativity, number of
+     * sets and replacement policy if it has a common geometry.
+     */
+    CacheAccessFn access;
+    CacheInstallFn install;
+
+    /**
+     * The lines of the cache, stored as one array per field so that the
+     * tags of a set are contiguous and can be compared all at once. Way w of
+     * set s is at index s * num_ways + w. The arrays take up 6 to 7 bytes per
+     * line for caches of 8 or more ways, and are only backed by host memory
+     * where sets have been touched.
+     */
+
+    /**
+     * The tag of each line, or 0 if it is invalid. Tags are uint32_t until a
+     * tag needs more bits, and uint64_t from then on.
+     */
+    void *tags;
+    bool wide_tags;
+
+    /* CACHE_META_* flags and the owning CPU core of each line */
+    uint8_t *meta;
+
+    /**
+     * The replacement state of each line: its recency rank for LRU, its MRU
+     * bit for BIT_PLRU, and the tree bits of its set for TREE_PLRU; see
+     * cache_touch() in cache.cpp.
+     */
+    uint8_t *rank;
+
+    /* the cycle in which the most recently used lines of each set were used */
+    uint64_t *rank_cycle;
+
+    /**
+     * For SWP and DWP, the number of ways of each set that each CPU core may
+     * fill before it has to replace its own lines.
+     */
+    unsigned int *quota;
+
+    /* for DWP, the utility monitor that sets the quotas */
+    CacheUmon *umon;
+
+    /**
+     * For RANDOM, whether victims are drawn from rand_state, which belongs
+     * to this cache alone, rather than from rand(). A cache private to a CPU
+     * core that is simulated on a thread of its own needs this, so that its
+     * victims don't depend on how the threads interleave.
+     */
+    bool private_rand;
+    unsigned int rand_state;
 
     /* the last evicted line from the cache */
     CacheLine last_evicted_line;
@@ -131,7 +243,7 @@ typedef struct Cache
      * You should initialize this to 0 and update it for every dirty eviction!
      */
     unsigned long long stat_dirty_evicts;
-} Cache;
+};
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -177,8 +289,11 @@ Cache *cache_new(uint64_t size, uint64_t associativity, uint64_t line_size,
  * @param core_id The CPU core ID that requested this access.
  * @return Whether the cache access was a hit or a miss.
  */
-CacheResult cache_access(Cache *c, uint64_t line_addr, bool is_write,
-                         unsigned int core_id);
+inline CacheResult cache_access(Cache *c, uint64_t line_addr, bool is_write,
+                                unsigned int core_id)
+{
+    return c->access(c, line_addr, is_write, core_id);
+}
 
 /**
  * Install the cache line with the given address.
@@ -193,8 +308,22 @@ CacheResult cache_access(Cache *c, uint64_t line_addr, bool is_write,
  * @param is_write Whether this install is triggered by a write.
  * @param core_id The CPU core ID that requested this access.
  */
-void cache_install(Cache *c, uint64_t line_addr, bool is_write,
-                   unsigned int core_id);
+inline void cache_install(Cache *c, uint64_t line_addr, bool is_write,
+                          unsigned int core_id)
+{
+    c->install(c, line_addr, is_write, core_id);
+}
+
+/**
+ * Check whether the line with the given address is in the cache, without
+ * touching its replacement state or the cache statistics.
+ *
+ * @param c The cache to search.
+ * @param line_addr The address of the cache line to look for (in units of the
+ *                  cache line size, i.e., excluding the line offset bits).
+ * @return Whether the line is in the cache.
+ */
+bool cache_probe(Cache *c, uint64_t line_addr);
 
 /**
  * Find which way in a given cache set to replace when a new cache line needs
@@ -215,6 +344,27 @@ void cache_install(Cache *c, uint64_t line_addr, bool is_write,
 unsigned int cache_find_victim(Cache *c, unsigned int set_index,
                                unsigned int core_id);
 
+/**
+ * Write the contents, replacement state, and statistics of a cache to a
+ * checkpoint.
+ *
+ * @param c The cache to save.
+ * @param gz The checkpoint file.
+ * @return Whether the cache was written.
+ */
+bool cache_save(Cache *c, gzFile gz);
+
+/**
+ * Restore the contents, replacement state, and statistics of a cache from a
+ * checkpoint. The cache must have just been created with the same geometry
+ * and replacement policy as the one saved.
+ *
+ * @param c The cache to restore.
+ * @param gz The checkpoint file.
+ * @return Whether the cache was restored.
+ */
+bool cache_load(Cache *c, gzFile gz);
+
 /**
  * Print the statistics of the given cache.
  *
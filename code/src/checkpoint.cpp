@@ -0,0 +1,478 @@
+// checkpoint.cpp
+// Defines the functions for checkpoints.
+//
+// A checkpoint is laid out as follows, each field in host byte order:
+//
+//   header: CHECKPOINT_MAGIC, version, mode, number of cores, number of
+//           MSHRs, ROB size, and for each core, the number of trace records
+//           it has read and whether it is done
+//   body:   the current cycle, the number of rand() victims drawn, the
+//           state of each core (with MSHRs or out of order, including its
+//           pending loads or the instructions in flight),
+//           the memory system statistics, the state of each cache in the
+//           order of checkpoint_caches(), the DRAM, and the MSHRs, MLP
+//           histograms and prefetchers if there are any
+//   end:    CHECKPOINT_MAGIC again, to catch truncated files
+
+#include "checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The size of the blocks state is read and written in, in bytes. */
+#define CHECKPOINT_BLOCK 4096
+
+/** The number of fields saved for each core. */
+#define CHECKPOINT_CORE_FIELDS 7
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  GLOBALS                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+extern Mode SIM_MODE;
+extern unsigned int NUM_CORES;
+extern uint64_t SKIP_INST;
+extern unsigned int LOAD_USE_DIST;
+extern unsigned int MSHRS;
+extern unsigned int ROB_SIZE;
+
+/** The current clock cycle number. */
+extern thread_local uint64_t current_cycle;
+
+/** The number of victims drawn from rand() so far. */
+extern uint64_t cache_rand_draws;
+
+///////////////////////////////////////////////////////////////////////////////
+//                           FUNCTION DEFINITIONS                            //
+///////////////////////////////////////////////////////////////////////////////
+
+bool checkpoint_write(gzFile gz, const void *data, uint64_t size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    while (size)
+    {
+        unsigned int len = (size < CHECKPOINT_BLOCK) ? size : CHECKPOINT_BLOCK;
+        if (gzwrite(gz, p, len) != (int)len)
+        {
+            return false;
+        }
+        p += len;
+        size -= len;
+    }
+    return true;
+}
+
+bool checkpoint_read(gzFile gz, void *data, uint64_t size)
+{
+    uint8_t block[CHECKPOINT_BLOCK];
+    uint8_t *p = (uint8_t *)data;
+    while (size)
+    {
+        unsigned int len = (size < CHECKPOINT_BLOCK) ? size : CHECKPOINT_BLOCK;
+        if (gzread(gz, block, len) != (int)len)
+        {
+            return false;
+        }
+        if (memcmp(p, block, len) != 0)
+        {
+            memcpy(p, block, len);
+        }
+        p += len;
+        size -= len;
+    }
+    return true;
+}
+
+/**
+ * List the caches of the memory system that are in use in this mode, in the
+ * order they are saved in.
+ *
+ * @return The number of caches.
+ */
+static unsigned int checkpoint_caches(MemorySystem *sys, Cache **caches)
+{
+    unsigned int n = 0;
+    if (SIM_MODE == SIM_MODE_DEF)
+    {
+        for (unsigned int i = 0; i < NUM_CORES; i++)
+        {
+            caches[n++] = sys->icache_coreid[i];
+            caches[n++] = sys->dcache_coreid[i];
+        }
+    }
+    else
+    {
+        if (sys->icache)
+        {
+            caches[n++] = sys->icache;
+        }
+        caches[n++] = sys->dcache;
+    }
+
+    if (sys->l2cache)
+    {
+        caches[n++] = sys->l2cache;
+    }
+    return n;
+}
+
+/**
+ * With MSHRs, save or restore the loads a core hasn't used the data of yet.
+ */
+static bool checkpoint_transfer_loads(Core *core, gzFile gz, bool load)
+{
+    uint64_t ring[3] = {LOAD_USE_DIST, core->load_head, core->load_count};
+    if (load ? !checkpoint_read(gz, ring, sizeof(ring))
+             : !checkpoint_write(gz, ring, sizeof(ring)))
+    {
+        return false;
+    }
+    if (ring[0] != LOAD_USE_DIST || ring[1] >= LOAD_USE_DIST ||
+        ring[2] > LOAD_USE_DIST)
+    {
+        fprintf(stderr, "Error: checkpoint was saved with a load use "
+                        "distance of %llu\n",
+                (unsigned long long)ring[0]);
+        return false;
+    }
+    core->load_head = ring[1];
+    core->load_count = ring[2];
+
+    uint64_t ready_size = LOAD_USE_DIST * sizeof(uint64_t);
+    uint64_t use_size = LOAD_USE_DIST * sizeof(unsigned long long);
+    if (load)
+    {
+        return checkpoint_read(gz, core->load_ready_cycle, ready_size) &&
+               checkpoint_read(gz, core->load_use_inst, use_size);
+    }
+    return checkpoint_write(gz, core->load_ready_cycle, ready_size) &&
+           checkpoint_write(gz, core->load_use_inst, use_size);
+}
+
+/**
+ * With the out-of-order model, save or restore the instructions a core has
+ * in flight.
+ */
+static bool checkpoint_transfer_rob(Core *core, gzFile gz, bool load)
+{
+    uint64_t rob[8] = {ROB_SIZE,
+                       core->rob_head,
+                       core->rob_count,
+                       core->lsq_count,
+                       core->retire_cycle,
+                       core->fetch_done,
+                       core->stat_rob_full_cycles,
+                       core->stat_lsq_full_cycles};
+    if (load ? !checkpoint_read(gz, rob, sizeof(rob))
+             : !checkpoint_write(gz, rob, sizeof(rob)))
+    {
+        return false;
+    }
+    if (rob[0] != ROB_SIZE || rob[1] >= ROB_SIZE || rob[2] > ROB_SIZE)
+    {
+        fprintf(stderr, "Error: checkpoint was saved with a %llu-entry "
+                        "ROB\n",
+                (unsigned long long)rob[0]);
+        return false;
+    }
+    core->rob_head = rob[1];
+    core->rob_count = rob[2];
+    core->lsq_count = rob[3];
+    core->retire_cycle = rob[4];
+    core->fetch_done = rob[5];
+    core->stat_rob_full_cycles = rob[6];
+    core->stat_lsq_full_cycles = rob[7];
+
+    uint64_t complete_size = ROB_SIZE * sizeof(uint64_t);
+    uint64_t is_mem_size = ROB_SIZE * sizeof(bool);
+    if (load)
+    {
+        return checkpoint_read(gz, core->rob_complete_cycle, complete_size) &&
+               checkpoint_read(gz, core->rob_is_mem, is_mem_size);
+    }
+    return checkpoint_write(gz, core->rob_complete_cycle, complete_size) &&
+           checkpoint_write(gz, core->rob_is_mem, is_mem_size);
+}
+
+/**
+ * Save or restore the state of the memory system; see cache_transfer() in
+ * cache.cpp and dram_transfer() in dram.cpp.
+ */
+static bool checkpoint_transfer_memsys(MemorySystem *sys, gzFile gz,
+                                       bool load)
+{
+    unsigned long long stats[7] = {
+        sys->stat_ifetch_access, sys->stat_load_access,
+        sys->stat_store_access,  sys->stat_ifetch_delay,
+        sys->stat_load_delay,    sys->stat_store_delay,
+        sys->stat_ifetch_buffered,
+    };
+    if (load ? !checkpoint_read(gz, stats, sizeof(stats))
+             : !checkpoint_write(gz, stats, sizeof(stats)))
+    {
+        return false;
+    }
+    sys->stat_ifetch_access = stats[0];
+    sys->stat_load_access = stats[1];
+    sys->stat_store_access = stats[2];
+    sys->stat_ifetch_delay = stats[3];
+    sys->stat_load_delay = stats[4];
+    sys->stat_store_delay = stats[5];
+    sys->stat_ifetch_buffered = stats[6];
+
+    Cache *caches[2 * CACHE_MAX_OWNERS + 1];
+    unsigned int num_caches = checkpoint_caches(sys, caches);
+    for (unsigned int i = 0; i < num_caches; i++)
+    {
+        if (load ? !cache_load(caches[i], gz) : !cache_save(caches[i], gz))
+        {
+            return false;
+        }
+    }
+
+    if (!sys->dram)
+    {
+        return true;
+    }
+    if (load ? !dram_load(sys->dram, gz) : !dram_save(sys->dram, gz))
+    {
+        return false;
+    }
+
+    for (unsigned int i = 0; sys->l2cache_mshr && i < NUM_CORES; i++)
+    {
+        bool ok = load ? mshr_load(sys->icache_mshr[i], gz) &&
+                             mshr_load(sys->dcache_mshr[i], gz) &&
+                             mshr_mlp_load(sys->mlp[i], gz)
+                       : mshr_save(sys->icache_mshr[i], gz) &&
+                             mshr_save(sys->dcache_mshr[i], gz) &&
+                             mshr_mlp_save(sys->mlp[i], gz);
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    if (sys->l2cache_mshr && (load ? !mshr_load(sys->l2cache_mshr, gz)
+                                   : !mshr_save(sys->l2cache_mshr, gz)))
+    {
+        return false;
+    }
+
+    // In modes B and C, the cores share one data cache and its prefetcher.
+    for (unsigned int i = 0; sys->dcache_prefetch && i < NUM_CORES; i++)
+    {
+        Prefetcher *pf = sys->dcache_prefetch[i];
+        if (pf && (load ? !prefetch_load(pf, gz) : !prefetch_save(pf, gz)))
+        {
+            return false;
+        }
+    }
+    if (!sys->l2cache_prefetch)
+    {
+        return true;
+    }
+    return load ? prefetch_load(sys->l2cache_prefetch, gz)
+                : prefetch_save(sys->l2cache_prefetch, gz);
+}
+
+bool checkpoint_save(const char *filename, MemorySystem *sys, Core **cores,
+                     unsigned int num_cores)
+{
+    gzFile gz = gzopen(filename, "wb");
+    if (!gz)
+    {
+        perror("Couldn't create checkpoint");
+        return false;
+    }
+
+    uint32_t header[6];
+    memcpy(&header[0], CHECKPOINT_MAGIC, 4);
+    header[1] = CHECKPOINT_VERSION;
+    header[2] = SIM_MODE;
+    header[3] = num_cores;
+    header[4] = MSHRS;
+    header[5] = ROB_SIZE;
+    bool ok = checkpoint_write(gz, header, sizeof(header));
+
+    for (unsigned int i = 0; ok && i < num_cores; i++)
+    {
+        // A core whose trace has run out reads nothing more from it, even
+        // with instructions still in flight.
+        uint64_t trace[2] = {SKIP_INST + cores[i]->trace_records,
+                             cores[i]->done || cores[i]->fetch_done};
+        ok = checkpoint_write(gz, trace, sizeof(trace));
+    }
+
+    uint64_t clock[2] = {current_cycle, cache_rand_draws};
+    ok = ok && checkpoint_write(gz, clock, sizeof(clock));
+
+    for (unsigned int i = 0; ok && i < num_cores; i++)
+    {
+        Core *core = cores[i];
+        uint64_t fields[CHECKPOINT_CORE_FIELDS] = {
+            core->done, core->snooze_end_cycle, core->inst_count,
+            core->done_inst_count, core->done_cycle_count,
+            core->fetch_block, core->fetch_block_valid,
+        };
+        ok = checkpoint_write(gz, fields, sizeof(fields));
+        if (ok && core->load_ready_cycle)
+        {
+            ok = checkpoint_transfer_loads(core, gz, false);
+        }
+        if (ok && core->rob_complete_cycle)
+        {
+            ok = checkpoint_transfer_rob(core, gz, false);
+        }
+    }
+
+    ok = ok && checkpoint_transfer_memsys(sys, gz, false) &&
+         checkpoint_write(gz, CHECKPOINT_MAGIC, 4);
+
+    if (gzclose(gz) != Z_OK || !ok)
+    {
+        fprintf(stderr, "Error: couldn't write checkpoint %s\n", filename);
+        return false;
+    }
+    return true;
+}
+
+Checkpoint *checkpoint_open(const char *filename)
+{
+    gzFile gz = gzopen(filename, "rb");
+    if (!gz)
+    {
+        perror("Couldn't open checkpoint");
+        return NULL;
+    }
+
+    uint32_t header[6];
+    if (!checkpoint_read(gz, header, sizeof(header)) ||
+        memcmp(&header[0], CHECKPOINT_MAGIC, 4) != 0 ||
+        header[1] != CHECKPOINT_VERSION)
+    {
+        fprintf(stderr, "Error: %s is not a checkpoint\n", filename);
+        gzclose(gz);
+        return NULL;
+    }
+
+    if (header[2] != (uint32_t)SIM_MODE || header[3] != NUM_CORES)
+    {
+        fprintf(stderr, "Error: checkpoint %s was saved in mode %u with %u "
+                        "cores\n",
+                filename, header[2], header[3]);
+        gzclose(gz);
+        return NULL;
+    }
+
+    // Which state follows for each core and the memory system depends on
+    // these, so a mismatch can't be caught once reading it.
+    if (header[4] != MSHRS || header[5] != ROB_SIZE)
+    {
+        fprintf(stderr, "Error: checkpoint %s was saved with -mshrs %u and "
+                        "-rob %u\n",
+                filename, header[4], header[5]);
+        gzclose(gz);
+        return NULL;
+    }
+
+    Checkpoint *ck = (Checkpoint *)calloc(1, sizeof(Checkpoint));
+    if (!ck)
+    {
+        exit(1);
+    }
+    ck->gz = gz;
+    ck->num_cores = header[3];
+
+    for (unsigned int i = 0; i < ck->num_cores; i++)
+    {
+        uint64_t trace[2];
+        if (checkpoint_read(gz, trace, sizeof(trace)))
+        {
+            ck->trace_records[i] = trace[0];
+            ck->done[i] = trace[1];
+        }
+        else
+        {
+            fprintf(stderr, "Error: checkpoint %s is truncated\n", filename);
+            gzclose(gz);
+            free(ck);
+            return NULL;
+        }
+    }
+    return ck;
+}
+
+uint64_t checkpoint_trace_start(Checkpoint *ck, unsigned int core_id)
+{
+    // The last record read was the next instruction to execute, unless the
+    // core had run out of them, so the core reads it again when created.
+    uint64_t records = ck->trace_records[core_id];
+    return ck->done[core_id] ? records : records - 1;
+}
+
+bool checkpoint_restore(Checkpoint *ck, MemorySystem *sys, Core **cores)
+{
+    gzFile gz = ck->gz;
+    for (unsigned int i = 0; i < NUM_CORES; i++)
+    {
+        cores[i]->trace_records = ck->trace_records[i];
+    }
+    free(ck);
+
+    uint64_t clock[2];
+    bool ok = checkpoint_read(gz, clock, sizeof(clock));
+    if (ok)
+    {
+        current_cycle = clock[0];
+
+        // Random replacement picks up the sequence of rand() where it was.
+        for (uint64_t i = 0; i < clock[1]; i++)
+        {
+            rand();
+        }
+        cache_rand_draws = clock[1];
+    }
+
+    for (unsigned int i = 0; ok && i < NUM_CORES; i++)
+    {
+        Core *core = cores[i];
+        uint64_t fields[CHECKPOINT_CORE_FIELDS];
+        ok = checkpoint_read(gz, fields, sizeof(fields));
+        if (!ok)
+        {
+            break;
+        }
+        core->done = fields[0];
+        core->snooze_end_cycle = fields[1];
+        core->inst_count = fields[2];
+        core->done_inst_count = fields[3];
+        core->done_cycle_count = fields[4];
+        core->fetch_block = fields[5];
+        core->fetch_block_valid = fields[6];
+        if (core->load_ready_cycle)
+        {
+            ok = checkpoint_transfer_loads(core, gz, true);
+        }
+        if (ok && core->rob_complete_cycle)
+        {
+            ok = checkpoint_transfer_rob(core, gz, true);
+        }
+    }
+
+    char magic[4];
+    ok = ok && checkpoint_transfer_memsys(sys, gz, true) &&
+         checkpoint_read(gz, magic, sizeof(magic)) &&
+         memcmp(magic, CHECKPOINT_MAGIC, 4) == 0;
+    gzclose(gz);
+
+    if (!ok)
+    {
+        fprintf(stderr, "Error: couldn't restore checkpoint\n");
+        return false;
+    }
+    return true;
+}
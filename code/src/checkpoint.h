@@ -0,0 +1,117 @@
+// checkpoint.h
+// Declares checkpoints, which save the warmed-up state of a simulation to a
+// file so that several experiments can start from it.
+//
+// A checkpoint holds the contents and replacement state of every cache, the
+// DRAM row buffers and controller queues, the position of each core in its
+// trace, and all the counters, so a simulation restored from a checkpoint
+// continues exactly like the one that saved it would have. It is a
+// gzip-compressed stream in the byte order of the host that wrote it.
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include "types.h"
+#include "core.h"
+#include "memsys.h"
+#include <zlib.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The magic bytes at the start of a checkpoint. */
+#define CHECKPOINT_MAGIC "MSCK"
+
+/** The version of the checkpoint format. */
+#define CHECKPOINT_VERSION 11
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** A checkpoint being restored. */
+typedef struct Checkpoint
+{
+    /* the checkpoint file, positioned after the header */
+    gzFile gz;
+
+    /**
+     * For each core, the number of records of its trace it had read,
+     * including any skipped, and whether it had run out of them.
+     */
+    unsigned int num_cores;
+    uint64_t trace_records[CACHE_MAX_OWNERS];
+    bool done[CACHE_MAX_OWNERS];
+} Checkpoint;
+
+///////////////////////////////////////////////////////////////////////////////
+//                            FUNCTION PROTOTYPES                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Save the state of a simulation between two cycles.
+ *
+ * @param filename The name of the checkpoint file to write.
+ * @param sys The memory system.
+ * @param cores The cores.
+ * @param num_cores The number of cores.
+ * @return Whether the checkpoint was written.
+ */
+bool checkpoint_save(const char *filename, MemorySystem *sys, Core **cores,
+                     unsigned int num_cores);
+
+/**
+ * Open a checkpoint and read its header, which tells where to open each
+ * trace before the cores are created.
+ *
+ * @param filename The name of the checkpoint file.
+ * @return The checkpoint, or NULL on error.
+ */
+Checkpoint *checkpoint_open(const char *filename);
+
+/**
+ * Find where a core's trace must be opened for the core to resume from a
+ * checkpoint.
+ *
+ * @param ck The checkpoint.
+ * @param core_id The core.
+ * @return The number of records to skip at the start of the trace.
+ */
+uint64_t checkpoint_trace_start(Checkpoint *ck, unsigned int core_id);
+
+/**
+ * Restore the memory system and cores from a checkpoint, and close it. The
+ * memory system and cores must have just been created with the same
+ * configuration as when the checkpoint was saved.
+ *
+ * @param ck The checkpoint.
+ * @param sys The memory system.
+ * @param cores The cores.
+ * @return Whether the state was restored.
+ */
+bool checkpoint_restore(Checkpoint *ck, MemorySystem *sys, Core **cores);
+
+/**
+ * Write a block of state to a checkpoint.
+ *
+ * @param gz The checkpoint file.
+ * @param data The state to write.
+ * @param size The size of the state in bytes.
+ * @return Whether it was written.
+ */
+bool checkpoint_write(gzFile gz, const void *data, uint64_t size);
+
+/**
+ * Read a block of state from a checkpoint. Pages that already hold what is
+ * read aren't written to, so memory that is only backed once written (see
+ * cache.cpp) stays unbacked where the state is empty.
+ *
+ * @param gz The checkpoint file.
+ * @param data Where to read the state to.
+ * @param size The size of the state in bytes.
+ * @return Whether it was read in full.
+ */
+bool checkpoint_read(gzFile gz, void *data, uint64_t size);
+
+#endif // __CHECKPOINT_H__
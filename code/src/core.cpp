@@ -8,37 +8,255 @@
 #include "core.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
-#include <sys/wait.h>
-#include <unistd.h>
 
-extern uint64_t current_cycle;
-
-int open_gunzip_pipe(const char *filename, int *fd, pid_t *pid);
-ssize_t trace_read(Core *core, void *buf, size_t size);
-
-Core *core_new(MemorySystem *memsys, const char *trace_filename,
+extern thread_local uint64_t current_cycle;
+extern thread_local uint64_t memsys_mshr_wait;
+extern thread_local uint64_t memsys_inst_pc;
+
+// The number of MSHRs of each L1 cache, or 0 if misses block the core.
+extern unsigned int MSHRS;
+
+// With MSHRs, how many instructions after a load the first use of its data
+// comes; the trace doesn't record dependences.
+extern unsigned int LOAD_USE_DIST;
+
+// The out-of-order model: the size of the reorder buffer, or 0 for the
+// in-order core, the number of instructions dispatched and retired per
+// cycle, the size of the load/store queue, and the execution latencies of
+// ALU and other instructions.
+extern unsigned int ROB_SIZE;
+extern unsigned int ISSUE_WIDTH;
+extern unsigned int LSQ_SIZE;
+extern unsigned int ALU_LATENCY;
+extern unsigned int OTHER_LATENCY;
+
+// The size of the aligned blocks instructions are fetched in, in bytes, or 0
+// to fetch every instruction on its own, and the number of instructions the
+// fetch buffer delivers per cycle.
+extern unsigned int FETCH_BLOCK;
+extern unsigned int FETCH_WIDTH;
+
+Core *core_new(MemorySystem *memsys, TraceReader *trace,
                unsigned int core_id)
 {
-    int trace_fd;
-    pid_t pid;
-    if (open_gunzip_pipe(trace_filename, &trace_fd, &pid) != 0)
-    {
-        return NULL;
-    }
-
     Core *core = (Core *)calloc(1, sizeof(Core));
     core->core_id = core_id;
     core->memsys = memsys;
-    core->trace_fd = trace_fd;
-    core->pid = pid;
-    core->read_buf_offset = 0;
-    core->read_buf_left = 0;
+    core->trace = trace;
+
+    if (ROB_SIZE)
+    {
+        core->rob_complete_cycle = (uint64_t *)calloc(ROB_SIZE,
+                                                      sizeof(uint64_t));
+        core->rob_is_mem = (bool *)calloc(ROB_SIZE, sizeof(bool));
+        if (!core->rob_complete_cycle || !core->rob_is_mem)
+        {
+            exit(1);
+        }
+    }
+    else if (MSHRS)
+    {
+        core->load_ready_cycle = (uint64_t *)calloc(LOAD_USE_DIST,
+                                                    sizeof(uint64_t));
+        core->load_use_inst = (unsigned long long *)calloc(
+            LOAD_USE_DIST, sizeof(unsigned long long));
+        if (!core->load_ready_cycle || !core->load_use_inst)
+        {
+            exit(1);
+        }
+    }
 
     core_read_trace(core);
     return core;
 }
 
+// With MSHRs, checks whether the data of the loads the next instruction
+// uses has arrived. If not, the core stalls until it does.
+static bool core_loads_ready(Core *core)
+{
+    while (core->load_count)
+    {
+        unsigned int i = core->load_head;
+        if (core->load_use_inst[i] > core->inst_count + 1)
+        {
+            break;
+        }
+        if (core->load_ready_cycle[i] > current_cycle)
+        {
+            core->snooze_end_cycle = core->load_ready_cycle[i] - 1;
+            return false;
+        }
+        core->load_head = (i + 1) % LOAD_USE_DIST;
+        core->load_count--;
+    }
+    return true;
+}
+
+// Fetches the core's next instruction and returns the delay. With fetch
+// blocks, the instruction cache is only accessed when the instruction is
+// outside the block in the fetch buffer, and the buffer is then refilled
+// with the instruction's block.
+static uint64_t core_fetch(Core *core)
+{
+    memsys_inst_pc = core->trace_inst_addr;
+    if (FETCH_BLOCK)
+    {
+        uint64_t block = core->trace_inst_addr / FETCH_BLOCK;
+        if (core->fetch_block_valid && block == core->fetch_block)
+        {
+            memsys_fetch_buffered(core->memsys, core->core_id);
+            return 0;
+        }
+        core->fetch_block = block;
+        core->fetch_block_valid = true;
+    }
+
+    return memsys_access(core->memsys, core->trace_inst_addr,
+                         ACCESS_TYPE_IFETCH, core->core_id);
+}
+
+// Checks whether the fetch buffer can deliver the core's next instruction
+// in the cycle it has already delivered the given number in: with fetch
+// blocks, it delivers up to FETCH_WIDTH per cycle, all from one block.
+static bool core_fetch_ready(Core *core, unsigned int fetched)
+{
+    if (!FETCH_BLOCK || fetched == 0)
+    {
+        return true;
+    }
+    return fetched < FETCH_WIDTH &&
+           core->trace_inst_addr / FETCH_BLOCK == core->fetch_block;
+}
+
+// Retires the instructions of an out-of-order core that have completed by
+// the given cycle, in order and at most ISSUE_WIDTH per cycle.
+static void core_retire(Core *core, uint64_t cycle)
+{
+    uint64_t t = core->retire_cycle;
+    while (core->rob_count)
+    {
+        uint64_t complete = core->rob_complete_cycle[core->rob_head];
+        if (complete > t)
+        {
+            t = complete;
+        }
+        if (t > cycle)
+        {
+            break;
+        }
+
+        for (unsigned int n = 0; n < ISSUE_WIDTH && core->rob_count; n++)
+        {
+            unsigned int i = core->rob_head;
+            if (core->rob_complete_cycle[i] > t)
+            {
+                break;
+            }
+            core->lsq_count -= core->rob_is_mem[i];
+            core->rob_head = (i + 1) % ROB_SIZE;
+            core->rob_count--;
+        }
+        t++;
+    }
+    core->retire_cycle = t;
+}
+
+// Runs a cycle of the out-of-order core: retires what has completed, then
+// dispatches up to ISSUE_WIDTH instructions. The traces don't record
+// dependences, so every instruction executes as soon as it is dispatched,
+// and loads overlap as far as the ROB and load/store queue allow. Memory
+// accesses are made at dispatch, and the core only stalls on an icache
+// miss or a full ROB or load/store queue.
+static void core_cycle_ooo(Core *core)
+{
+    core_retire(core, current_cycle);
+
+    if (core->fetch_done)
+    {
+        if (!core->rob_count)
+        {
+            core->done = true;
+            core->done_inst_count = core->inst_count;
+            core->done_cycle_count = current_cycle;
+            return;
+        }
+        uint64_t complete = core->rob_complete_cycle[core->rob_head];
+        core->snooze_end_cycle = (complete > current_cycle) ? complete - 1
+                                                            : current_cycle;
+        return;
+    }
+
+    for (unsigned int n = 0; n < ISSUE_WIDTH && core_fetch_ready(core, n); n++)
+    {
+        bool is_mem = (core->trace_inst_type == INST_TYPE_LOAD ||
+                       core->trace_inst_type == INST_TYPE_STORE);
+        bool rob_full = (core->rob_count == ROB_SIZE);
+        if (rob_full || (is_mem && core->lsq_count == LSQ_SIZE))
+        {
+            // Dispatch waits until the oldest instruction retires.
+            uint64_t complete = core->rob_complete_cycle[core->rob_head];
+            uint64_t wake = (complete > current_cycle) ? complete
+                                                       : current_cycle + 1;
+            if (rob_full)
+            {
+                core->stat_rob_full_cycles += wake - current_cycle;
+            }
+            else
+            {
+                core->stat_lsq_full_cycles += wake - current_cycle;
+            }
+            core->snooze_end_cycle = wake - 1;
+            return;
+        }
+
+        // The instruction starts once it has been fetched.
+        uint64_t ifetch_delay = core_fetch(core);
+        uint64_t start = current_cycle;
+        if (ifetch_delay > 1)
+        {
+            start += ifetch_delay - 1;
+        }
+
+        // Waits for MSHRs are part of the latency of loads and stores,
+        // since later instructions don't wait for them.
+        uint64_t latency = ALU_LATENCY;
+        if (core->trace_inst_type == INST_TYPE_LOAD)
+        {
+            latency = memsys_access(core->memsys, core->trace_ldst_addr,
+                                    ACCESS_TYPE_LOAD, core->core_id);
+        }
+        if (core->trace_inst_type == INST_TYPE_STORE)
+        {
+            // A store completes into the store buffer once it has an MSHR.
+            memsys_access(core->memsys, core->trace_ldst_addr,
+                          ACCESS_TYPE_STORE, core->core_id);
+            latency = 1 + memsys_mshr_wait;
+        }
+        if (core->trace_inst_type == INST_TYPE_OTHER)
+        {
+            latency = OTHER_LATENCY;
+        }
+
+        unsigned int i = (core->rob_head + core->rob_count) % ROB_SIZE;
+        core->rob_complete_cycle[i] = start + latency;
+        core->rob_is_mem[i] = is_mem;
+        core->rob_count++;
+        core->lsq_count += is_mem;
+        core->inst_count++;
+
+        core_read_trace(core);
+        if (ifetch_delay > 1)
+        {
+            core->snooze_end_cycle = start;
+            return;
+        }
+        if (core->done || core->fetch_done)
+        {
+            return;
+        }
+    }
+}
+
 void core_cycle(Core *core)
 {
     if (core->done)
@@ -52,14 +270,24 @@ void core_cycle(Core *core)
         return;
     }
 
+    if (core->rob_complete_cycle)
+    {
+        core_cycle_ooo(core);
+        return;
+    }
+
+    if (core->load_ready_cycle && !core_loads_ready(core))
+    {
+        return;
+    }
+
     core->inst_count++;
 
     uint64_t ifetch_delay = 0;
     uint64_t ld_delay = 0;
     uint64_t bubble_cycles = 0;
 
-    ifetch_delay = memsys_access(core->memsys, core->trace_inst_addr,
-                                 ACCESS_TYPE_IFETCH, core->core_id);
+    ifetch_delay = core_fetch(core);
     if (ifetch_delay > 1)
     {
         bubble_cycles += (ifetch_delay - 1);
@@ -70,7 +298,22 @@ void core_cycle(Core *core)
         ld_delay = memsys_access(core->memsys, core->trace_ldst_addr,
                                  ACCESS_TYPE_LOAD, core->core_id);
     }
-    if (ld_delay > 1)
+    if (core->load_ready_cycle && core->trace_inst_type == INST_TYPE_LOAD)
+    {
+        // With MSHRs, the core only waits for a free register, and the data
+        // when it is used.
+        uint64_t ready = current_cycle + bubble_cycles + ld_delay;
+        bubble_cycles += memsys_mshr_wait;
+        if (ld_delay > 1)
+        {
+            unsigned int i = (core->load_head + core->load_count) %
+                             LOAD_USE_DIST;
+            core->load_ready_cycle[i] = ready;
+            core->load_use_inst[i] = core->inst_count + LOAD_USE_DIST;
+            core->load_count++;
+        }
+    }
+    else if (ld_delay > 1)
     {
         bubble_cycles += (ld_delay - 1);
     }
@@ -79,8 +322,9 @@ void core_cycle(Core *core)
     {
         memsys_access(core->memsys, core->trace_ldst_addr, ACCESS_TYPE_STORE,
                       core->core_id);
+        bubble_cycles += memsys_mshr_wait;
     }
-    // We don't incur bubbles for store misses.
+    // We don't incur bubbles for store misses, unless they wait for an MSHR.
 
     if (bubble_cycles)
     {
@@ -90,27 +334,87 @@ void core_cycle(Core *core)
     core_read_trace(core);
 }
 
+// Runs the core's next instruction through the memory system without timing
+// it, for functional warming, and moves on to the one after it. Once the
+// trace has run out, there is nothing left to warm, and only core_cycle()
+// can drain the instructions still in flight.
+void core_warm(Core *core)
+{
+    if (core->done || core->fetch_done)
+    {
+        return;
+    }
+
+    // With fetch blocks, only the first instruction fetched from each block
+    // accesses the icache, as in core_fetch().
+    memsys_inst_pc = core->trace_inst_addr;
+    uint64_t block = FETCH_BLOCK ? core->trace_inst_addr / FETCH_BLOCK : 0;
+    if (!core->fetch_block_valid || block != core->fetch_block)
+    {
+        memsys_warm(core->memsys, core->trace_inst_addr, ACCESS_TYPE_IFETCH,
+                    core->core_id);
+        core->fetch_block = block;
+        core->fetch_block_valid = (FETCH_BLOCK != 0);
+    }
+    if (core->trace_inst_type == INST_TYPE_LOAD)
+    {
+        memsys_warm(core->memsys, core->trace_ldst_addr, ACCESS_TYPE_LOAD,
+                    core->core_id);
+    }
+    if (core->trace_inst_type == INST_TYPE_STORE)
+    {
+        memsys_warm(core->memsys, core->trace_ldst_addr, ACCESS_TYPE_STORE,
+                    core->core_id);
+    }
+
+    core_read_trace(core);
+}
+
+// Returns the earliest cycle (after the current one) in which core_cycle()
+// can make progress on this core, or UINT64_MAX once the core is done.
+uint64_t core_next_cycle(Core *core)
+{
+    if (core->done)
+    {
+        return UINT64_MAX;
+    }
+
+    if (core->snooze_end_cycle > current_cycle)
+    {
+        return core->snooze_end_cycle + 1;
+    }
+
+    return current_cycle + 1;
+}
+
 void core_read_trace(Core *core)
 {
-    uint32_t inst_addr = 0; // initialized to 0 to suppress warning
-    uint8_t inst_type = 0; // initialized to 0 to suppress warning
-    uint32_t ldst_addr = 0; // initialized to 0 to suppress warning
+    TraceReader *trace = core->trace;
 
-    if (trace_read(core, &inst_addr, sizeof(inst_addr)) !=
-            sizeof(inst_addr) ||
-        trace_read(core, &inst_type, sizeof(inst_type)) !=
-            sizeof(inst_type) ||
-        trace_read(core, &ldst_addr, sizeof(ldst_addr)) !=
-            sizeof(ldst_addr))
+    if (trace->pos == trace->len && !trace_refill(trace))
     {
+        // An out-of-order core is done once its last instructions retire,
+        // while an in-order core is done in the cycle it issues its last
+        // one. So even where the two issue every instruction in the same
+        // cycle (-rob 1 -issue_width 1 with unit latencies, against
+        // -load_use_dist 1 with the same MSHRs), the out-of-order count
+        // ends later by the latency of the last instruction.
+        if (core->rob_count)
+        {
+            core->fetch_done = true;
+            return;
+        }
         core->done = true;
         core->done_inst_count = core->inst_count;
         core->done_cycle_count = current_cycle;
+        return;
     }
 
-    core->trace_inst_addr = inst_addr;
-    core->trace_inst_type = inst_type;
-    core->trace_ldst_addr = ldst_addr;
+    core->trace_inst_addr = trace->inst_addr[trace->pos];
+    core->trace_inst_type = trace->inst_type[trace->pos];
+    core->trace_ldst_addr = trace->ldst_addr[trace->pos];
+    trace->pos++;
+    core->trace_records++;
 }
 
 void core_print_stats(Core *core)
@@ -128,95 +432,13 @@ void core_print_stats(Core *core)
     printf("CORE_%01d_CYCLES       \t\t : %10llu\n", core->core_id,
            core->done_cycle_count);
     printf("CORE_%01d_IPC          \t\t : %10.3f\n", core->core_id, ipc);
-
-    close(core->trace_fd);
-    waitpid(core->pid, NULL, 0);
-}
-
-int open_gunzip_pipe(const char *filename, int *fd, pid_t *pid)
-{
-    int status;
-    int pipefd[2];
-
-    status = pipe(pipefd);
-    if (status != 0)
+    if (core->rob_complete_cycle)
     {
-        perror("Couldn't create pipe");
-        return 1;
-    }
-
-    *pid = fork();
-    if (*pid == -1)
-    {
-        perror("Couldn't fork");
-        close(pipefd[0]);
-        close(pipefd[1]);
-        return 1;
-    }
-
-    if (*pid == 0)
-    {
-        // Child process: exec gunzip.
-        dup2(pipefd[1], STDOUT_FILENO);
-        close(pipefd[0]);
-        close(pipefd[1]);
-        execlp("gunzip", "gunzip", "-c", filename, NULL);
-        perror("Couldn't exec gunzip");
-        fprintf(stderr, "Is gunzip installed?\n");
-        return 127;
-    }
-
-    // Parent process: return the read end of the pipe.
-    *fd = pipefd[0];
-    close(pipefd[1]);
-    return 0;
-}
-
-ssize_t trace_read(Core *core, void *buf, size_t size)
-{
-    uint8_t *bytes = (uint8_t *)buf;
-    size_t bytes_read_total = 0;
-    size_t bytes_left = size;
-
-    // Read a total of size bytes from the file descriptor.
-    while (bytes_left > 0)
-    {
-        if (core->read_buf_left < 0)
-        {
-            // Error
-            return -1;
-        }
-
-        if (core->read_buf_left == 0)
-        {
-            // Refill the read buffer.
-            core->read_buf_left = read(core->trace_fd, core->read_buf,
-                                       sizeof(core->read_buf));
-            if (core->read_buf_left < 0)
-            {
-                perror("Couldn't read from trace file");
-                return -1;
-            }
-            if (core->read_buf_left == 0)
-            {
-                // EOF
-                break;
-            }
-            core->read_buf_offset = 0;
-        }
-
-        // Copy bytes from the read buffer to the caller's buffer.
-        uint8_t *read_buf_ptr = core->read_buf + core->read_buf_offset;
-        size_t bytes_to_copy = ((ssize_t)bytes_left < core->read_buf_left)
-                                   ? bytes_left
-                                   : core->read_buf_left;
-        memcpy(bytes, read_buf_ptr, bytes_to_copy);
-        bytes += bytes_to_copy;
-        bytes_read_total += bytes_to_copy;
-        bytes_left -= bytes_to_copy;
-        core->read_buf_left -= bytes_to_copy;
-        core->read_buf_offset += bytes_to_copy;
+        printf("CORE_%01d_ROB_FULL     \t\t : %10llu\n", core->core_id,
+               core->stat_rob_full_cycles);
+        printf("CORE_%01d_LSQ_FULL     \t\t : %10llu\n", core->core_id,
+               core->stat_lsq_full_cycles);
     }
 
-    return bytes_read_total;
+    trace_close(core->trace);
 }
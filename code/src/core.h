@@ -10,7 +10,7 @@
 
 #include "types.h"
 #include "memsys.h"
-#include <sys/types.h>
+#include "trace.h"
 
 typedef struct Core
 {
@@ -18,14 +18,13 @@ typedef struct Core
 
     MemorySystem *memsys;
 
-    int trace_fd;
-    pid_t pid;
-    uint8_t read_buf[32 * 1024];
-    size_t read_buf_offset;
-    ssize_t read_buf_left;
+    TraceReader *trace;
 
     bool done;
 
+    // The number of records read from the trace, including the pending one.
+    unsigned long long trace_records;
+
     uint64_t trace_inst_addr;
     uint64_t trace_inst_type;
     uint64_t trace_ldst_addr;
@@ -33,14 +32,49 @@ typedef struct Core
     // Used to stall when waiting for data to return from memory.
     uint64_t snooze_end_cycle;
 
+    // With fetch blocks, the block the fetch buffer holds, in units of
+    // FETCH_BLOCK bytes, if it holds one.
+    uint64_t fetch_block;
+    bool fetch_block_valid;
+
+    // With MSHRs, the loads whose data hasn't been used yet, oldest first:
+    // the cycle from which each one's data can be used, and the number of
+    // the instruction that uses it. A ring of LOAD_USE_DIST entries.
+    uint64_t *load_ready_cycle;
+    unsigned long long *load_use_inst;
+    unsigned int load_head;
+    unsigned int load_count;
+
+    // With the out-of-order model, the instructions in flight, oldest first:
+    // the cycle each one completes in and whether it holds a load/store
+    // queue entry. A ring of ROB_SIZE entries.
+    uint64_t *rob_complete_cycle;
+    bool *rob_is_mem;
+    unsigned int rob_head;
+    unsigned int rob_count;
+    unsigned int lsq_count;
+
+    // The first cycle in which the out-of-order core may still retire.
+    uint64_t retire_cycle;
+
+    // Whether the trace has run out while instructions are still in flight.
+    bool fetch_done;
+
+    // The cycles in which dispatch stopped because the ROB or the load/store
+    // queue was full.
+    unsigned long long stat_rob_full_cycles;
+    unsigned long long stat_lsq_full_cycles;
+
     unsigned long long inst_count;
     unsigned long long done_inst_count;
     unsigned long long done_cycle_count;
 } Core;
 
-Core *core_new(MemorySystem *memsys, const char *trace_filename,
+Core *core_new(MemorySystem *memsys, TraceReader *trace,
                unsigned int core_id);
 void core_cycle(Core *core);
+void core_warm(Core *core);
+uint64_t core_next_cycle(Core *core);
 void core_print_stats(Core *core);
 void core_read_trace(Core *core);
 
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 // You may add any other #include directives you need here, but make sure they
 // compile on the reference machine!
+#include "checkpoint.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 //                                 CONSTANTS                                 //
@@ -39,7 +40,7 @@
 /** The row buffer size, in bytes. */
 #define ROW_BUFFER_SIZE 1024
 
-/** The number of banks in the DRAM module. */
+/** The default number of banks in each rank of the DRAM module. */
 #define NUM_BANKS 16
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -58,6 +59,51 @@ extern uint64_t CACHE_LINESIZE;
 /** Which page policy the DRAM should use. */
 extern DRAMPolicy DRAM_PAGE_POLICY;
 
+/** How physical addresses map to DRAM banks and rows in parts C through F. */
+extern DRAMMapping DRAM_MAPPING;
+
+/** Whether to count and print the accesses and row conflicts of each bank. */
+extern bool DRAM_BANK_STATS;
+
+/** How the DRAM controller schedules requests in parts C through F. */
+extern DRAMScheduler DRAM_SCHEDULER;
+
+/** The number of DRAM channels, each with a data bus of its own. */
+extern unsigned int DRAM_CHANNELS;
+
+/** The number of ranks of each DRAM channel. */
+extern unsigned int DRAM_RANKS;
+
+/** The number of banks of each DRAM rank. */
+extern unsigned int DRAM_BANKS;
+
+/**
+ * The number of writes the write queue of each DRAM channel holds, or 0 to
+ * queue writes with reads.
+ */
+extern unsigned int DRAM_WQ_SIZE;
+
+/**
+ * The write queue length at which a channel starts draining writes, or
+ * DRAM_WQ_AUTO for 3/4 of the queue.
+ */
+extern unsigned int DRAM_WQ_HIGH;
+
+/**
+ * The write queue length at which a channel stops draining writes, or
+ * DRAM_WQ_AUTO for 1/4 of the queue.
+ */
+extern unsigned int DRAM_WQ_LOW;
+
+/** The current clock cycle number. */
+extern thread_local uint64_t current_cycle;
+
+/**
+ * The delay the earlier accesses of the instruction being executed have
+ * incurred, which its later accesses wait for.
+ */
+extern thread_local uint64_t memsys_inst_delay;
+
 ///////////////////////////////////////////////////////////////////////////////
 //                           FUNCTION DEFINITIONS                            //
 ///////////////////////////////////////////////////////////////////////////////
@@ -81,8 +127,42 @@ DRAM *dram_new()
     //       fields. (You might want to use calloc() for this.)
 
     DRAM *dram = (DRAM *)calloc(1, sizeof(DRAM));
+    if (!dram) {
+        exit(1);
+    }
+
+    dram->num_banks = DRAM_CHANNELS * DRAM_RANKS * DRAM_BANKS;
+    dram->row_buffers = (RowBuffer *)calloc(dram->num_banks,
+                                            sizeof(RowBuffer));
+    dram->bank_ready = (uint64_t *)calloc(dram->num_banks, sizeof(uint64_t));
+    dram->channels = (DRAMChannel *)calloc(DRAM_CHANNELS,
+                                           sizeof(DRAMChannel));
+    dram->stat_bank_access = (unsigned long long *)calloc(
+        dram->num_banks, sizeof(unsigned long long));
+    dram->stat_bank_conflicts = (unsigned long long *)calloc(
+        dram->num_banks, sizeof(unsigned long long));
+    if (!dram->row_buffers || !dram->bank_ready || !dram->channels ||
+        !dram->stat_bank_access || !dram->stat_bank_conflicts) {
+        exit(1);
+    }
 
-    return dram; // to suppress warning
+    for (unsigned int i = 0; DRAM_WQ_SIZE && i < DRAM_CHANNELS; i++) {
+        dram->channels[i].write_queue = (DRAMRequest *)calloc(
+            DRAM_WQ_SIZE, sizeof(DRAMRequest));
+        if (!dram->channels[i].write_queue) {
+            exit(1);
+        }
+    }
+    dram_wq_watermarks(&dram->wq_high, &dram->wq_low);
+
+    return dram;
+}
+
+void dram_wq_watermarks(unsigned int *high, unsigned int *low)
+{
+    *high = (DRAM_WQ_HIGH != DRAM_WQ_AUTO) ? DRAM_WQ_HIGH
+                                           : DRAM_WQ_SIZE - DRAM_WQ_SIZE / 4;
+    *low = (DRAM_WQ_LOW != DRAM_WQ_AUTO) ? DRAM_WQ_LOW : DRAM_WQ_SIZE / 4;
 }
 
 /**
@@ -145,16 +225,83 @@ uint64_t dram_access(DRAM *dram, uint64_t line_addr, bool is_dram_write)
  * @param is_dram_write Whether this access writes to DRAM.
  * @return The delay in cycles incurred by this DRAM access.
  */
+static uint64_t dram_access_queued(DRAM *dram, uint64_t line_addr,
+                                   bool is_dram_write);
+
+/**
+ * Find the bank and row a cache line maps to.
+ *
+ * Every mapping puts the same ROW_BUFFER_SIZE * num_banks bytes in the same
+ * row of every bank, so they only differ in how those bytes are spread over
+ * the banks. The lowest bits of the bank number select the channel, then
+ * the rank, so neighboring rows or lines go to different channels first.
+ *
+ * @param dram The DRAM module.
+ * @param line_addr The address of the cache line (in units of the cache line
+ *                  size).
+ * @param row Where to store the row.
+ * @return The bank, across all channels and ranks.
+ */
+static unsigned int dram_map(DRAM *dram, uint64_t line_addr, uint64_t *row)
+{
+    uint64_t physical_addr = line_addr * CACHE_LINESIZE;
+    uint64_t row_addr = physical_addr / ROW_BUFFER_SIZE;
+    *row = row_addr / dram->num_banks;
+
+    if (DRAM_MAPPING == DRAM_MAP_LINE) {
+        return line_addr % dram->num_banks;
+    }
+    if (DRAM_MAPPING == DRAM_MAP_XOR) {
+        // The number of banks is a power of two, so this stays in range.
+        return (row_addr % dram->num_banks) ^ (*row % dram->num_banks);
+    }
+    return row_addr % dram->num_banks;
+}
+
+/**
+ * Find the channel a bank is in.
+ */
+static DRAMChannel *dram_channel(DRAM *dram, unsigned int bank)
+{
+    return &dram->channels[bank % DRAM_CHANNELS];
+}
+
+/**
+ * Count an access to a bank, unless it is only made for functional warming.
+ */
+static void dram_count_bank(DRAM *dram, unsigned int bank, bool conflict)
+{
+    if (!DRAM_BANK_STATS || dram->functional) {
+        return;
+    }
+    dram->stat_bank_access[bank]++;
+    if (conflict) {
+        dram->stat_bank_conflicts[bank]++;
+    }
+}
+
 uint64_t dram_access_mode_CDEF(DRAM *dram, uint64_t line_addr,
                                bool is_dram_write)
 {
-    // Assume a mapping with consecutive lines in the same row and consecutive
-    // row buffers in consecutive rows.
+    if (DRAM_SCHEDULER != DRAM_SCHED_FIXED) {
+        if (!dram->functional) {
+            return dram_access_queued(dram, line_addr, is_dram_write);
+        }
+
+        // Functional warming doesn't keep time, so whatever was queued is
+        // settled now and the row buffers are updated directly.
+        dram_flush(dram);
+    }
+
+    // The mapping defaults to consecutive lines in the same row and
+    // consecutive row buffers in consecutive rows.
     // TODO: Use this function to track open rows.
     // TODO: Compute the delay based on row buffer hit/miss/empty.
-
+    uint64_t row_index;
+    unsigned int bank = dram_map(dram, line_addr, &row_index);
 
     if (DRAM_PAGE_POLICY == CLOSE_PAGE) {
+        dram_count_bank(dram, bank, false);
 
         if (is_dram_write) {
             /* Timing: DELAY_ACT (activate the row) + DELAY_CAS (column access) + DELAY_BUS (data transfer). */
@@ -171,15 +318,11 @@ uint64_t dram_access_mode_CDEF(DRAM *dram, uint64_t line_addr,
 
     int delay = 0;
     if (DRAM_PAGE_POLICY == OPEN_PAGE) {
-        /* get physical addr, calculate bank index and row index */
-        uint64_t physical_addr = line_addr * CACHE_LINESIZE;
-        uint64_t bank = (physical_addr/ROW_BUFFER_SIZE) % NUM_BANKS;
-        uint64_t row_index = (physical_addr/ROW_BUFFER_SIZE) / NUM_BANKS;
-
         /* get bool conditions for row hit/miss/empty */
         bool is_row_hit = dram->row_buffers[bank].valid && (dram->row_buffers[bank].row_id == row_index);
         bool is_row_miss = dram->row_buffers[bank].valid && (dram->row_buffers[bank].row_id != row_index);
         bool is_row_empty = !dram->row_buffers[bank].valid;
+        dram_count_bank(dram, bank, is_row_miss);
 
 
         if (is_row_hit) {
@@ -222,6 +365,413 @@ uint64_t dram_access_mode_CDEF(DRAM *dram, uint64_t line_addr,
     return 0;
 }
 
+/**
+ * Issue a queued request to its bank no earlier than the given cycle, and
+ * update the bank, the data bus, and the statistics.
+ *
+ * A bank takes DELAY_ACT to open a row and DELAY_CAS to read or write a
+ * column of it, plus DELAY_PRE to close another row first. The data then
+ * crosses the bus of its channel, one transfer at a time, in DELAY_BUS.
+ * Under a close-page policy, the bank also precharges after every access.
+ *
+ * @param dram The DRAM module.
+ * @param req The request to issue.
+ * @param cycle The earliest cycle to issue the request in.
+ * @return The cycle the data transfer of the request ends in.
+ */
+static uint64_t dram_issue(DRAM *dram, const DRAMRequest *req,
+                           uint64_t cycle)
+{
+    RowBuffer *rb = &dram->row_buffers[req->bank];
+    uint64_t start = (dram->bank_ready[req->bank] > cycle)
+                         ? dram->bank_ready[req->bank]
+                         : cycle;
+    uint64_t latency;
+
+    bool conflict = false;
+    if (DRAM_PAGE_POLICY == CLOSE_PAGE) {
+        latency = DELAY_ACT + DELAY_CAS;
+        dram->bank_ready[req->bank] = start + latency + DELAY_PRE;
+    } else {
+        if (!rb->valid) {
+            latency = DELAY_ACT + DELAY_CAS;
+        } else if (rb->row_id == req->row_id) {
+            latency = DELAY_CAS;
+            dram->stat_row_hits++;
+        } else {
+            latency = DELAY_PRE + DELAY_ACT + DELAY_CAS;
+            dram->stat_row_conflicts++;
+            conflict = true;
+        }
+        rb->valid = true;
+        rb->row_id = req->row_id;
+        dram->bank_ready[req->bank] = start + latency;
+    }
+    dram_count_bank(dram, req->bank, conflict);
+
+    DRAMChannel *ch = dram_channel(dram, req->bank);
+    uint64_t transfer = (ch->bus_free > start + latency)
+                            ? ch->bus_free
+                            : start + latency;
+    uint64_t done = transfer + DELAY_BUS;
+    ch->bus_free = done;
+
+    uint64_t delay = done - req->arrival_cycle;
+    dram->stat_queue_delay += delay - (latency + DELAY_BUS);
+    if (req->is_write) {
+        dram->stat_write_access += 1;
+        dram->stat_write_delay += delay;
+    } else {
+        dram->stat_read_access += 1;
+        dram->stat_read_delay += delay;
+    }
+    return done;
+}
+
+/**
+ * Choose the queued request to issue next, as of the given cycle.
+ *
+ * FCFS takes the oldest request. FR-FCFS takes the request that can start
+ * the soonest, so a busy bank doesn't hold up the others, and among those,
+ * one that hits an open row before the oldest.
+ *
+ * @param dram The DRAM module.
+ * @param queue The queue, with at least one request in it.
+ * @param len The number of requests in the queue.
+ * @param cycle The current cycle.
+ * @param frfcfs Whether to use FR-FCFS rather than FCFS.
+ * @return The index of the request in the queue.
+ */
+static unsigned int dram_pick(DRAM *dram, const DRAMRequest *queue,
+                              unsigned int len, uint64_t cycle, bool frfcfs)
+{
+    if (!frfcfs) {
+        return 0;
+    }
+
+    unsigned int best = 0;
+    uint64_t best_start = UINT64_MAX;
+    bool best_hit = false;
+    for (unsigned int i = 0; i < len; i++) {
+        const DRAMRequest *req = &queue[i];
+        uint64_t start = (dram->bank_ready[req->bank] > cycle)
+                             ? dram->bank_ready[req->bank]
+                             : cycle;
+        const RowBuffer *rb = &dram->row_buffers[req->bank];
+        bool hit = DRAM_PAGE_POLICY == OPEN_PAGE && rb->valid &&
+                   rb->row_id == req->row_id;
+        if (start < best_start || (start == best_start && hit && !best_hit)) {
+            best = i;
+            best_start = start;
+            best_hit = hit;
+        }
+    }
+    return best;
+}
+
+/**
+ * Issue the next queued request as of the given cycle and take it off the
+ * queue.
+ *
+ * @param dram The DRAM module.
+ * @param queue The queue, with at least one request in it.
+ * @param len The number of requests in the queue, which is decremented.
+ * @param cycle The current cycle.
+ * @param frfcfs Whether to use FR-FCFS rather than FCFS.
+ * @param index Where to store the index the request had in the queue.
+ * @return The cycle the data transfer of the request ends in.
+ */
+static uint64_t dram_issue_next(DRAM *dram, DRAMRequest *queue,
+                                unsigned int *len, uint64_t cycle,
+                                bool frfcfs, unsigned int *index)
+{
+    unsigned int i = dram_pick(dram, queue, *len, cycle, frfcfs);
+    uint64_t done = dram_issue(dram, &queue[i], cycle);
+
+    (*len)--;
+    for (unsigned int j = i; j < *len; j++) {
+        queue[j] = queue[j + 1];
+    }
+    *index = i;
+    return done;
+}
+
+/**
+ * Drain the write queue of a channel down to the low watermark, issuing row
+ * hits first.
+ *
+ * @param dram The DRAM module.
+ * @param ch The channel.
+ * @param cycle The cycle the drain starts in.
+ */
+static void dram_drain_writes(DRAM *dram, DRAMChannel *ch, uint64_t cycle)
+{
+    uint64_t done = cycle;
+    unsigned int index;
+    while (ch->write_queue_len > dram->wq_low) {
+        done = dram_issue_next(dram, ch->write_queue, &ch->write_queue_len,
+                               cycle, true, &index);
+    }
+
+    dram->stat_wq_drains++;
+    dram->stat_wq_drain_cycles += done - cycle;
+}
+
+/**
+ * Put a write in the write queue of its channel, merging it with a queued
+ * write to the same line, and drain the queue if it has filled up to the
+ * high watermark.
+ *
+ * @param dram The DRAM module.
+ * @param ch The channel.
+ * @param req The write.
+ */
+static void dram_queue_write(DRAM *dram, DRAMChannel *ch,
+                             const DRAMRequest *req)
+{
+    for (unsigned int i = 0; i < ch->write_queue_len; i++) {
+        if (ch->write_queue[i].line_addr == req->line_addr) {
+            dram->stat_wq_merges++;
+            return;
+        }
+    }
+
+    ch->write_queue[ch->write_queue_len++] = *req;
+    if (ch->write_queue_len >= dram->wq_high) {
+        dram_drain_writes(dram, ch, req->arrival_cycle);
+    }
+}
+
+/**
+ * Access the DRAM through the queued controller.
+ *
+ * The controller can't know of requests that will arrive later, so a read
+ * is scheduled as soon as it arrives, along with the requests chosen before
+ * it, and its delay includes the time it waited for them. Writes are off the
+ * critical path: they wait in the queue until they are chosen, or the queue
+ * fills up, and add no delay here.
+ *
+ * With a write queue, writes wait apart from reads, so reads are only held
+ * up by the banks and bus the last drain left busy. A read of a line with a
+ * write queued is served from the write queue without a DRAM access.
+ *
+ * A request arrives once the earlier accesses of its instruction are done.
+ * Requests of different cores are scheduled in the order the cores are
+ * simulated in within a cycle, even if a later one arrives earlier.
+ *
+ * @param dram The DRAM module to access.
+ * @param line_addr The address of the cache line to access (in units of the
+ *                  cache line size).
+ * @param is_dram_write Whether this access writes to DRAM.
+ * @return The delay in cycles until the data of a read has arrived.
+ */
+static uint64_t dram_access_queued(DRAM *dram, uint64_t line_addr,
+                                   bool is_dram_write)
+{
+    bool frfcfs = (DRAM_SCHEDULER == DRAM_SCHED_FRFCFS);
+    DRAMRequest req;
+    req.line_addr = line_addr;
+    req.bank = dram_map(dram, line_addr, &req.row_id);
+    req.arrival_cycle = current_cycle + memsys_inst_delay;
+    req.is_write = is_dram_write;
+    DRAMChannel *ch = dram_channel(dram, req.bank);
+
+    if (DRAM_WQ_SIZE) {
+        dram->stat_wq_arrivals++;
+        dram->stat_wq_occupancy += ch->write_queue_len;
+
+        if (is_dram_write) {
+            dram_queue_write(dram, ch, &req);
+            return 0;
+        }
+
+        for (unsigned int i = 0; i < ch->write_queue_len; i++) {
+            if (ch->write_queue[i].line_addr == line_addr) {
+                dram->stat_wq_forwards++;
+                return 0;
+            }
+        }
+    }
+
+    unsigned int index;
+    if (ch->queue_len == DRAM_QUEUE_SIZE) {
+        dram_issue_next(dram, ch->queue, &ch->queue_len, req.arrival_cycle,
+                        frfcfs, &index);
+    }
+    ch->queue[ch->queue_len++] = req;
+
+    if (is_dram_write) {
+        return 0;
+    }
+
+    // The read is the newest request, so it is issued once the queue has
+    // shrunk past it.
+    uint64_t arrival = req.arrival_cycle;
+    unsigned int read_index = ch->queue_len - 1;
+    while (true) {
+        uint64_t done = dram_issue_next(dram, ch->queue, &ch->queue_len,
+                                        arrival, frfcfs, &index);
+        if (index == read_index) {
+            return done - arrival;
+        }
+        read_index--;
+    }
+}
+
+void dram_flush(DRAM *dram)
+{
+    bool frfcfs = (DRAM_SCHEDULER == DRAM_SCHED_FRFCFS);
+    unsigned int index;
+    for (unsigned int i = 0; i < DRAM_CHANNELS; i++) {
+        DRAMChannel *ch = &dram->channels[i];
+        while (ch->queue_len) {
+            dram_issue_next(dram, ch->queue, &ch->queue_len, current_cycle,
+                            frfcfs, &index);
+        }
+        while (ch->write_queue_len) {
+            dram_issue_next(dram, ch->write_queue, &ch->write_queue_len,
+                            current_cycle, true, &index);
+        }
+    }
+}
+
+/**
+ * Write a block of DRAM state to a checkpoint; see checkpoint_write().
+ */
+static bool dram_write_block(gzFile gz, void *data, uint64_t size)
+{
+    return checkpoint_write(gz, data, size);
+}
+
+/**
+ * Save or restore the state of the DRAM module after its topology, which is
+ * the same for both.
+ *
+ * @param dram The DRAM module.
+ * @param gz The checkpoint file.
+ * @param load Whether to restore the state rather than save it.
+ * @return Whether the state was written or read in full.
+ */
+static bool dram_transfer(DRAM *dram, gzFile gz, bool load)
+{
+    bool (*transfer)(gzFile, void *, uint64_t) =
+        load ? checkpoint_read : dram_write_block;
+
+    uint64_t stats[13] = {
+        dram->stat_read_access,   dram->stat_read_delay,
+        dram->stat_write_access,  dram->stat_write_delay,
+        dram->stat_row_hits,      dram->stat_row_conflicts,
+        dram->stat_queue_delay,   dram->stat_wq_arrivals,
+        dram->stat_wq_occupancy,  dram->stat_wq_drains,
+        dram->stat_wq_drain_cycles, dram->stat_wq_forwards,
+        dram->stat_wq_merges,
+    };
+    bool ok = transfer(gz, dram->row_buffers,
+                       dram->num_banks * sizeof(RowBuffer)) &&
+              transfer(gz, dram->bank_ready,
+                       dram->num_banks * sizeof(uint64_t)) &&
+              transfer(gz, stats, sizeof(stats)) &&
+              transfer(gz, dram->stat_bank_access,
+                       dram->num_banks * sizeof(unsigned long long)) &&
+              transfer(gz, dram->stat_bank_conflicts,
+                       dram->num_banks * sizeof(unsigned long long));
+
+    for (unsigned int i = 0; ok && i < DRAM_CHANNELS; i++) {
+        DRAMChannel *ch = &dram->channels[i];
+        uint64_t queue_len = ch->queue_len;
+        uint64_t write_queue_len = ch->write_queue_len;
+        ok = transfer(gz, &ch->bus_free, sizeof(ch->bus_free)) &&
+             transfer(gz, &queue_len, sizeof(queue_len)) &&
+             queue_len <= DRAM_QUEUE_SIZE &&
+             transfer(gz, ch->queue, queue_len * sizeof(DRAMRequest)) &&
+             transfer(gz, &write_queue_len, sizeof(write_queue_len)) &&
+             write_queue_len <= DRAM_WQ_SIZE &&
+             transfer(gz, ch->write_queue,
+                      write_queue_len * sizeof(DRAMRequest));
+        ch->queue_len = queue_len;
+        ch->write_queue_len = write_queue_len;
+    }
+    if (!ok) {
+        return false;
+    }
+
+    dram->stat_read_access = stats[0];
+    dram->stat_read_delay = stats[1];
+    dram->stat_write_access = stats[2];
+    dram->stat_write_delay = stats[3];
+    dram->stat_row_hits = stats[4];
+    dram->stat_row_conflicts = stats[5];
+    dram->stat_queue_delay = stats[6];
+    dram->stat_wq_arrivals = stats[7];
+    dram->stat_wq_occupancy = stats[8];
+    dram->stat_wq_drains = stats[9];
+    dram->stat_wq_drain_cycles = stats[10];
+    dram->stat_wq_forwards = stats[11];
+    dram->stat_wq_merges = stats[12];
+    return true;
+}
+
+bool dram_save(DRAM *dram, gzFile gz)
+{
+    uint64_t topology[3] = {DRAM_CHANNELS, DRAM_RANKS, DRAM_BANKS};
+    return checkpoint_write(gz, topology, sizeof(topology)) &&
+           dram_transfer(dram, gz, false);
+}
+
+bool dram_load(DRAM *dram, gzFile gz)
+{
+    uint64_t topology[3];
+    if (!checkpoint_read(gz, topology, sizeof(topology))) {
+        return false;
+    }
+
+    if (topology[0] != DRAM_CHANNELS || topology[1] != DRAM_RANKS ||
+        topology[2] != DRAM_BANKS) {
+        fprintf(stderr, "Error: checkpoint has %llu DRAM channels of %llu "
+                        "ranks of %llu banks where %u of %u of %u are "
+                        "configured\n",
+                (unsigned long long)topology[0],
+                (unsigned long long)topology[1],
+                (unsigned long long)topology[2], DRAM_CHANNELS, DRAM_RANKS,
+                DRAM_BANKS);
+        return false;
+    }
+    return dram_transfer(dram, gz, true);
+}
+
+uint64_t dram_estimate(DRAM *dram, uint64_t line_addr)
+{
+    if (SIM_MODE == SIM_MODE_B) {
+        return DELAY_SIM_MODE_B;
+    }
+
+    uint64_t row_index;
+    unsigned int bank = dram_map(dram, line_addr, &row_index);
+
+    uint64_t latency;
+    if (DRAM_PAGE_POLICY == CLOSE_PAGE || !dram->row_buffers[bank].valid) {
+        latency = DELAY_ACT + DELAY_CAS;
+    } else if (dram->row_buffers[bank].row_id == row_index) {
+        latency = DELAY_CAS;
+    } else {
+        latency = DELAY_PRE + DELAY_ACT + DELAY_CAS;
+    }
+
+    if (DRAM_SCHEDULER == DRAM_SCHED_FIXED) {
+        return latency + DELAY_BUS;
+    }
+
+    // The queued controller also makes the read wait for its bank and the
+    // data bus of its channel, though not for queued writes.
+    uint64_t arrival = current_cycle + memsys_inst_delay;
+    uint64_t start = (dram->bank_ready[bank] > arrival) ? dram->bank_ready[bank]
+                                                       : arrival;
+    DRAMChannel *ch = dram_channel(dram, bank);
+    uint64_t transfer = (ch->bus_free > start + latency) ? ch->bus_free
+                                                         : start + latency;
+    return transfer + DELAY_BUS - arrival;
+}
+
 /**
  * Print the statistics of the DRAM module.
  * 
@@ -251,4 +801,66 @@ void dram_print_stats(DRAM *dram)
     printf("DRAM_WRITE_ACCESS    \t\t : %10llu\n", dram->stat_write_access);
     printf("DRAM_READ_DELAY_AVG  \t\t : %10.3f\n", avg_read_delay);
     printf("DRAM_WRITE_DELAY_AVG \t\t : %10.3f\n", avg_write_delay);
+
+    if (DRAM_BANK_STATS && SIM_MODE != SIM_MODE_B) {
+        // The busiest bank against the mean shows how evenly the mapping
+        // spreads the accesses; 1 is perfectly even.
+        unsigned long long total = 0;
+        unsigned long long busiest = 0;
+        for (unsigned int i = 0; i < dram->num_banks; i++) {
+            printf("DRAM_BANK_%02u_ACCESS  \t\t : %10llu\n", i,
+                   dram->stat_bank_access[i]);
+            printf("DRAM_BANK_%02u_CONFLICT\t\t : %10llu\n", i,
+                   dram->stat_bank_conflicts[i]);
+            total += dram->stat_bank_access[i];
+            if (dram->stat_bank_access[i] > busiest) {
+                busiest = dram->stat_bank_access[i];
+            }
+        }
+
+        double imbalance = 0.0;
+        if (total) {
+            imbalance = (double)busiest * dram->num_banks / (double)total;
+        }
+        printf("DRAM_BANK_IMBALANCE  \t\t : %10.3f\n", imbalance);
+    }
+
+    if (DRAM_SCHEDULER == DRAM_SCHED_FIXED || SIM_MODE == SIM_MODE_B) {
+        return;
+    }
+
+    unsigned long long accesses = dram->stat_read_access +
+                                  dram->stat_write_access;
+    double row_hit_perc = 0.0;
+    double avg_queue_delay = 0.0;
+    if (accesses) {
+        row_hit_perc = 100.0 * (double)dram->stat_row_hits /
+                       (double)accesses;
+        avg_queue_delay = (double)dram->stat_queue_delay / (double)accesses;
+    }
+
+    printf("DRAM_ROW_HIT_PERC    \t\t : %10.3f\n", row_hit_perc);
+    printf("DRAM_ROW_CONFLICTS   \t\t : %10llu\n", dram->stat_row_conflicts);
+    printf("DRAM_QUEUE_DELAY_AVG \t\t : %10.3f\n", avg_queue_delay);
+
+    if (!DRAM_WQ_SIZE) {
+        return;
+    }
+
+    double avg_occupancy = 0.0;
+    double avg_drain_cycles = 0.0;
+    if (dram->stat_wq_arrivals) {
+        avg_occupancy = (double)dram->stat_wq_occupancy /
+                        (double)dram->stat_wq_arrivals;
+    }
+    if (dram->stat_wq_drains) {
+        avg_drain_cycles = (double)dram->stat_wq_drain_cycles /
+                           (double)dram->stat_wq_drains;
+    }
+
+    printf("DRAM_WQ_OCCUPANCY_AVG\t\t : %10.3f\n", avg_occupancy);
+    printf("DRAM_WQ_DRAINS       \t\t : %10llu\n", dram->stat_wq_drains);
+    printf("DRAM_WQ_DRAIN_CYCLES_AVG\t : %10.3f\n", avg_drain_cycles);
+    printf("DRAM_WQ_FORWARDS     \t\t : %10llu\n", dram->stat_wq_forwards);
+    printf("DRAM_WQ_MERGES       \t\t : %10llu\n", dram->stat_wq_merges);
 }
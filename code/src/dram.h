@@ -12,10 +12,17 @@
 #include "types.h"
 // You may add any other #include directives you need here, but make sure they
 // compile on the reference machine!
+#include <zlib.h>
 
-/** The number of banks in the DRAM module. */
+/** The default number of banks in each rank of the DRAM module. */
 #define NUM_BANKS 16
 
+/** The number of requests each DRAM channel can hold in its queue. */
+#define DRAM_QUEUE_SIZE 32
+
+/** A write queue watermark that is derived from the size of the queue. */
+#define DRAM_WQ_AUTO UINT32_MAX
+
 ///////////////////////////////////////////////////////////////////////////////
 //                              DATA STRUCTURES                              //
 ///////////////////////////////////////////////////////////////////////////////
@@ -30,18 +37,82 @@ typedef struct RowBuffer
     unsigned int valid;
 
     /* row id */
-    unsigned int row_id;
+    uint64_t row_id;
 } RowBuffer;
 
+/* A request waiting in the DRAM controller's queue */
+typedef struct DRAMRequest
+{
+    /* the cache line the request is for */
+    uint64_t line_addr;
+
+    /* the bank, across all channels and ranks, and row the request maps to */
+    unsigned int bank;
+    uint64_t row_id;
+
+    /* the cycle the request reached the controller */
+    uint64_t arrival_cycle;
+
+    bool is_write;
+} DRAMRequest;
+
+/**
+ * A DRAM channel: the ranks behind it share its data bus, and its requests
+ * are scheduled independently of the other channels.
+ */
+typedef struct DRAMChannel
+{
+    /* for the queued controller, the cycle from which the data bus is free */
+    uint64_t bus_free;
+
+    /* for the queued controller, the requests not yet issued, oldest first */
+    DRAMRequest queue[DRAM_QUEUE_SIZE];
+    unsigned int queue_len;
+
+    /**
+     * With a write queue, the DRAM_WQ_SIZE writes it holds apart from the
+     * reads, oldest first.
+     */
+    DRAMRequest *write_queue;
+    unsigned int write_queue_len;
+} DRAMChannel;
+
 /** A DRAM module. */
 typedef struct DRAM
 {
     // TODO: Define any other fields you need here.
     // Refer to Appendix B for details on other fields you will need here.
 
-    /* array of NUM_BANKS row buffers pointers */
-    RowBuffer row_buffers[NUM_BANKS];
+    /**
+     * The number of banks across all channels and ranks. Bank b is in
+     * channel b % DRAM_CHANNELS.
+     */
+    unsigned int num_banks;
 
+    /* array of num_banks row buffers */
+    RowBuffer *row_buffers;
+
+    /**
+     * For the queued controller, the cycle from which each bank can take its
+     * next command.
+     */
+    uint64_t *bank_ready;
+
+    /* array of DRAM_CHANNELS channels */
+    DRAMChannel *channels;
+
+    /**
+     * The write queue lengths at which a channel starts and stops draining
+     * writes; see dram_wq_watermarks().
+     */
+    unsigned int wq_high;
+    unsigned int wq_low;
+
+    /**
+     * Whether accesses only update the row buffers and statistics, as in the
+     * fixed-latency model, for functional warming.
+     */
+    bool functional;
 
 
     /**
@@ -69,6 +140,49 @@ typedef struct DRAM
      * You should initialize this to 0 and update it for every DRAM write!
      */
     uint64_t stat_write_delay;
+
+    /**
+     * For the queued controller, the number of requests that found their
+     * row open, and the number that found another row open.
+     */
+    unsigned long long stat_row_hits;
+    unsigned long long stat_row_conflicts;
+
+    /**
+     * For the queued controller, the total number of cycles requests waited
+     * for busy banks, the data bus, or requests issued before them, on top
+     * of the latency they would have had in an idle DRAM.
+     */
+    uint64_t stat_queue_delay;
+
+    /**
+     * With a write queue, the number of requests that reached it, and the
+     * sum of the write queue lengths they found, for the average occupancy.
+     */
+    unsigned long long stat_wq_arrivals;
+    unsigned long long stat_wq_occupancy;
+
+    /**
+     * With a write queue, the number of times it filled up to the high
+     * watermark and was drained, and the total number of cycles the drains
+     * kept the channel busy.
+     */
+    unsigned long long stat_wq_drains;
+    uint64_t stat_wq_drain_cycles;
+
+    /**
+     * With a write queue, the number of reads served from it, and the number
+     * of writes merged with a write queued to the same line.
+     */
+    unsigned long long stat_wq_forwards;
+    unsigned long long stat_wq_merges;
+
+    /**
+     * The number of accesses to each bank, and the number of them that found
+     * another row open, when bank statistics are enabled.
+     */
+    unsigned long long *stat_bank_access;
+    unsigned long long *stat_bank_conflicts;
 } DRAM;
 
 /** Possible page policies for DRAM. */
@@ -78,6 +192,30 @@ typedef enum DRAMPolicyEnum
     CLOSE_PAGE = 1, // The DRAM uses a close-page policy.
 } DRAMPolicy;
 
+/** Possible ways of mapping physical addresses to DRAM banks and rows. */
+typedef enum DRAMMappingEnum
+{
+    DRAM_MAP_ROW = 0,  // row:bank:column; each row buffer holds consecutive
+                       // lines, and consecutive rows go to consecutive banks.
+    DRAM_MAP_LINE = 1, // row:column:bank; consecutive lines go to
+                       // consecutive banks.
+    DRAM_MAP_XOR = 2,  // row:bank:column, with the bank XORed with the low
+                       // bits of the row, so rows that would conflict in one
+                       // bank are spread over all of them.
+} DRAMMapping;
+
+/** Possible scheduling policies of the DRAM controller. */
+typedef enum DRAMSchedulerEnum
+{
+    DRAM_SCHED_FIXED = 0,  // Every access takes the latency of its row-buffer
+                           // state, as if the DRAM were idle.
+    DRAM_SCHED_FCFS = 1,   // Queued requests are issued oldest first.
+    DRAM_SCHED_FRFCFS = 2, // The queued request whose bank is ready first
+                           // is issued; row hits, then the oldest, break
+                           // ties, so a row miss to an idle bank goes
+                           // before a row hit to a busy one.
+} DRAMScheduler;
+
 ///////////////////////////////////////////////////////////////////////////////
 //                            FUNCTION PROTOTYPES                            //
 ///////////////////////////////////////////////////////////////////////////////
@@ -102,6 +240,15 @@ typedef enum DRAMPolicyEnum
  */
 DRAM *dram_new();
 
+/**
+ * Find the write queue watermarks in effect: the ones given, or else 3/4 and
+ * 1/4 of the write queue size.
+ *
+ * @param high Where to store the length at which draining starts.
+ * @param low Where to store the length at which draining stops.
+ */
+void dram_wq_watermarks(unsigned int *high, unsigned int *low);
+
 /**
  * Access the DRAM at the given cache line address.
  * 
@@ -141,6 +288,46 @@ uint64_t dram_access(DRAM *dram, uint64_t line_addr, bool is_dram_write);
 uint64_t dram_access_mode_CDEF(DRAM *dram, uint64_t line_addr,
                                bool is_dram_write);
 
+/**
+ * Estimate the delay of a DRAM read at the given cache line address from the
+ * current state of the row buffers, and of the banks and data bus for the
+ * queued controller, without changing it or the statistics.
+ * 
+ * @param dram The DRAM module.
+ * @param line_addr The address of the cache line to read (in units of the
+ *                  cache line size).
+ * @return The delay in cycles the read would incur if it were made now.
+ */
+uint64_t dram_estimate(DRAM *dram, uint64_t line_addr);
+
+/**
+ * Issue every request left in the queue of the DRAM controller, so that the
+ * write statistics cover them.
+ * 
+ * @param dram The DRAM module.
+ */
+void dram_flush(DRAM *dram);
+
+/**
+ * Write the row buffers, controller state, and statistics of the DRAM module
+ * to a checkpoint.
+ * 
+ * @param dram The DRAM module to save.
+ * @param gz The checkpoint file.
+ * @return Whether the DRAM module was written.
+ */
+bool dram_save(DRAM *dram, gzFile gz);
+
+/**
+ * Restore the row buffers, controller state, and statistics of the DRAM
+ * module from a checkpoint.
+ * 
+ * @param dram The DRAM module to restore.
+ * @param gz The checkpoint file.
+ * @return Whether the DRAM module was restored.
+ */
+bool dram_load(DRAM *dram, gzFile gz);
+
 /**
  * Print the statistics of the DRAM module.
  * 
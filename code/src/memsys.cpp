@@ -72,15 +72,73 @@ extern uint64_t L2CACHE_ASSOC;
 /** The replacement policy to use for the L2 cache. */
 extern ReplacementPolicy L2CACHE_REPL;
 
+/**
+ * The largest dcache size covered by the stack-distance engine in bytes, or 0
+ * if the engine is disabled.
+ */
+extern uint64_t STACKDIST_MAX_SIZE;
+
+/** The largest dcache associativity covered by the stack-distance engine. */
+extern uint64_t STACKDIST_MAX_ASSOC;
+
 /** The number of cores being simulated. */
 extern unsigned int NUM_CORES;
 
+/**
+ * The size of the blocks the cores fetch instructions in, in bytes, or 0 if
+ * every instruction is fetched on its own.
+ */
+extern unsigned int FETCH_BLOCK;
+
+/** The number of MSHRs of each L1 cache, or 0 if L1 misses block. */
+extern unsigned int MSHRS;
+
+/** The number of MSHRs of the L2 cache. */
+extern unsigned int L2_MSHRS;
+
+/** The prefetcher of each data cache, and its degree and distance. */
+extern PrefetcherType L1_PREFETCHER;
+extern unsigned int L1_PF_DEGREE;
+extern unsigned int L1_PF_DISTANCE;
+
+/** The prefetcher of the L2 cache, and its degree and distance. */
+extern PrefetcherType L2_PREFETCHER;
+extern unsigned int L2_PF_DEGREE;
+extern unsigned int L2_PF_DISTANCE;
+
+/** Whether the prefetchers are throttled by their accuracy and pollution. */
+extern bool PF_THROTTLE;
+
 /**
  * The current clock cycle number.
  * 
  * This can be used as a timestamp for implementing the LRU replacement policy.
  */
-extern uint64_t current_cycle;
+extern thread_local uint64_t current_cycle;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  GLOBALS                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The delay the accesses of the instruction being executed on this thread
+ * have incurred so far. The core makes them one after another, so a queued
+ * DRAM controller sees each one arrive this much after the current cycle.
+ */
+thread_local uint64_t memsys_inst_delay;
+
+/**
+ * The number of cycles the last access made on this thread waited for a
+ * free MSHR in its L1 cache. A core can't go on until it has one, even if it
+ * doesn't need the data yet.
+ */
+thread_local uint64_t memsys_mshr_wait;
+
+/**
+ * The address of the instruction being executed on this thread, which the
+ * core sets before fetching it, for the prefetchers indexed by it.
+ */
+thread_local uint64_t memsys_inst_pc;
 
 ///////////////////////////////////////////////////////////////////////////////
 //                           FUNCTION DEFINITIONS                            //
@@ -101,6 +159,12 @@ MemorySystem *memsys_new()
     {
         sys->dcache = cache_new(DCACHE_SIZE, DCACHE_ASSOC, CACHE_LINESIZE,
                                 REPL_POLICY);
+        if (STACKDIST_MAX_SIZE)
+        {
+            sys->dcache_stackdist = stackdist_new(STACKDIST_MAX_SIZE,
+                                                  STACKDIST_MAX_ASSOC,
+                                                  CACHE_LINESIZE);
+        }
     }
 
     if (SIM_MODE == SIM_MODE_B || SIM_MODE == SIM_MODE_C)
@@ -119,6 +183,16 @@ MemorySystem *memsys_new()
         sys->l2cache = cache_new(L2CACHE_SIZE, L2CACHE_ASSOC, CACHE_LINESIZE,
                                  L2CACHE_REPL);
         sys->dram = dram_new();
+        sys->dcache_coreid = (Cache **)calloc(NUM_CORES, sizeof(Cache *));
+        sys->icache_coreid = (Cache **)calloc(NUM_CORES, sizeof(Cache *));
+        if (!sys->dcache_coreid || !sys->icache_coreid)
+        {
+            exit(1);
+        }
+        while (((uint64_t)1 << sys->pfn_core_bits) < NUM_CORES)
+        {
+            sys->pfn_core_bits++;
+        }
         for (unsigned int i = 0; i < NUM_CORES; i++)
         {
             sys->dcache_coreid[i] = cache_new(DCACHE_SIZE, DCACHE_ASSOC,
@@ -128,6 +202,44 @@ MemorySystem *memsys_new()
         }
     }
 
+    if (MSHRS)
+    {
+        sys->icache_mshr = (MshrFile **)calloc(NUM_CORES, sizeof(MshrFile *));
+        sys->dcache_mshr = (MshrFile **)calloc(NUM_CORES, sizeof(MshrFile *));
+        sys->mlp = (MshrMlp **)calloc(NUM_CORES, sizeof(MshrMlp *));
+        if (!sys->icache_mshr || !sys->dcache_mshr || !sys->mlp)
+        {
+            exit(1);
+        }
+        for (unsigned int i = 0; i < NUM_CORES; i++)
+        {
+            sys->icache_mshr[i] = mshr_new(MSHRS);
+            sys->dcache_mshr[i] = mshr_new(MSHRS);
+            sys->mlp[i] = mshr_mlp_new(2 * MSHRS);
+        }
+        sys->l2cache_mshr = mshr_new(L2_MSHRS);
+    }
+
+    if (L1_PREFETCHER != PREFETCH_NONE)
+    {
+        sys->dcache_prefetch = (Prefetcher **)calloc(NUM_CORES,
+                                                     sizeof(Prefetcher *));
+        if (!sys->dcache_prefetch)
+        {
+            exit(1);
+        }
+        unsigned int num_dcaches = (SIM_MODE == SIM_MODE_DEF) ? NUM_CORES : 1;
+        for (unsigned int i = 0; i < num_dcaches; i++)
+        {
+            sys->dcache_prefetch[i] = prefetch_new(
+                L1_PREFETCHER, L1_PF_DEGREE, L1_PF_DISTANCE, PF_THROTTLE,
+                DCACHE_SIZE / CACHE_LINESIZE);
+        }
+    }
+    sys->l2cache_prefetch = prefetch_new(L2_PREFETCHER, L2_PF_DEGREE,
+                                         L2_PF_DISTANCE, PF_THROTTLE,
+                                         L2CACHE_SIZE / CACHE_LINESIZE);
+
     return sys;
 }
 
@@ -154,6 +266,13 @@ uint64_t memsys_access(MemorySystem *sys, uint64_t addr, AccessType type,
     // byte address to a cache line address.
     uint64_t line_addr = addr / CACHE_LINESIZE;
 
+    // Every instruction starts with its fetch.
+    if (type == ACCESS_TYPE_IFETCH)
+    {
+        memsys_inst_delay = 0;
+    }
+    memsys_mshr_wait = 0;
+
     if (SIM_MODE == SIM_MODE_A)
     {
         delay = memsys_access_modeA(sys, line_addr, type, core_id);
@@ -168,6 +287,30 @@ uint64_t memsys_access(MemorySystem *sys, uint64_t addr, AccessType type,
     {
         delay = memsys_access_modeDEF(sys, line_addr, type, core_id);
     }
+    memsys_inst_delay += delay;
+
+    // When cores are simulated on separate threads, each core counts its
+    // own statistics, and the totals are added up at the end.
+    if (sys->core_stats)
+    {
+        MemsysCoreStats *stats = &sys->core_stats[core_id];
+        if (type == ACCESS_TYPE_IFETCH)
+        {
+            stats->stat_ifetch_access++;
+            stats->stat_ifetch_delay += delay;
+        }
+        if (type == ACCESS_TYPE_LOAD)
+        {
+            stats->stat_load_access++;
+            stats->stat_load_delay += delay;
+        }
+        if (type == ACCESS_TYPE_STORE)
+        {
+            stats->stat_store_access++;
+            stats->stat_store_delay += delay;
+        }
+        return delay;
+    }
 
     // Update the statistics.
     if (type == ACCESS_TYPE_IFETCH)
@@ -191,6 +334,41 @@ uint64_t memsys_access(MemorySystem *sys, uint64_t addr, AccessType type,
     return delay;
 }
 
+void memsys_fetch_buffered(MemorySystem *sys, unsigned int core_id)
+{
+    // Every instruction starts with its fetch, even from the fetch buffer.
+    memsys_inst_delay = 0;
+    memsys_mshr_wait = 0;
+
+    if (sys->core_stats)
+    {
+        sys->core_stats[core_id].stat_ifetch_buffered++;
+        return;
+    }
+    sys->stat_ifetch_buffered++;
+}
+
+void memsys_warm(MemorySystem *sys, uint64_t addr, AccessType type,
+                 unsigned int core_id)
+{
+    uint64_t line_addr = addr / CACHE_LINESIZE;
+
+    // Nothing is timed, so the DRAM controller mustn't queue anything.
+    sys->dram->functional = true;
+
+    if (SIM_MODE == SIM_MODE_B || SIM_MODE == SIM_MODE_C)
+    {
+        memsys_access_modeBC(sys, line_addr, type, core_id);
+    }
+
+    if (SIM_MODE == SIM_MODE_DEF)
+    {
+        memsys_access_modeDEF(sys, line_addr, type, core_id);
+    }
+
+    sys->dram->functional = false;
+}
+
 /**
  * In mode A, access the given memory address from a load or store.
  * 
@@ -238,12 +416,286 @@ uint64_t memsys_access_modeA(MemorySystem *sys, uint64_t line_addr,
         {
             cache_install(sys->dcache, line_addr, is_write, core_id);
         }
+
+        if (sys->dcache_stackdist)
+        {
+            stackdist_access(sys->dcache_stackdist, line_addr, is_write);
+        }
     }
 
     // Timing is not simulated in Part A.
     return 0;
 }
 
+/**
+ * Access the shared L2 cache on behalf of one core's L1 caches, through the
+ * parallel engine if one has hooked in.
+ *
+ * @param sys The memory system to use for the access.
+ * @param line_addr The (physical) address of the cache line to access.
+ * @param is_writeback Whether this access is a writeback from an L1 cache.
+ * @param type The type of the memory access that led to this one.
+ * @param core_id The CPU core ID that requested this access.
+ * @return The delay in cycles incurred by this access.
+ */
+static uint64_t memsys_core_l2_access(MemorySystem *sys, uint64_t line_addr,
+                                      bool is_writeback, AccessType type,
+                                      unsigned int core_id)
+{
+    if (sys->l2_access_hook)
+    {
+        return sys->l2_access_hook(sys, line_addr, is_writeback, type,
+                                   core_id);
+    }
+    return memsys_l2_access(sys, line_addr, is_writeback, core_id);
+}
+
+/**
+ * With MSHRs, find how much longer than the hit latency an access that hit
+ * an L1 cache takes, because the line was installed by a miss that is still
+ * outstanding, and merge the access with the miss.
+ *
+ * @param sys The memory system.
+ * @param mshr The MSHRs of the L1 cache, or NULL if misses block.
+ * @param line_addr The (physical) address of the cache line accessed.
+ * @param latency The hit latency of the L1 cache.
+ * @return The delay in cycles of the access on top of the hit latency.
+ */
+static uint64_t memsys_l1_hit(MemorySystem *sys, MshrFile *mshr,
+                              uint64_t line_addr, uint64_t latency)
+{
+    if (!mshr || sys->dram->functional)
+    {
+        return 0;
+    }
+
+    uint64_t cycle = current_cycle + memsys_inst_delay;
+    uint64_t ready;
+    if (mshr_merge(mshr, line_addr, cycle, &ready) && ready - cycle > latency)
+    {
+        return ready - cycle - latency;
+    }
+    return 0;
+}
+
+/**
+ * Fetch a line that missed an L1 cache from the L2 cache. With MSHRs, the
+ * miss first takes a register of the L1 cache, waiting for one if they are
+ * all busy, and holds it until the line arrives.
+ *
+ * @param sys The memory system.
+ * @param mshr The MSHRs of the L1 cache, or NULL if misses block.
+ * @param line_addr The (physical) address of the cache line that missed.
+ * @param latency The hit latency of the L1 cache.
+ * @param type The type of the memory access that missed.
+ * @param core_id The CPU core ID that made the access.
+ * @return The delay in cycles of the miss, on top of the hit latency.
+ */
+static uint64_t memsys_l1_miss(MemorySystem *sys, MshrFile *mshr,
+                               uint64_t line_addr, uint64_t latency,
+                               AccessType type, unsigned int core_id)
+{
+    if (!mshr || sys->dram->functional)
+    {
+        return memsys_core_l2_access(sys, line_addr, false, type, core_id);
+    }
+
+    uint64_t cycle = current_cycle + memsys_inst_delay;
+    MshrFile *files[2] = {sys->icache_mshr[core_id],
+                          sys->dcache_mshr[core_id]};
+    mshr_mlp_advance(sys->mlp[core_id], files, 2, cycle);
+
+    uint64_t wait;
+    unsigned int index = mshr_allocate(mshr, line_addr, cycle, &wait);
+    memsys_mshr_wait = wait;
+
+    // The L2 cache sees the miss once it has a register.
+    memsys_inst_delay += wait;
+    uint64_t delay = wait + memsys_core_l2_access(sys, line_addr, false, type,
+                                                  core_id);
+    memsys_inst_delay -= wait;
+
+    mshr_fill(mshr, index, cycle + latency + delay);
+    return delay;
+}
+
+/**
+ * Check whether two lines are in the same page. Prefetches stay in the page
+ * of the access that triggered them, since the next page needn't be next to
+ * it in physical memory.
+ *
+ * @param a The address of one cache line.
+ * @param b The address of the other cache line.
+ * @return Whether the lines are in the same page.
+ */
+static bool memsys_same_page(uint64_t a, uint64_t b)
+{
+    return a * CACHE_LINESIZE / PAGE_SIZE == b * CACHE_LINESIZE / PAGE_SIZE;
+}
+
+/**
+ * Prefetch into a data cache the lines its prefetcher proposes after a
+ * demand access. Prefetches are made in the cycle of the access and go to
+ * the L2 cache like misses, and their lines are installed right away; the
+ * prefetcher remembers when each one arrives.
+ *
+ * @param sys The memory system.
+ * @param dcache The data cache.
+ * @param pf The prefetcher of the data cache.
+ * @param line_addr The (physical) address of the cache line accessed.
+ * @param trigger Whether the access missed or was the first use of a
+ *                prefetched line.
+ * @param core_id The CPU core ID that made the access.
+ */
+static void memsys_l1_prefetch(MemorySystem *sys, Cache *dcache,
+                               Prefetcher *pf, uint64_t line_addr,
+                               bool trigger, unsigned int core_id)
+{
+    uint64_t lines[PREFETCH_MAX_LINES];
+    unsigned int n = prefetch_train(pf, memsys_inst_pc, line_addr, trigger,
+                                    lines);
+    bool timed = !sys->dram->functional;
+    uint64_t cycle = current_cycle + memsys_inst_delay;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        if (!memsys_same_page(lines[i], line_addr) ||
+            cache_probe(dcache, lines[i]))
+        {
+            continue;
+        }
+        if (timed && !prefetch_can_issue(pf, cycle))
+        {
+            break;
+        }
+
+        uint64_t delay = DCACHE_HIT_LATENCY +
+                         memsys_l2_access(sys, lines[i], false, core_id);
+        cache_install(dcache, lines[i], false, core_id);
+
+        CacheLine *evicted = &dcache->last_evicted_line;
+        if (evicted->valid)
+        {
+            prefetch_evict(pf, evicted->line_addr, true);
+        }
+        if (evicted->valid && evicted->dirty)
+        {
+            memsys_l2_access(sys, evicted->line_addr, true, core_id);
+            evicted->valid = false;
+        }
+
+        prefetch_issue(pf, lines[i], cycle, timed ? cycle + delay : 0);
+    }
+}
+
+/**
+ * Find how much longer than the hit latency an access that hit a data cache
+ * takes, because its line is still on its way from a miss or a prefetch,
+ * and let the prefetcher of the cache prefetch after the access.
+ *
+ * @param sys The memory system.
+ * @param dcache The data cache.
+ * @param mshr The MSHRs of the data cache, or NULL if misses block.
+ * @param pf The prefetcher of the data cache, or NULL.
+ * @param line_addr The (physical) address of the cache line accessed.
+ * @param core_id The CPU core ID that made the access.
+ * @return The delay in cycles of the access on top of the hit latency.
+ */
+static uint64_t memsys_dcache_hit(MemorySystem *sys, Cache *dcache,
+                                  MshrFile *mshr, Prefetcher *pf,
+                                  uint64_t line_addr, unsigned int core_id)
+{
+    uint64_t extra = memsys_l1_hit(sys, mshr, line_addr, DCACHE_HIT_LATENCY);
+    if (!pf)
+    {
+        return extra;
+    }
+
+    uint64_t cycle = current_cycle + memsys_inst_delay;
+    uint64_t ready;
+    bool first_use = prefetch_hit(pf, line_addr, cycle, &ready);
+    if (ready > cycle + DCACHE_HIT_LATENCY + extra)
+    {
+        extra = ready - cycle - DCACHE_HIT_LATENCY;
+    }
+
+    memsys_l1_prefetch(sys, dcache, pf, line_addr, first_use, core_id);
+    return extra;
+}
+
+/**
+ * Prefetch into the L2 cache the lines its prefetcher proposes after an
+ * access from an L1 cache, straight from DRAM; see memsys_l1_prefetch().
+ *
+ * @param sys The memory system, with an L2 prefetcher.
+ * @param line_addr The (physical) address of the cache line accessed.
+ * @param trigger Whether the access missed or was the first use of a
+ *                prefetched line.
+ * @param core_id The CPU core ID that made the access.
+ */
+static void memsys_l2_prefetch(MemorySystem *sys, uint64_t line_addr,
+                               bool trigger, unsigned int core_id)
+{
+    Prefetcher *pf = sys->l2cache_prefetch;
+    uint64_t lines[PREFETCH_MAX_LINES];
+    unsigned int n = prefetch_train(pf, memsys_inst_pc, line_addr, trigger,
+                                    lines);
+    bool timed = !sys->dram->functional;
+    uint64_t cycle = current_cycle + memsys_inst_delay;
+
+    // A temporal prefetcher reads its metadata from DRAM one lookup after
+    // another, and its prefetches go out once the last lookup is back.
+    uint64_t meta_delay = 0;
+    for (unsigned int i = 0; i < pf->num_meta; i++)
+    {
+        PrefetchMetaAccess *meta = &pf->meta[i];
+        memsys_inst_delay += meta_delay;
+        uint64_t delay = dram_access(sys->dram, meta->line_addr,
+                                     meta->is_write);
+        memsys_inst_delay -= meta_delay;
+        if (meta->blocking)
+        {
+            meta_delay += delay;
+        }
+    }
+
+    // Temporal prefetches follow misses recorded earlier, wherever they are,
+    // rather than running on from this one.
+    bool same_page_only = pf->type != PREFETCH_TEMPORAL;
+    memsys_inst_delay += meta_delay;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        if ((same_page_only && !memsys_same_page(lines[i], line_addr)) ||
+            cache_probe(sys->l2cache, lines[i]))
+        {
+            continue;
+        }
+        if (timed && !prefetch_can_issue(pf, cycle))
+        {
+            break;
+        }
+
+        uint64_t delay = meta_delay + L2CACHE_HIT_LATENCY +
+                         dram_access(sys->dram, lines[i], false);
+        cache_install(sys->l2cache, lines[i], false, core_id);
+
+        CacheLine *evicted = &sys->l2cache->last_evicted_line;
+        if (evicted->valid)
+        {
+            prefetch_evict(pf, evicted->line_addr, true);
+        }
+        if (evicted->valid && evicted->dirty)
+        {
+            dram_access(sys->dram, evicted->line_addr, true);
+            evicted->valid = false;
+        }
+
+        prefetch_issue(pf, lines[i], cycle, timed ? cycle + delay : 0);
+    }
+    memsys_inst_delay -= meta_delay;
+}
+
 /**
  * In mode B or C, access the given memory address from an instruction fetch or
  * load/store.
@@ -290,13 +742,23 @@ uint64_t memsys_access_modeBC(MemorySystem *sys, uint64_t line_addr,
         is_write = true;
     }
 
+    MshrFile *icache_mshr = sys->icache_mshr ? sys->icache_mshr[core_id] : NULL;
+    MshrFile *dcache_mshr = sys->dcache_mshr ? sys->dcache_mshr[core_id] : NULL;
+    Prefetcher *dcache_pf = sys->dcache_prefetch ? sys->dcache_prefetch[0]
+                                                 : NULL;
+
     if (needs_icache_access)
     {
         delay += ICACHE_HIT_LATENCY;
         CacheResult outcome = cache_access(sys->icache, line_addr, is_write, core_id);
+        if (outcome == HIT) {
+            delay += memsys_l1_hit(sys, icache_mshr, line_addr,
+                                   ICACHE_HIT_LATENCY);
+        }
         if (outcome == MISS) {
             /* access L2 & update delay */
-            delay += memsys_l2_access(sys, line_addr, false, core_id);
+            delay += memsys_l1_miss(sys, icache_mshr, line_addr,
+                                    ICACHE_HIT_LATENCY, type, core_id);
             /* bring line in ICACHE */
             cache_install(sys->icache, line_addr, is_write, core_id);
         }
@@ -307,13 +769,26 @@ uint64_t memsys_access_modeBC(MemorySystem *sys, uint64_t line_addr,
     {
         delay += DCACHE_HIT_LATENCY;
         CacheResult outcome = cache_access(sys->dcache, line_addr, is_write, core_id);
+        if (outcome == HIT) {
+            delay += memsys_dcache_hit(sys, sys->dcache, dcache_mshr,
+                                       dcache_pf, line_addr, core_id);
+        }
         if (outcome == MISS) {
+            if (dcache_pf) {
+                prefetch_miss(dcache_pf, line_addr);
+            }
+
             /* access L2 & update delay */
-            delay += memsys_l2_access(sys, line_addr, false, core_id);
+            delay += memsys_l1_miss(sys, dcache_mshr, line_addr,
+                                    DCACHE_HIT_LATENCY, type, core_id);
 
             /* bring line in DCACHE */
             cache_install(sys->dcache, line_addr, is_write, core_id);
-
+            if (dcache_pf && sys->dcache->last_evicted_line.valid) {
+                prefetch_evict(dcache_pf,
+                               sys->dcache->last_evicted_line.line_addr,
+                               false);
+            }
 
 
             /* check if evicted line was dirty -> perform writeback */
@@ -327,6 +802,11 @@ uint64_t memsys_access_modeBC(MemorySystem *sys, uint64_t line_addr,
                 /* make the data in last evicted line invalid */
                 sys->dcache->last_evicted_line.valid = false;
             }
+
+            if (dcache_pf) {
+                memsys_l1_prefetch(sys, sys->dcache, dcache_pf, line_addr,
+                                   true, core_id);
+            }
         }
     }
 
@@ -362,16 +842,55 @@ uint64_t memsys_l2_access(MemorySystem *sys, uint64_t line_addr,
 
     CacheResult outcome = cache_access(sys->l2cache, line_addr, is_writeback, core_id);
 
+    // Writebacks don't wait for their line, so they take no MSHR, and the
+    // prefetcher doesn't learn from them.
+    MshrFile *mshr = sys->l2cache_mshr;
+    if (is_writeback || sys->dram->functional) {
+        mshr = NULL;
+    }
+    Prefetcher *pf = is_writeback ? NULL : sys->l2cache_prefetch;
+    uint64_t cycle = current_cycle + memsys_inst_delay;
+
     if (outcome == HIT) {
+        uint64_t ready;
+        if (pf) {
+            bool first_use = prefetch_hit(pf, line_addr, cycle, &ready);
+            if (ready > cycle + delay) {
+                delay = ready - cycle;
+            }
+            memsys_l2_prefetch(sys, line_addr, first_use, core_id);
+        }
+        if (mshr && mshr_merge(mshr, line_addr, cycle, &ready) &&
+            ready - cycle > delay) {
+            return ready - cycle;
+        }
         return delay;
     }
 
     if (outcome == MISS) {
-        /* access DRAM */
-        delay += dram_access(sys->dram, line_addr, false);
+        if (pf) {
+            prefetch_miss(pf, line_addr);
+        }
+
+        /* access DRAM, once the miss has an MSHR */
+        uint64_t wait = 0;
+        unsigned int index = 0;
+        if (mshr) {
+            index = mshr_allocate(mshr, line_addr, cycle, &wait);
+        }
+        memsys_inst_delay += wait;
+        delay += wait + dram_access(sys->dram, line_addr, false);
+        memsys_inst_delay -= wait;
+        if (mshr) {
+            mshr_fill(mshr, index, cycle + delay);
+        }
 
         /* bring line in L2 */
         cache_install(sys->l2cache, line_addr, is_writeback, core_id);
+        if (sys->l2cache_prefetch && sys->l2cache->last_evicted_line.valid) {
+            prefetch_evict(sys->l2cache_prefetch,
+                           sys->l2cache->last_evicted_line.line_addr, false);
+        }
 
         /* check for writeback & perform if necessary */
         if (sys->l2cache->last_evicted_line.valid && sys->l2cache->last_evicted_line.dirty) {
@@ -384,11 +903,42 @@ uint64_t memsys_l2_access(MemorySystem *sys, uint64_t line_addr,
             /* make the data in last evicted line invalid */
             sys->l2cache->last_evicted_line.valid = false;
         }
+
+        if (pf) {
+            memsys_l2_prefetch(sys, line_addr, true, core_id);
+        }
     }
 
     return delay;
 }
 
+uint64_t memsys_l2_estimate(MemorySystem *sys, uint64_t line_addr)
+{
+    uint64_t delay = L2CACHE_HIT_LATENCY;
+    if (!cache_probe(sys->l2cache, line_addr))
+    {
+        delay += dram_estimate(sys->dram, line_addr);
+    }
+    return delay;
+}
+
+void memsys_merge_core_stats(MemorySystem *sys)
+{
+    for (unsigned int i = 0; i < NUM_CORES; i++)
+    {
+        MemsysCoreStats *stats = &sys->core_stats[i];
+        sys->stat_ifetch_access += stats->stat_ifetch_access;
+        sys->stat_load_access += stats->stat_load_access;
+        sys->stat_store_access += stats->stat_store_access;
+        sys->stat_ifetch_delay += stats->stat_ifetch_delay;
+        sys->stat_load_delay += stats->stat_load_delay;
+        sys->stat_store_delay += stats->stat_store_delay;
+        sys->stat_ifetch_buffered += stats->stat_ifetch_buffered;
+    }
+    free(sys->core_stats);
+    sys->core_stats = NULL;
+}
+
 /**
  * In mode D, E, or F, access the given virtual address from an instruction
  * fetch or load/store.
@@ -452,13 +1002,23 @@ uint64_t memsys_access_modeDEF(MemorySystem *sys, uint64_t v_line_addr,
         is_write = true;
     }
 
+    MshrFile *icache_mshr = sys->icache_mshr ? sys->icache_mshr[core_id] : NULL;
+    MshrFile *dcache_mshr = sys->dcache_mshr ? sys->dcache_mshr[core_id] : NULL;
+    Prefetcher *dcache_pf = sys->dcache_prefetch ? sys->dcache_prefetch[core_id]
+                                                 : NULL;
+
     if (needs_icache_access)
     {
         delay += ICACHE_HIT_LATENCY;
         CacheResult outcome = cache_access(sys->icache_coreid[core_id], line_addr, is_write, core_id);
+        if (outcome == HIT) {
+            delay += memsys_l1_hit(sys, icache_mshr, line_addr,
+                                   ICACHE_HIT_LATENCY);
+        }
         if (outcome == MISS) {
             /* access L2 & update delay */
-            delay += memsys_l2_access(sys, line_addr, false, core_id);
+            delay += memsys_l1_miss(sys, icache_mshr, line_addr,
+                                    ICACHE_HIT_LATENCY, type, core_id);
             /* bring line in ICACHE */
             cache_install(sys->icache_coreid[core_id], line_addr, is_write, core_id);
         }
@@ -469,13 +1029,29 @@ uint64_t memsys_access_modeDEF(MemorySystem *sys, uint64_t v_line_addr,
     {
         delay += DCACHE_HIT_LATENCY;
         CacheResult outcome = cache_access(sys->dcache_coreid[core_id], line_addr, is_write, core_id);
+        if (outcome == HIT) {
+            delay += memsys_dcache_hit(sys, sys->dcache_coreid[core_id],
+                                       dcache_mshr, dcache_pf, line_addr,
+                                       core_id);
+        }
         if (outcome == MISS) {
+            if (dcache_pf) {
+                prefetch_miss(dcache_pf, line_addr);
+            }
+
             /* access L2 & update delay */
-            delay += memsys_l2_access(sys, line_addr, false, core_id);
+            delay += memsys_l1_miss(sys, dcache_mshr, line_addr,
+                                    DCACHE_HIT_LATENCY, type, core_id);
 
             /* bring line in DCACHE */
             cache_install(sys->dcache_coreid[core_id], line_addr, is_write, core_id);
-
+            if (dcache_pf &&
+                sys->dcache_coreid[core_id]->last_evicted_line.valid) {
+                prefetch_evict(
+                    dcache_pf,
+                    sys->dcache_coreid[core_id]->last_evicted_line.line_addr,
+                    false);
+            }
 
 
             /* check if evicted line was dirty -> perform writeback */
@@ -484,11 +1060,17 @@ uint64_t memsys_access_modeDEF(MemorySystem *sys, uint64_t v_line_addr,
                 uint64_t evicted_line_addr = sys->dcache_coreid[core_id]->last_evicted_line.line_addr;
 
                 /* delay not be calculated for writeback */
-                memsys_l2_access(sys, evicted_line_addr, true, core_id);
+                memsys_core_l2_access(sys, evicted_line_addr, true, type,
+                                      core_id);
 
                 /* make the data in last evicted line invalid */
                 sys->dcache_coreid[core_id]->last_evicted_line.valid = false;
             }
+
+            if (dcache_pf) {
+                memsys_l1_prefetch(sys, sys->dcache_coreid[core_id],
+                                   dcache_pf, line_addr, true, core_id);
+            }
         }
     }
 
@@ -606,13 +1188,94 @@ uint64_t memsys_access_modeDEF(MemorySystem *sys, uint64_t v_line_addr,
 uint64_t memsys_convert_vpn_to_pfn(MemorySystem *sys, uint64_t vpn,
                                    unsigned int core_id)
 {
-    assert(NUM_CORES == 2);
     uint64_t tail = vpn & 0x000fffff;
     uint64_t head = vpn >> 20;
-    uint64_t pfn = tail + (core_id << 21) + (head << 21);
+
+    // Up to two cores use the original mapping, so that results stay
+    // comparable with earlier runs. With more cores, the core ID gets a
+    // field of its own between the two halves of the VPN, so every core's
+    // pages land in a disjoint physical range.
+    if (NUM_CORES <= 2)
+    {
+        uint64_t pfn = tail + (core_id << 21) + (head << 21);
+        return pfn;
+    }
+
+    uint64_t pfn = tail + ((uint64_t)core_id << 20) +
+                   (head << (20 + sys->pfn_core_bits));
     return pfn;
 }
 
+/**
+ * Print the statistics of the MSHRs of every cache, and the MLP histogram of
+ * every core.
+ *
+ * @param sys The memory system, with MSHRs.
+ */
+static void memsys_print_mshr_stats(MemorySystem *sys)
+{
+    printf("\n");
+    for (unsigned int i = 0; i < NUM_CORES; i++)
+    {
+        char label[32];
+        if (SIM_MODE == SIM_MODE_DEF)
+        {
+            snprintf(label, sizeof(label), "ICACHE_%u", i);
+            mshr_print_stats(sys->icache_mshr[i], label);
+            snprintf(label, sizeof(label), "DCACHE_%u", i);
+            mshr_print_stats(sys->dcache_mshr[i], label);
+        }
+        else
+        {
+            mshr_print_stats(sys->icache_mshr[i], "ICACHE");
+            mshr_print_stats(sys->dcache_mshr[i], "DCACHE");
+        }
+    }
+    mshr_print_stats(sys->l2cache_mshr, "L2CACHE");
+
+    for (unsigned int i = 0; i < NUM_CORES; i++)
+    {
+        MshrFile *files[2] = {sys->icache_mshr[i], sys->dcache_mshr[i]};
+        mshr_mlp_advance(sys->mlp[i], files, 2, UINT64_MAX);
+
+        char label[32];
+        snprintf(label, sizeof(label), "CORE_%u", i);
+        printf("\n");
+        mshr_mlp_print_stats(sys->mlp[i], label);
+    }
+}
+
+/**
+ * Print the statistics of the prefetchers of every cache.
+ *
+ * @param sys The memory system, with at least one prefetcher.
+ */
+static void memsys_print_prefetch_stats(MemorySystem *sys)
+{
+    unsigned long long dram_accesses = sys->dram->stat_read_access +
+                                       sys->dram->stat_write_access;
+    printf("\n");
+    if (sys->dcache_prefetch && SIM_MODE == SIM_MODE_DEF)
+    {
+        for (unsigned int i = 0; i < NUM_CORES; i++)
+        {
+            char label[32];
+            snprintf(label, sizeof(label), "DCACHE_%u", i);
+            prefetch_print_stats(sys->dcache_prefetch[i], label, dram_accesses);
+        }
+    }
+    else if (sys->dcache_prefetch)
+    {
+        prefetch_print_stats(sys->dcache_prefetch[0], "DCACHE",
+                             dram_accesses);
+    }
+    if (sys->l2cache_prefetch)
+    {
+        prefetch_print_stats(sys->l2cache_prefetch, "L2CACHE",
+                             dram_accesses);
+    }
+}
+
 /**
  * Print the statistics of the memory system.
  * 
@@ -648,10 +1311,19 @@ void memsys_print_stats(MemorySystem *sys)
     printf("MEMSYS_IFETCH_AVGDELAY \t\t : %10.3f\n", ifetch_delay_avg);
     printf("MEMSYS_LOAD_AVGDELAY   \t\t : %10.3f\n", load_delay_avg);
     printf("MEMSYS_STORE_AVGDELAY  \t\t : %10.3f\n", store_delay_avg);
+    if (FETCH_BLOCK)
+    {
+        printf("MEMSYS_IFETCH_BUFFERED \t\t : %10llu\n",
+               sys->stat_ifetch_buffered);
+    }
 
     if (SIM_MODE == SIM_MODE_A)
     {
         cache_print_stats(sys->dcache, "DCACHE");
+        if (sys->dcache_stackdist)
+        {
+            stackdist_print_stats(sys->dcache_stackdist, "DCACHE");
+        }
     }
 
     if ((SIM_MODE == SIM_MODE_B) || (SIM_MODE == SIM_MODE_C))
@@ -659,17 +1331,32 @@ void memsys_print_stats(MemorySystem *sys)
         cache_print_stats(sys->icache, "ICACHE");
         cache_print_stats(sys->dcache, "DCACHE");
         cache_print_stats(sys->l2cache, "L2CACHE");
+        dram_flush(sys->dram);
         dram_print_stats(sys->dram);
     }
 
     if (SIM_MODE == SIM_MODE_DEF)
     {
-        assert(NUM_CORES == 2);
-        cache_print_stats(sys->icache_coreid[0], "ICACHE_0");
-        cache_print_stats(sys->dcache_coreid[0], "DCACHE_0");
-        cache_print_stats(sys->icache_coreid[1], "ICACHE_1");
-        cache_print_stats(sys->dcache_coreid[1], "DCACHE_1");
+        for (unsigned int i = 0; i < NUM_CORES; i++)
+        {
+            char label[32];
+            snprintf(label, sizeof(label), "ICACHE_%u", i);
+            cache_print_stats(sys->icache_coreid[i], label);
+            snprintf(label, sizeof(label), "DCACHE_%u", i);
+            cache_print_stats(sys->dcache_coreid[i], label);
+        }
         cache_print_stats(sys->l2cache, "L2CACHE");
+        dram_flush(sys->dram);
         dram_print_stats(sys->dram);
     }
+
+    if (sys->l2cache_mshr)
+    {
+        memsys_print_mshr_stats(sys);
+    }
+
+    if (sys->dcache_prefetch || sys->l2cache_prefetch)
+    {
+        memsys_print_prefetch_stats(sys);
+    }
 }
@@ -11,34 +11,102 @@
 #include "types.h"
 #include "cache.h"
 #include "dram.h"
+#include "mshr.h"
+#include "prefetch.h"
+#include "stackdist.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 //                              DATA STRUCTURES                              //
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * The memory system statistics of one core, counted separately when cores
+ * are simulated on separate threads. Each takes up its own cache line.
+ */
+typedef struct alignas(64) MemsysCoreStats
+{
+    unsigned long long stat_ifetch_access;
+    unsigned long long stat_load_access;
+    unsigned long long stat_store_access;
+    uint64_t stat_ifetch_delay;
+    uint64_t stat_load_delay;
+    uint64_t stat_store_delay;
+    unsigned long long stat_ifetch_buffered;
+} MemsysCoreStats;
+
 typedef struct MemorySystem
 {
     /** A cache for data accesses. Used in parts A, B, and C. */
     Cache *dcache;
     /** A cache for instruction fetches. Used in parts A, B, and C. */
     Cache *icache;
+    /**
+     * A stack-distance engine simulating every LRU dcache geometry alongside
+     * the dcache. Used in part A when enabled with -SD_maxKB.
+     */
+    StackDist *dcache_stackdist;
 
     /**
-     * The data caches for each core in a multicore system. Used in parts D,
-     * E, and F.
+     * The data caches for each core in a multicore system, indexed by core
+     * ID. Used in parts D, E, and F.
      */
-    Cache *dcache_coreid[2];
+    Cache **dcache_coreid;
     /**
-     * The instruction caches for each core in a multicore system. Used in
-     * parts D, E, and F.
+     * The instruction caches for each core in a multicore system, indexed by
+     * core ID. Used in parts D, E, and F.
      */
-    Cache *icache_coreid[2];
+    Cache **icache_coreid;
+    /**
+     * The number of bits of a PFN that hold the core ID, for more than two
+     * cores. Used in parts D, E, and F.
+     */
+    unsigned int pfn_core_bits;
 
     /** The shared L2 cache. Used in parts B, C, D, E, and F. */
     Cache *l2cache;
     /** The DRAM module. Used in parts B, C, D, E, and F. */
     DRAM *dram;
 
+    /**
+     * The MSHRs of the instruction and data caches of each core, indexed by
+     * core ID, and those of the L2 cache, or NULL if misses block. Used in
+     * parts B through F when enabled with -mshrs.
+     */
+    MshrFile **icache_mshr;
+    MshrFile **dcache_mshr;
+    MshrFile *l2cache_mshr;
+
+    /**
+     * For each core, a histogram of the number of misses outstanding in its
+     * instruction and data caches. Used along with the MSHRs.
+     */
+    MshrMlp **mlp;
+
+    /**
+     * The prefetchers of the data cache of each core, indexed by core ID
+     * (only the first in parts B and C, where the cores share one), and of
+     * the L2 cache, or NULL if they don't prefetch. Used in parts B through
+     * F when enabled with -L1pf and -L2pf.
+     */
+    Prefetcher **dcache_prefetch;
+    Prefetcher *l2cache_prefetch;
+
+    /**
+     * If set, called instead of memsys_l2_access() for the L2 accesses of
+     * the per-core caches, so that a parallel engine can order them across
+     * cores. Used in parts D, E, and F.
+     */
+    uint64_t (*l2_access_hook)(struct MemorySystem *sys, uint64_t line_addr,
+                               bool is_writeback, AccessType type,
+                               unsigned int core_id);
+
+    /**
+     * If set, memsys_access() counts the accesses and delays of each core
+     * here instead of in the totals below, until memsys_merge_core_stats()
+     * adds them up. Used when cores are simulated on separate threads.
+     */
+    MemsysCoreStats *core_stats;
+
     /**
      * The total number of times the memory system was accessed for an
      * instruction fetch. This is updated for you in memsys_access().
@@ -69,6 +137,11 @@ typedef struct MemorySystem
      * in memsys_access().
      */
     uint64_t stat_store_delay;
+    /**
+     * With fetch blocks, the total number of instructions fetched from the
+     * fetch buffer of their core, without an instruction cache access.
+     */
+    unsigned long long stat_ifetch_buffered;
 } MemorySystem;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -101,6 +174,29 @@ MemorySystem *memsys_new();
 uint64_t memsys_access(MemorySystem *sys, uint64_t addr, AccessType type,
                        unsigned int core_id);
 
+/**
+ * Start an instruction whose fetch needs no memory access, because it is in
+ * the fetch block its core fetched last. Also update the statistics.
+ *
+ * @param sys The memory system.
+ * @param core_id The CPU core ID that fetched the instruction.
+ */
+void memsys_fetch_buffered(MemorySystem *sys, unsigned int core_id);
+
+/**
+ * Update the caches and DRAM row buffers as an access to the given memory
+ * address would, for functional warming. The delay is ignored and the memory
+ * system statistics are left alone, but the cache and DRAM statistics are
+ * updated as usual. Only supported in modes B through F.
+ *
+ * @param sys The memory system to warm.
+ * @param addr The address to access (in bytes).
+ * @param type The type of memory access.
+ * @param core_id The CPU core ID that made the access.
+ */
+void memsys_warm(MemorySystem *sys, uint64_t addr, AccessType type,
+                 unsigned int core_id);
+
 /**
  * In mode A, access the given memory address from a load or store.
  * 
@@ -158,6 +254,26 @@ uint64_t memsys_access_modeBC(MemorySystem *sys, uint64_t line_addr,
 uint64_t memsys_l2_access(MemorySystem *sys, uint64_t line_addr,
                           bool is_writeback, unsigned int core_id);
 
+/**
+ * Estimate the delay of an L2 access without changing the L2 or DRAM: the L2
+ * hit latency if the line is present, plus an estimate of the DRAM read from
+ * the open rows if it isn't.
+ *
+ * @param sys The memory system to use for the estimate.
+ * @param line_addr The (physical) address of the cache line to access (in
+ *                  units of the cache line size).
+ * @return The estimated delay in cycles.
+ */
+uint64_t memsys_l2_estimate(MemorySystem *sys, uint64_t line_addr);
+
+/**
+ * Add the per-core statistics gathered in sys->core_stats to the totals,
+ * and go back to counting the totals directly.
+ *
+ * @param sys The memory system.
+ */
+void memsys_merge_core_stats(MemorySystem *sys);
+
 /**
  * In mode D, E, or F, access the given virtual address from an instruction
  * fetch or load/store.
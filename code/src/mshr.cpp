@@ -0,0 +1,248 @@
+// mshr.cpp
+// Defines the functions for MSHRs and MLP histograms.
+
+#include "mshr.h"
+#include "checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                           FUNCTION DEFINITIONS                            //
+///////////////////////////////////////////////////////////////////////////////
+
+MshrFile *mshr_new(unsigned int size)
+{
+    MshrFile *m = (MshrFile *)calloc(1, sizeof(MshrFile));
+    if (!m)
+    {
+        exit(1);
+    }
+
+    m->size = size;
+    m->line_addr = (uint64_t *)calloc(size, sizeof(uint64_t));
+    m->ready_cycle = (uint64_t *)calloc(size, sizeof(uint64_t));
+    if (!m->line_addr || !m->ready_cycle)
+    {
+        exit(1);
+    }
+    return m;
+}
+
+bool mshr_merge(MshrFile *m, uint64_t line_addr, uint64_t cycle,
+                uint64_t *ready_cycle)
+{
+    for (unsigned int i = 0; i < m->size; i++)
+    {
+        if (m->ready_cycle[i] > cycle && m->line_addr[i] == line_addr)
+        {
+            m->stat_merged++;
+            *ready_cycle = m->ready_cycle[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned int mshr_allocate(MshrFile *m, uint64_t line_addr, uint64_t cycle,
+                           uint64_t *wait)
+{
+    // Take a free register if there is one, or else the one that frees up
+    // first.
+    unsigned int best = 0;
+    for (unsigned int i = 0; i < m->size; i++)
+    {
+        if (m->ready_cycle[i] <= cycle)
+        {
+            best = i;
+            break;
+        }
+        if (m->ready_cycle[i] < m->ready_cycle[best])
+        {
+            best = i;
+        }
+    }
+
+    *wait = 0;
+    if (m->ready_cycle[best] > cycle)
+    {
+        *wait = m->ready_cycle[best] - cycle;
+        m->stat_full++;
+        m->stat_full_cycles += *wait;
+    }
+
+    m->stat_primary++;
+    m->line_addr[best] = line_addr;
+    m->ready_cycle[best] = cycle + *wait;
+    return best;
+}
+
+void mshr_fill(MshrFile *m, unsigned int index, uint64_t ready_cycle)
+{
+    m->ready_cycle[index] = ready_cycle;
+}
+
+MshrMlp *mshr_mlp_new(unsigned int max_outstanding)
+{
+    MshrMlp *mlp = (MshrMlp *)calloc(1, sizeof(MshrMlp));
+    if (!mlp)
+    {
+        exit(1);
+    }
+
+    mlp->num_buckets = max_outstanding + 1;
+    mlp->hist = (uint64_t *)calloc(mlp->num_buckets, sizeof(uint64_t));
+    mlp->scratch = (uint64_t *)calloc(max_outstanding, sizeof(uint64_t));
+    if (!mlp->hist || !mlp->scratch)
+    {
+        exit(1);
+    }
+    return mlp;
+}
+
+void mshr_mlp_advance(MshrMlp *mlp, MshrFile **files, unsigned int num_files,
+                      uint64_t cycle)
+{
+    if (cycle <= mlp->cycle)
+    {
+        return;
+    }
+
+    // Sort the arrival cycles of the misses outstanding since mlp->cycle;
+    // one fewer miss is outstanding after each.
+    unsigned int n = 0;
+    for (unsigned int f = 0; f < num_files; f++)
+    {
+        MshrFile *m = files[f];
+        for (unsigned int i = 0; i < m->size; i++)
+        {
+            uint64_t ready = m->ready_cycle[i];
+            if (ready <= mlp->cycle)
+            {
+                continue;
+            }
+
+            unsigned int j = n++;
+            while (j > 0 && mlp->scratch[j - 1] > ready)
+            {
+                mlp->scratch[j] = mlp->scratch[j - 1];
+                j--;
+            }
+            mlp->scratch[j] = ready;
+        }
+    }
+
+    // Completing the histogram for good stops at the last arrival.
+    if (cycle == UINT64_MAX)
+    {
+        cycle = n ? mlp->scratch[n - 1] : mlp->cycle;
+    }
+
+    uint64_t from = mlp->cycle;
+    unsigned int i = 0;
+    for (; i < n && mlp->scratch[i] <= cycle; i++)
+    {
+        mlp->hist[n - i] += mlp->scratch[i] - from;
+        from = mlp->scratch[i];
+    }
+    mlp->hist[n - i] += cycle - from;
+    mlp->cycle = cycle;
+}
+
+bool mshr_save(MshrFile *m, gzFile gz)
+{
+    uint64_t size = m->size;
+    uint64_t stats[4] = {m->stat_primary, m->stat_merged, m->stat_full,
+                         m->stat_full_cycles};
+    return checkpoint_write(gz, &size, sizeof(size)) &&
+           checkpoint_write(gz, m->line_addr, m->size * sizeof(uint64_t)) &&
+           checkpoint_write(gz, m->ready_cycle, m->size * sizeof(uint64_t)) &&
+           checkpoint_write(gz, stats, sizeof(stats));
+}
+
+bool mshr_load(MshrFile *m, gzFile gz)
+{
+    uint64_t size;
+    if (!checkpoint_read(gz, &size, sizeof(size)))
+    {
+        return false;
+    }
+    if (size != m->size)
+    {
+        fprintf(stderr, "Error: checkpoint has %llu MSHRs where %u are "
+                        "configured\n",
+                (unsigned long long)size, m->size);
+        return false;
+    }
+
+    uint64_t stats[4];
+    if (!checkpoint_read(gz, m->line_addr, m->size * sizeof(uint64_t)) ||
+        !checkpoint_read(gz, m->ready_cycle, m->size * sizeof(uint64_t)) ||
+        !checkpoint_read(gz, stats, sizeof(stats)))
+    {
+        return false;
+    }
+    m->stat_primary = stats[0];
+    m->stat_merged = stats[1];
+    m->stat_full = stats[2];
+    m->stat_full_cycles = stats[3];
+    return true;
+}
+
+bool mshr_mlp_save(MshrMlp *mlp, gzFile gz)
+{
+    return checkpoint_write(gz, &mlp->cycle, sizeof(mlp->cycle)) &&
+           checkpoint_write(gz, mlp->hist,
+                            mlp->num_buckets * sizeof(uint64_t));
+}
+
+bool mshr_mlp_load(MshrMlp *mlp, gzFile gz)
+{
+    return checkpoint_read(gz, &mlp->cycle, sizeof(mlp->cycle)) &&
+           checkpoint_read(gz, mlp->hist,
+                           mlp->num_buckets * sizeof(uint64_t));
+}
+
+void mshr_print_stats(MshrFile *m, const char *label)
+{
+    double avg_full_cycles = 0.0;
+    if (m->stat_full)
+    {
+        avg_full_cycles = (double)m->stat_full_cycles / (double)m->stat_full;
+    }
+
+    printf("%s_MSHR_PRIMARY   \t\t : %10llu\n", label, m->stat_primary);
+    printf("%s_MSHR_MERGED    \t\t : %10llu\n", label, m->stat_merged);
+    printf("%s_MSHR_FULL      \t\t : %10llu\n", label, m->stat_full);
+    printf("%s_MSHR_FULL_AVG  \t\t : %10.3f\n", label, avg_full_cycles);
+}
+
+void mshr_mlp_print_stats(MshrMlp *mlp, const char *label)
+{
+    uint64_t busy_cycles = 0;
+    uint64_t weighted = 0;
+    unsigned int top = 0;
+    for (unsigned int k = 1; k < mlp->num_buckets; k++)
+    {
+        busy_cycles += mlp->hist[k];
+        weighted += k * mlp->hist[k];
+        if (mlp->hist[k])
+        {
+            top = k;
+        }
+    }
+
+    double avg = 0.0;
+    if (busy_cycles)
+    {
+        avg = (double)weighted / (double)busy_cycles;
+    }
+
+    printf("%s_MLP_AVG        \t\t : %10.3f\n", label, avg);
+    printf("%s_MLP_CYCLES     \t\t : %10llu\n", label,
+           (unsigned long long)busy_cycles);
+    for (unsigned int k = 1; k <= top; k++)
+    {
+        printf("%s_MLP_%02u         \t\t : %10llu\n", label, k,
+               (unsigned long long)mlp->hist[k]);
+    }
+}
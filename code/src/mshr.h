@@ -0,0 +1,198 @@
+// mshr.h
+// Declares miss status holding registers (MSHRs), which let a cache keep
+// several misses outstanding at once, and the histograms of memory-level
+// parallelism (MLP) they are measured with.
+//
+// The memory system computes the delay of an access as soon as it is made,
+// so an MSHR only needs to remember the line it is fetching and the cycle
+// the line arrives in. A later access to the line before then merges with
+// the miss instead of hitting, and a miss that finds every register busy
+// waits for the first one to free up.
+
+#ifndef __MSHR_H__
+#define __MSHR_H__
+
+#include "types.h"
+#include <zlib.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The largest number of MSHRs a cache can have. */
+#define MSHR_MAX 256
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The MSHRs of a cache. */
+typedef struct MshrFile
+{
+    /* the number of registers */
+    unsigned int size;
+
+    /**
+     * For each register, the line it fetches and the cycle the line arrives
+     * in, from which the register is free again.
+     */
+    uint64_t *line_addr;
+    uint64_t *ready_cycle;
+
+    /* the number of misses that took a register */
+    unsigned long long stat_primary;
+
+    /* the number of accesses merged with an outstanding miss to their line */
+    unsigned long long stat_merged;
+
+    /**
+     * The number of misses that found every register busy, and the total
+     * number of cycles they waited for one.
+     */
+    unsigned long long stat_full;
+    uint64_t stat_full_cycles;
+} MshrFile;
+
+/** A histogram of the number of misses outstanding in each cycle. */
+typedef struct MshrMlp
+{
+    /* the cycle up to which the histogram is complete */
+    uint64_t cycle;
+
+    /* the number of buckets, one more than the most misses outstanding */
+    unsigned int num_buckets;
+
+    /* the number of cycles in which each number of misses was outstanding */
+    uint64_t *hist;
+
+    /* room for the arrival cycle of every outstanding miss */
+    uint64_t *scratch;
+} MshrMlp;
+
+///////////////////////////////////////////////////////////////////////////////
+//                            FUNCTION PROTOTYPES                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Allocate and initialize the MSHRs of a cache, all free.
+ *
+ * @param size The number of registers.
+ * @return A pointer to the MSHRs.
+ */
+MshrFile *mshr_new(unsigned int size);
+
+/**
+ * Find an outstanding miss to the given line, for an access that hit the
+ * line before its data arrived, and count the access as merged with it.
+ *
+ * @param m The MSHRs.
+ * @param line_addr The address of the cache line.
+ * @param cycle The cycle the access is made in.
+ * @param ready_cycle Where to store the cycle the line arrives in.
+ * @return Whether a miss to the line was outstanding.
+ */
+bool mshr_merge(MshrFile *m, uint64_t line_addr, uint64_t cycle,
+                uint64_t *ready_cycle);
+
+/**
+ * Take a register for a miss, waiting for the first one to free up if all
+ * of them are busy. The caller must set the cycle the line arrives in with
+ * mshr_fill() once it knows it.
+ *
+ * @param m The MSHRs.
+ * @param line_addr The address of the cache line that missed.
+ * @param cycle The cycle the miss is made in.
+ * @param wait Where to store the number of cycles the miss waits for a
+ *             register.
+ * @return The index of the register.
+ */
+unsigned int mshr_allocate(MshrFile *m, uint64_t line_addr, uint64_t cycle,
+                           uint64_t *wait);
+
+/**
+ * Set the cycle the line of a register's miss arrives in.
+ *
+ * @param m The MSHRs.
+ * @param index The index of the register, from mshr_allocate().
+ * @param ready_cycle The cycle the line arrives in.
+ */
+void mshr_fill(MshrFile *m, unsigned int index, uint64_t ready_cycle);
+
+/**
+ * Allocate and initialize an empty MLP histogram.
+ *
+ * @param max_outstanding The most misses that can be outstanding at once.
+ * @return A pointer to the histogram.
+ */
+MshrMlp *mshr_mlp_new(unsigned int max_outstanding);
+
+/**
+ * Complete an MLP histogram up to the given cycle, from the misses
+ * outstanding in some MSHRs. Called before every miss is added to them, so
+ * each miss is counted from the cycle it was made in.
+ *
+ * @param mlp The histogram.
+ * @param files The MSHRs whose misses are counted.
+ * @param num_files The number of MSHR files.
+ * @param cycle The cycle to complete the histogram up to, or UINT64_MAX to
+ *              complete it up to the cycle the last miss is done in.
+ */
+void mshr_mlp_advance(MshrMlp *mlp, MshrFile **files, unsigned int num_files,
+                      uint64_t cycle);
+
+/**
+ * Save the state of some MSHRs to a checkpoint.
+ *
+ * @param m The MSHRs.
+ * @param gz The checkpoint file.
+ * @return Whether the state was written.
+ */
+bool mshr_save(MshrFile *m, gzFile gz);
+
+/**
+ * Restore the state of some MSHRs from a checkpoint. The MSHRs must have the
+ * same number of registers as the ones saved.
+ *
+ * @param m The MSHRs.
+ * @param gz The checkpoint file.
+ * @return Whether the state was read in full.
+ */
+bool mshr_load(MshrFile *m, gzFile gz);
+
+/**
+ * Save the state of an MLP histogram to a checkpoint.
+ *
+ * @param mlp The histogram.
+ * @param gz The checkpoint file.
+ * @return Whether the state was written.
+ */
+bool mshr_mlp_save(MshrMlp *mlp, gzFile gz);
+
+/**
+ * Restore the state of an MLP histogram from a checkpoint.
+ *
+ * @param mlp The histogram, with as many buckets as the one saved.
+ * @param gz The checkpoint file.
+ * @return Whether the state was read in full.
+ */
+bool mshr_mlp_load(MshrMlp *mlp, gzFile gz);
+
+/**
+ * Print the statistics of some MSHRs.
+ *
+ * @param m The MSHRs.
+ * @param label The label of their cache, e.g., "DCACHE_0".
+ */
+void mshr_print_stats(MshrFile *m, const char *label);
+
+/**
+ * Print an MLP histogram: the number of cycles in which each number of
+ * misses was outstanding, and the average number outstanding over the
+ * cycles in which there was at least one.
+ *
+ * @param mlp The histogram.
+ * @param label The label of the histogram, e.g., "CORE_0".
+ */
+void mshr_mlp_print_stats(MshrMlp *mlp, const char *label);
+
+#endif // __MSHR_H__
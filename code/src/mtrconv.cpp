@@ -0,0 +1,457 @@
+// mtrconv.cpp
+// Converts .mtr(.gz) traces into v2 traces, which the simulator maps into
+// memory instead of decompressing on every run, or into delta-compressed
+// traces, which are smaller than .mtr.gz and much faster to decode.
+
+#include "types.h"
+#include "trace.h"
+#include "tracedelta.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+/** The number of records buffered per column before they are written out. */
+#define CONV_BUF_RECORDS (64 * 1024)
+
+/** A column of the output trace being written at a fixed file offset. */
+typedef struct ConvColumn
+{
+    uint8_t *buf;
+    size_t entry_size;
+    size_t len;
+    uint64_t offset;
+} ConvColumn;
+
+void print_usage(const char *program_name);
+
+/** Round up to the alignment of the columns of a v2 trace. */
+static uint64_t conv_align(uint64_t offset)
+{
+    return (offset + TRACE_V2_ALIGN - 1) / TRACE_V2_ALIGN * TRACE_V2_ALIGN;
+}
+
+/** Write all the given bytes at an offset of the output trace. */
+static bool conv_write_at(int fd, const uint8_t *buf, size_t bytes,
+                          uint64_t offset)
+{
+    size_t done = 0;
+    while (done < bytes)
+    {
+        ssize_t n = pwrite(fd, buf + done, bytes - done, offset + done);
+        if (n < 0)
+        {
+            perror("Couldn't write output trace");
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+/** Write out everything buffered in a column. */
+static bool conv_flush(int fd, ConvColumn *col)
+{
+    size_t bytes = col->len * col->entry_size;
+    if (!conv_write_at(fd, col->buf, bytes, col->offset))
+    {
+        return false;
+    }
+
+    col->offset += bytes;
+    col->len = 0;
+    return true;
+}
+
+/** Append entries to a column, writing it out whenever its buffer fills. */
+static bool conv_append(int fd, ConvColumn *col, const void *entries,
+                        size_t count)
+{
+    const uint8_t *src = (const uint8_t *)entries;
+    while (count > 0)
+    {
+        size_t n = CONV_BUF_RECORDS - col->len;
+        if (n > count)
+        {
+            n = count;
+        }
+        memcpy(col->buf + col->len * col->entry_size, src,
+               n * col->entry_size);
+        col->len += n;
+        src += n * col->entry_size;
+        count -= n;
+
+        if (col->len == CONV_BUF_RECORDS && !conv_flush(fd, col))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Count the records of a trace and find the widest address in it, so that
+ * the columns can be laid out before any record is written.
+ */
+static bool conv_scan(const char *filename, uint64_t *num_records,
+                      uint64_t *addr_mask)
+{
+    TraceReader *in = trace_open(filename);
+    if (!in)
+    {
+        return false;
+    }
+
+    *num_records = 0;
+    *addr_mask = 0;
+    while (in->pos < in->len || trace_refill(in))
+    {
+        for (size_t i = in->pos; i < in->len; i++)
+        {
+            *addr_mask |= in->inst_addr[i] | in->ldst_addr[i];
+        }
+        *num_records += in->len - in->pos;
+        in->pos = in->len;
+    }
+
+    trace_close(in);
+    return true;
+}
+
+/** Convert a trace, whose records have already been counted, to v2. */
+static bool conv_write(const char *filename, int fd, TraceFileHeader *h)
+{
+    TraceReader *in = trace_open(filename);
+    if (!in)
+    {
+        return false;
+    }
+
+    ConvColumn cols[3] = {
+        {NULL, sizeof(uint64_t), 0, h->inst_addr_offset},
+        {NULL, sizeof(uint8_t), 0, h->inst_type_offset},
+        {NULL, sizeof(uint64_t), 0, h->ldst_addr_offset},
+    };
+    for (unsigned int c = 0; c < 3; c++)
+    {
+        cols[c].buf = (uint8_t *)malloc(CONV_BUF_RECORDS *
+                                        cols[c].entry_size);
+        if (!cols[c].buf)
+        {
+            exit(1);
+        }
+    }
+
+    bool ok = true;
+    uint64_t written = 0;
+    while (ok && (in->pos < in->len || trace_refill(in)))
+    {
+        size_t n = in->len - in->pos;
+        ok = conv_append(fd, &cols[0], in->inst_addr + in->pos, n) &&
+             conv_append(fd, &cols[1], in->inst_type + in->pos, n) &&
+             conv_append(fd, &cols[2], in->ldst_addr + in->pos, n);
+        written += n;
+        in->pos = in->len;
+    }
+
+    for (unsigned int c = 0; c < 3; c++)
+    {
+        ok = ok && conv_flush(fd, &cols[c]);
+        free(cols[c].buf);
+    }
+    trace_close(in);
+
+    if (ok && written != h->num_records)
+    {
+        fprintf(stderr, "Error: %s changed while being converted\n",
+                filename);
+        ok = false;
+    }
+    return ok;
+}
+
+/** Convert a trace to a v2 trace. */
+static int conv_to_v2(const char *in_filename, const char *out_filename,
+                      const char *workload)
+{
+    TraceFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRACE_V2_MAGIC, sizeof(h.magic));
+    h.version = TRACE_V2_VERSION;
+    h.header_size = sizeof(h);
+    snprintf(h.workload, sizeof(h.workload), "%s", workload);
+
+    uint64_t addr_mask;
+    if (!conv_scan(in_filename, &h.num_records, &addr_mask))
+    {
+        return 1;
+    }
+    h.addr_bits = (addr_mask >> 32) ? 64 : 32;
+    h.inst_addr_offset = conv_align(sizeof(h));
+    h.ldst_addr_offset = conv_align(h.inst_addr_offset +
+                                    h.num_records * sizeof(uint64_t));
+    h.inst_type_offset = conv_align(h.ldst_addr_offset +
+                                    h.num_records * sizeof(uint64_t));
+
+    int fd = open(out_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("Couldn't open output trace");
+        return 1;
+    }
+
+    // The header goes in last, so a partly written file is never mistaken
+    // for a v2 trace.
+    bool ok = conv_write(in_filename, fd, &h) &&
+              ftruncate(fd, h.inst_type_offset + h.num_records) == 0 &&
+              pwrite(fd, &h, sizeof(h), 0) == sizeof(h);
+    if (close(fd) != 0 || !ok)
+    {
+        fprintf(stderr, "Error: couldn't write %s\n", out_filename);
+        unlink(out_filename);
+        return 1;
+    }
+
+    printf("%s: %llu records, %u-bit addresses, workload \"%s\"\n",
+           out_filename, (unsigned long long)h.num_records, h.addr_bits,
+           h.workload);
+    return 0;
+}
+
+/** Convert a trace to a delta-compressed trace. */
+static int conv_to_delta(const char *in_filename, const char *out_filename,
+                         const char *workload)
+{
+    TraceDeltaHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRACE_DELTA_MAGIC, sizeof(h.magic));
+    h.version = TRACE_DELTA_VERSION;
+    h.block_records = TRACE_BATCH_RECORDS;
+    h.header_size = sizeof(h);
+    snprintf(h.workload, sizeof(h.workload), "%s", workload);
+
+    TraceReader *in = trace_open(in_filename);
+    if (!in)
+    {
+        return 1;
+    }
+
+    int fd = open(out_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("Couldn't open output trace");
+        trace_close(in);
+        return 1;
+    }
+
+    // Gather records into full blocks, since batches can be any size.
+    ConvColumn cols[3] = {
+        {NULL, sizeof(uint64_t), 0, 0},
+        {NULL, sizeof(uint8_t), 0, 0},
+        {NULL, sizeof(uint64_t), 0, 0},
+    };
+    for (unsigned int c = 0; c < 3; c++)
+    {
+        cols[c].buf = (uint8_t *)malloc(h.block_records * cols[c].entry_size);
+        if (!cols[c].buf)
+        {
+            exit(1);
+        }
+    }
+    const size_t encoded_bytes = h.block_records *
+                                 TRACE_DELTA_MAX_RECORD_BYTES;
+    uint8_t *encoded = (uint8_t *)malloc(encoded_bytes);
+    uint8_t *block = (uint8_t *)malloc(2 * sizeof(uint32_t) +
+                                       compressBound(encoded_bytes));
+    if (!encoded || !block)
+    {
+        exit(1);
+    }
+
+    bool ok = true;
+    bool more = true;
+    uint64_t offset = sizeof(h);
+    while (ok && more)
+    {
+        more = in->pos < in->len || trace_refill(in);
+        size_t n = 0;
+        if (more)
+        {
+            n = in->len - in->pos;
+            if (n > h.block_records - cols[0].len)
+            {
+                n = h.block_records - cols[0].len;
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                if (in->inst_type[in->pos + i] > INST_TYPE_OTHER)
+                {
+                    fprintf(stderr, "Error: record %llu has an unknown "
+                                    "instruction type\n",
+                            (unsigned long long)(h.num_records + cols[0].len +
+                                                 i));
+                    ok = false;
+                }
+            }
+            memcpy(cols[0].buf + cols[0].len * sizeof(uint64_t),
+                   in->inst_addr + in->pos, n * sizeof(uint64_t));
+            memcpy(cols[1].buf + cols[1].len, in->inst_type + in->pos, n);
+            memcpy(cols[2].buf + cols[2].len * sizeof(uint64_t),
+                   in->ldst_addr + in->pos, n * sizeof(uint64_t));
+            for (unsigned int c = 0; c < 3; c++)
+            {
+                cols[c].len += n;
+            }
+            in->pos += n;
+        }
+
+        // Write out a block when it's full, and the last partial block at
+        // the end of the trace.
+        size_t count = cols[0].len;
+        if (!ok || (count < h.block_records && (more || count == 0)))
+        {
+            continue;
+        }
+
+        size_t raw_bytes = tracedelta_encode_block(
+            (const uint64_t *)cols[0].buf, cols[1].buf,
+            (const uint64_t *)cols[2].buf, count, encoded);
+        uLongf bytes = compressBound(encoded_bytes);
+        if (compress2(block + 2 * sizeof(uint32_t), &bytes, encoded,
+                      raw_bytes, Z_BEST_COMPRESSION) != Z_OK)
+        {
+            fprintf(stderr, "Error: couldn't deflate a block\n");
+            ok = false;
+            continue;
+        }
+        uint32_t block_header[2] = {(uint32_t)count, (uint32_t)bytes};
+        memcpy(block, block_header, sizeof(block_header));
+
+        ok = conv_write_at(fd, block, sizeof(block_header) + bytes, offset);
+        offset += sizeof(block_header) + bytes;
+        h.num_records += count;
+        for (unsigned int c = 0; c < 3; c++)
+        {
+            cols[c].len = 0;
+        }
+    }
+
+    for (unsigned int c = 0; c < 3; c++)
+    {
+        free(cols[c].buf);
+    }
+    free(encoded);
+    free(block);
+    trace_close(in);
+
+    // The header goes in last, so a partly written file is never mistaken
+    // for a delta trace.
+    ok = ok && pwrite(fd, &h, sizeof(h), 0) == sizeof(h);
+    if (close(fd) != 0 || !ok)
+    {
+        fprintf(stderr, "Error: couldn't write %s\n", out_filename);
+        unlink(out_filename);
+        return 1;
+    }
+
+    printf("%s: %llu records in %llu bytes (%.2f bytes per record), "
+           "workload \"%s\"\n",
+           out_filename, (unsigned long long)h.num_records,
+           (unsigned long long)offset,
+           h.num_records ? (double)offset / h.num_records : 0.0,
+           h.workload);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *workload = NULL;
+    bool delta = false;
+    const char *in_filename = NULL;
+    const char *out_filename = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcasecmp(argv[i], "-h") == 0 ||
+            strcasecmp(argv[i], "-help") == 0)
+        {
+            print_usage(argv[0]);
+            return 2;
+        }
+        else if (strcasecmp(argv[i], "-name") == 0)
+        {
+            if (++i >= argc)
+            {
+                fprintf(stderr, "Error: missing argument to -name\n");
+                return 2;
+            }
+            workload = argv[i];
+        }
+        else if (strcasecmp(argv[i], "-delta") == 0)
+        {
+            delta = true;
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "Error: unrecognized option: %s\n", argv[i]);
+            return 2;
+        }
+        else if (!in_filename)
+        {
+            in_filename = argv[i];
+        }
+        else if (!out_filename)
+        {
+            out_filename = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "Error: too many file names specified\n");
+            return 2;
+        }
+    }
+
+    if (!in_filename || !out_filename)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    // By default, name the workload after the input file, e.g., "libq" for
+    // "traces/libq.mtr.gz".
+    char name[TRACE_V2_WORKLOAD_LEN];
+    if (!workload)
+    {
+        const char *base = strrchr(in_filename, '/');
+        base = base ? base + 1 : in_filename;
+        size_t len = strcspn(base, ".");
+        snprintf(name, sizeof(name), "%.*s", (int)len, base);
+        workload = name;
+    }
+
+    if (delta)
+    {
+        return conv_to_delta(in_filename, out_filename, workload);
+    }
+    return conv_to_v2(in_filename, out_filename, workload);
+}
+
+void print_usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [-option <value>] input.mtr.gz output\n",
+            program_name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Convert an .mtr trace (optionally gzip-compressed) into "
+                    "a v2 trace, which\n");
+    fprintf(stderr, "the simulator maps into memory instead of "
+                    "decompressing\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -delta                  Write a delta-compressed "
+                    "trace instead\n");
+    fprintf(stderr, "    -name <workload>        Set the workload name stored "
+                    "in the trace\n");
+    fprintf(stderr, "                            (default: the input file name "
+                    "up to its first '.')\n");
+}
@@ -0,0 +1,524 @@
+// parallel.cpp
+// Defines the functions for the parallel multicore engine.
+//
+// Each core runs on a thread of its own and publishes the cycle it is in. In
+// strict mode, those clocks are all the synchronization there is: a core
+// that misses its L1 caches waits for the cores it must come after. In
+// relaxed mode, the cores only meet at a barrier at the end of each quantum,
+// where one of them replays the quantum's L2 accesses; see parallel.h.
+
+#include "parallel.h"
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** How often the calling thread reports progress, in microseconds. */
+#define PARALLEL_POLL_USEC 5000
+
+/** The initial number of L2 accesses each core can log per quantum. */
+#define PARALLEL_LOG_INITIAL 1024
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** An L2 access made by a core during a quantum in relaxed mode. */
+typedef struct ParallelAccess
+{
+    uint64_t cycle;
+    uint64_t line_addr;
+
+    /* the delay of the earlier accesses of the same instruction */
+    uint64_t inst_delay;
+
+    /* the delay the core was given for it */
+    uint64_t estimate;
+
+    AccessType type;
+    bool is_writeback;
+} ParallelAccess;
+
+/** A core and the thread simulating it. Each takes up its own cache lines. */
+typedef struct alignas(64) ParallelCore
+{
+    Core *core;
+    pthread_t thread;
+
+    /**
+     * The cycle the core is in, or UINT64_MAX once it is done. In relaxed
+     * mode, the cycle the current quantum started in.
+     */
+    std::atomic<uint64_t> clock;
+
+    /* the next cycle in which the core has work to do */
+    uint64_t next_cycle;
+
+    /* relaxed mode: the L2 accesses of the current quantum, in order */
+    ParallelAccess *log;
+    size_t log_len;
+    size_t log_capacity;
+    size_t replay_pos;
+
+    /**
+     * Relaxed mode: the number of cycles the core stalled too little on the
+     * loads and instruction fetches replayed so far, negative if it stalled
+     * too long.
+     */
+    int64_t correction;
+
+    /**
+     * Relaxed mode: the cycles the core stalled too long that are yet to be
+     * given back, by cutting short its next stalls.
+     */
+    uint64_t credit;
+} ParallelCore;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  GLOBALS                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+extern ParallelMode PARALLEL_MODE;
+extern uint64_t PARALLEL_QUANTUM;
+
+/** The current clock cycle number of the calling thread. */
+extern thread_local uint64_t current_cycle;
+
+/** The delay of the earlier accesses of the instruction being executed. */
+extern thread_local uint64_t memsys_inst_delay;
+
+static MemorySystem *parallel_sys;
+static ParallelCore *parallel_cores;
+static unsigned int parallel_num_cores;
+
+/* the cycle the simulation starts in, after any checkpoint restored */
+static uint64_t parallel_start_cycle;
+
+/* relaxed mode: the barrier ending each quantum */
+static pthread_barrier_t parallel_barrier;
+
+/* relaxed mode: whether every core was done at the end of the last quantum */
+static bool parallel_finished;
+
+static ParallelStats parallel_stats;
+
+///////////////////////////////////////////////////////////////////////////////
+//                           FUNCTION DEFINITIONS                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Allocate zeroed memory aligned to a cache line, or exit on failure.
+ */
+static void *parallel_alloc(size_t size)
+{
+    size = (size + 63) & ~(size_t)63;
+    void *p = aligned_alloc(64, size);
+    if (!p)
+    {
+        exit(1);
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+/**
+ * In strict mode, access the L2 cache once every access the sequential
+ * engine would make before this one has been made.
+ */
+static uint64_t parallel_strict_l2_access(MemorySystem *sys,
+                                          uint64_t line_addr,
+                                          bool is_writeback, AccessType type,
+                                          unsigned int core_id)
+{
+    (void)type;
+
+    // The sequential engine simulates the cores of each cycle in order, so
+    // the cores before this one must be past this cycle, and the cores after
+    // it must have reached it.
+    for (unsigned int j = 0; j < parallel_num_cores; j++)
+    {
+        uint64_t needed = (j < core_id) ? current_cycle + 1 : current_cycle;
+        while (parallel_cores[j].clock.load(std::memory_order_acquire) <
+               needed)
+        {
+            sched_yield();
+        }
+    }
+
+    return memsys_l2_access(sys, line_addr, is_writeback, core_id);
+}
+
+/**
+ * In relaxed mode, log an L2 access for the end of the quantum, and estimate
+ * its delay from the L2 cache and DRAM as they were at the start.
+ */
+static uint64_t parallel_relaxed_l2_access(MemorySystem *sys,
+                                           uint64_t line_addr,
+                                           bool is_writeback, AccessType type,
+                                           unsigned int core_id)
+{
+    ParallelCore *pc = &parallel_cores[core_id];
+    if (pc->log_len == pc->log_capacity)
+    {
+        pc->log_capacity *= 2;
+        pc->log = (ParallelAccess *)realloc(
+            pc->log, pc->log_capacity * sizeof(ParallelAccess));
+        if (!pc->log)
+        {
+            exit(1);
+        }
+    }
+
+    // Writebacks don't delay the core.
+    uint64_t estimate = is_writeback ? 0 : memsys_l2_estimate(sys, line_addr);
+
+    ParallelAccess *access = &pc->log[pc->log_len++];
+    access->cycle = current_cycle;
+    access->line_addr = line_addr;
+    access->inst_delay = memsys_inst_delay;
+    access->estimate = estimate;
+    access->type = type;
+    access->is_writeback = is_writeback;
+    return estimate;
+}
+
+/**
+ * In relaxed mode, replay the L2 accesses logged by all cores during the
+ * last quantum in the order of the sequential engine, and work out how far
+ * each core's estimates were off.
+ */
+static void parallel_replay()
+{
+    MemorySystem *sys = parallel_sys;
+
+    while (true)
+    {
+        // Take the earliest access left; on ties, the lowest core goes first.
+        unsigned int core_id = 0;
+        ParallelAccess *access = NULL;
+        for (unsigned int i = 0; i < parallel_num_cores; i++)
+        {
+            ParallelCore *pc = &parallel_cores[i];
+            if (pc->replay_pos < pc->log_len &&
+                (!access || pc->log[pc->replay_pos].cycle < access->cycle))
+            {
+                core_id = i;
+                access = &pc->log[pc->replay_pos];
+            }
+        }
+        if (!access)
+        {
+            break;
+        }
+        parallel_cores[core_id].replay_pos++;
+
+        current_cycle = access->cycle;
+        memsys_inst_delay = access->inst_delay;
+        uint64_t delay = memsys_l2_access(sys, access->line_addr,
+                                          access->is_writeback, core_id);
+        if (access->is_writeback)
+        {
+            continue;
+        }
+
+        int64_t diff = (int64_t)(delay - access->estimate);
+        parallel_stats.stat_replays++;
+        if (diff)
+        {
+            parallel_stats.stat_mispredicts++;
+            parallel_stats.stat_drift_cycles += (diff < 0) ? -diff : diff;
+        }
+
+        MemsysCoreStats *stats = &sys->core_stats[core_id];
+        if (access->type == ACCESS_TYPE_IFETCH)
+        {
+            stats->stat_ifetch_delay += diff;
+        }
+        if (access->type == ACCESS_TYPE_LOAD)
+        {
+            stats->stat_load_delay += diff;
+        }
+        if (access->type == ACCESS_TYPE_STORE)
+        {
+            stats->stat_store_delay += diff;
+        }
+
+        // We don't incur bubbles for store misses.
+        if (access->type != ACCESS_TYPE_STORE)
+        {
+            parallel_cores[core_id].correction += diff;
+        }
+    }
+
+    for (unsigned int i = 0; i < parallel_num_cores; i++)
+    {
+        parallel_cores[i].log_len = 0;
+        parallel_cores[i].replay_pos = 0;
+    }
+}
+
+/**
+ * In relaxed mode, charge each core the cycles it stalled too little during
+ * the quantum that just ended, or give back the ones it stalled too long.
+ *
+ * @param end The first cycle of the next quantum.
+ */
+static void parallel_correct(uint64_t end)
+{
+    parallel_finished = true;
+    for (unsigned int i = 0; i < parallel_num_cores; i++)
+    {
+        ParallelCore *pc = &parallel_cores[i];
+        Core *core = pc->core;
+        int64_t diff = pc->correction - (int64_t)pc->credit;
+        pc->correction = 0;
+        pc->credit = 0;
+
+        if (core->done)
+        {
+            // The core finished during the quantum, later or earlier; it
+            // can only be held back.
+            if (diff > 0)
+            {
+                core->done_cycle_count += diff;
+            }
+            else
+            {
+                parallel_stats.stat_lost_cycles += -diff;
+            }
+            continue;
+        }
+        parallel_finished = false;
+
+        if (diff > 0)
+        {
+            // Stall from the start of the next quantum on, or further if
+            // the core is still snoozing then.
+            if (core->snooze_end_cycle < end - 1)
+            {
+                core->snooze_end_cycle = end - 1;
+            }
+            core->snooze_end_cycle += diff;
+        }
+        else if (diff < 0)
+        {
+            // Only the part of the snooze that reaches into the next
+            // quantum can be cut short.
+            uint64_t left = (core->snooze_end_cycle >= end)
+                                ? core->snooze_end_cycle - (end - 1)
+                                : 0;
+            uint64_t given = ((uint64_t)-diff < left) ? -diff : left;
+            core->snooze_end_cycle -= given;
+
+            // The rest is taken off the next stalls of the core, during the
+            // next quantum or later.
+            pc->credit = -diff - given;
+        }
+
+        pc->next_cycle = (core->snooze_end_cycle >= end)
+                             ? core->snooze_end_cycle + 1
+                             : end;
+    }
+}
+
+/**
+ * Simulate one core in strict mode, one cycle with work at a time.
+ */
+static void *parallel_run_strict(void *arg)
+{
+    ParallelCore *pc = (ParallelCore *)arg;
+    Core *core = pc->core;
+
+    while (!core->done)
+    {
+        current_cycle = pc->next_cycle;
+        core_cycle(core);
+        pc->next_cycle = core_next_cycle(core);
+        pc->clock.store(pc->next_cycle, std::memory_order_release);
+    }
+    return NULL;
+}
+
+/**
+ * Simulate one core in relaxed mode, one quantum at a time.
+ */
+static void *parallel_run_relaxed(void *arg)
+{
+    ParallelCore *pc = (ParallelCore *)arg;
+    Core *core = pc->core;
+
+    for (uint64_t start = parallel_start_cycle;; start += PARALLEL_QUANTUM)
+    {
+        uint64_t end = start + PARALLEL_QUANTUM;
+        while (pc->next_cycle < end)
+        {
+            current_cycle = pc->next_cycle;
+            core_cycle(core);
+
+            // A core only runs a cycle once it has stopped snoozing, so any
+            // snooze now is a stall that just started.
+            if (pc->credit && core->snooze_end_cycle > current_cycle)
+            {
+                uint64_t stall = core->snooze_end_cycle - current_cycle;
+                uint64_t given = (pc->credit < stall) ? pc->credit : stall;
+                core->snooze_end_cycle -= given;
+                pc->credit -= given;
+            }
+            pc->next_cycle = core_next_cycle(core);
+        }
+
+        if (pthread_barrier_wait(&parallel_barrier) ==
+            PTHREAD_BARRIER_SERIAL_THREAD)
+        {
+            parallel_stats.stat_quanta++;
+            parallel_replay();
+            parallel_correct(end);
+        }
+        pthread_barrier_wait(&parallel_barrier);
+
+        pc->clock.store(core->done ? UINT64_MAX : end,
+                        std::memory_order_release);
+        if (parallel_finished)
+        {
+            return NULL;
+        }
+    }
+}
+
+uint64_t parallel_simulate(MemorySystem *sys, Core **cores,
+                           unsigned int num_cores,
+                           void (*progress)(uint64_t cycle))
+{
+    bool relaxed = (PARALLEL_MODE == PARALLEL_RELAXED);
+
+    parallel_sys = sys;
+    parallel_num_cores = num_cores;
+    parallel_start_cycle = current_cycle;
+    parallel_cores = (ParallelCore *)parallel_alloc(num_cores *
+                                                    sizeof(ParallelCore));
+    memset(&parallel_stats, 0, sizeof(parallel_stats));
+    parallel_finished = false;
+
+    sys->core_stats = (MemsysCoreStats *)parallel_alloc(
+        num_cores * sizeof(MemsysCoreStats));
+    sys->l2_access_hook = relaxed ? parallel_relaxed_l2_access
+                                  : parallel_strict_l2_access;
+
+    if (relaxed)
+    {
+        pthread_barrier_init(&parallel_barrier, NULL, num_cores);
+    }
+
+    for (unsigned int i = 0; i < num_cores; i++)
+    {
+        ParallelCore *pc = &parallel_cores[i];
+        pc->core = cores[i];
+        pc->next_cycle = cores[i]->done ? UINT64_MAX : parallel_start_cycle;
+        pc->clock.store(pc->next_cycle);
+
+        if (relaxed)
+        {
+            pc->log_capacity = PARALLEL_LOG_INITIAL;
+            pc->log = (ParallelAccess *)malloc(pc->log_capacity *
+                                               sizeof(ParallelAccess));
+            if (!pc->log)
+            {
+                exit(1);
+            }
+
+            // The L1 caches of different cores are now filled concurrently,
+            // so random replacement can't share rand() between them.
+            sys->icache_coreid[i]->private_rand = true;
+            sys->icache_coreid[i]->rand_state = i;
+            sys->dcache_coreid[i]->private_rand = true;
+            sys->dcache_coreid[i]->rand_state = i;
+        }
+    }
+
+    for (unsigned int i = 0; i < num_cores; i++)
+    {
+        if (pthread_create(&parallel_cores[i].thread, NULL,
+                           relaxed ? parallel_run_relaxed
+                                   : parallel_run_strict,
+                           &parallel_cores[i]) != 0)
+        {
+            perror("Couldn't start core thread");
+            exit(1);
+        }
+    }
+
+    // Every core is sure to get past the cycle before the lowest clock.
+    while (true)
+    {
+        usleep(PARALLEL_POLL_USEC);
+
+        uint64_t min_clock = UINT64_MAX;
+        for (unsigned int i = 0; i < num_cores; i++)
+        {
+            uint64_t clock = parallel_cores[i].clock.load(
+                std::memory_order_acquire);
+            if (clock < min_clock)
+            {
+                min_clock = clock;
+            }
+        }
+
+        if (min_clock == UINT64_MAX)
+        {
+            break;
+        }
+        if (min_clock > 0)
+        {
+            progress(min_clock - 1);
+        }
+    }
+
+    uint64_t last_cycle = 0;
+    for (unsigned int i = 0; i < num_cores; i++)
+    {
+        pthread_join(parallel_cores[i].thread, NULL);
+        free(parallel_cores[i].log);
+
+        if (cores[i]->done_cycle_count > last_cycle)
+        {
+            last_cycle = cores[i]->done_cycle_count;
+        }
+    }
+
+    if (relaxed)
+    {
+        pthread_barrier_destroy(&parallel_barrier);
+    }
+    free(parallel_cores);
+    parallel_cores = NULL;
+    sys->l2_access_hook = NULL;
+
+    return last_cycle + 1;
+}
+
+void parallel_print_stats()
+{
+    if (PARALLEL_MODE != PARALLEL_RELAXED)
+    {
+        return;
+    }
+
+    printf("\n");
+    printf("PARALLEL_QUANTA        \t\t : %10llu\n",
+           parallel_stats.stat_quanta);
+    printf("PARALLEL_REPLAYS       \t\t : %10llu\n",
+           parallel_stats.stat_replays);
+    printf("PARALLEL_MISPREDICTS   \t\t : %10llu\n",
+           parallel_stats.stat_mispredicts);
+    printf("PARALLEL_DRIFT_CYCLES  \t\t : %10llu\n",
+           parallel_stats.stat_drift_cycles);
+    printf("PARALLEL_LOST_CYCLES   \t\t : %10llu\n",
+           parallel_stats.stat_lost_cycles);
+}
@@ -0,0 +1,86 @@
+// parallel.h
+// Declares the parallel multicore engine, which simulates each core and its
+// private L1 caches on a host thread of its own, and orders the cores'
+// accesses to the shared L2 cache and DRAM.
+//
+// In strict mode, a core may only access the L2 in cycle t once every core
+// before it has finished cycle t and every core after it has finished cycle
+// t - 1. The L2 then sees exactly the accesses of the sequential engine, in
+// the same order, so the results are identical; only stretches of L1 hits
+// run in parallel.
+//
+// In relaxed mode, time is cut into quanta. Within a quantum, the cores run
+// freely against the L2 and DRAM as they were at its start: an L2 access
+// only looks up whether the line is present and returns an estimated delay,
+// and is logged. At the end of the quantum, one thread replays the logged
+// accesses in timestamp order against the real L2 and DRAM, and the
+// difference between each real delay and its estimate is charged to the
+// core at the start of the next quantum. Cycles a core stalled too long are
+// given back by cutting short its current stall, or failing that, its next
+// ones.
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include "types.h"
+#include "core.h"
+#include "memsys.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** Possible engines to simulate the cores with. */
+typedef enum ParallelModeEnum
+{
+    PARALLEL_NONE = 0,    // Round-robin over the cores on one thread.
+    PARALLEL_STRICT = 1,  // One thread per core, identical results.
+    PARALLEL_RELAXED = 2, // One thread per core, synchronized every quantum.
+} ParallelMode;
+
+/** How far the results of a relaxed parallel simulation drifted. */
+typedef struct ParallelStats
+{
+    /* the number of quanta simulated */
+    unsigned long long stat_quanta;
+
+    /* the number of L2 accesses replayed, excluding writebacks */
+    unsigned long long stat_replays;
+
+    /* the number of them whose real delay differed from the estimate */
+    unsigned long long stat_mispredicts;
+
+    /* the total absolute difference between real and estimated delays */
+    unsigned long long stat_drift_cycles;
+
+    /**
+     * The part of the negative differences that could not be given back,
+     * because the core finished before it stalled again.
+     */
+    unsigned long long stat_lost_cycles;
+} ParallelStats;
+
+///////////////////////////////////////////////////////////////////////////////
+//                            FUNCTION PROTOTYPES                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Simulate the cores until all of them are done, each on its own thread.
+ *
+ * @param sys The memory system the cores share.
+ * @param cores The cores to simulate.
+ * @param num_cores The number of cores.
+ * @param progress A function called now and then from the calling thread
+ *                 with a cycle that every core has reached.
+ * @return The cycle after the last one simulated.
+ */
+uint64_t parallel_simulate(MemorySystem *sys, Core **cores,
+                           unsigned int num_cores,
+                           void (*progress)(uint64_t cycle));
+
+/**
+ * Print the drift statistics of the last relaxed parallel simulation.
+ */
+void parallel_print_stats();
+
+#endif // __PARALLEL_H__
@@ -0,0 +1,778 @@
+// prefetch.cpp
+// Defines the functions for hardware prefetchers.
+
+#include "prefetch.h"
+#include "checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 EXTERNALS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The size of a cache line in bytes. */
+extern uint64_t CACHE_LINESIZE;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The number of entries of the reference prediction table. */
+#define PREFETCH_RPT_SIZE 256
+
+/** The number of streams a stream prefetcher follows. */
+#define PREFETCH_STREAMS 16
+
+/** How many lines away from a stream a miss can be and still follow it. */
+#define PREFETCH_STREAM_WINDOW 16
+
+/**
+ * The confidence a stride or stream needs before it is prefetched along,
+ * and the most it can have.
+ */
+#define PREFETCH_CONFIDENT 2
+#define PREFETCH_MAX_CONFIDENCE 3
+
+/**
+ * The number of entries of the correlation table of a temporal prefetcher,
+ * and the bytes each one takes in DRAM.
+ */
+#define PREFETCH_TABLE_BITS 18
+#define PREFETCH_TABLE_SIZE (1 << PREFETCH_TABLE_BITS)
+#define PREFETCH_ENTRY_BYTES 16
+
+/** The size and associativity of the on-chip cache of correlation lines. */
+#define PREFETCH_META_CACHE_SIZE (32 * 1024)
+#define PREFETCH_META_CACHE_ASSOC 8
+
+/**
+ * The line the correlation table starts at in DRAM, above every line a trace
+ * can reach.
+ */
+#define PREFETCH_META_BASE (1ULL << 57)
+
+/** The number of bits of the pollution filter. */
+#define PREFETCH_FILTER_BITS 4096
+
+/** The number of demand misses in a feedback interval. */
+#define PREFETCH_INTERVAL 1024
+
+/**
+ * The thresholds of feedback throttling: prefetchers are accurate from
+ * PREFETCH_ACCURACY_HIGH of their prefetches used, and inaccurate below
+ * PREFETCH_ACCURACY_LOW; late when more than PREFETCH_LATENESS of the
+ * used prefetches arrive late; and polluting when more than
+ * PREFETCH_POLLUTION of the demand misses are on lines they evicted.
+ */
+#define PREFETCH_ACCURACY_HIGH 0.75
+#define PREFETCH_ACCURACY_LOW 0.40
+#define PREFETCH_LATENESS 0.01
+#define PREFETCH_POLLUTION 0.005
+
+/** The least and most aggressive throttling levels, and the default. */
+#define PREFETCH_MIN_LEVEL 1
+#define PREFETCH_MAX_LEVEL 5
+#define PREFETCH_MID_LEVEL 3
+
+///////////////////////////////////////////////////////////////////////////////
+//                           FUNCTION DEFINITIONS                            //
+///////////////////////////////////////////////////////////////////////////////
+
+Prefetcher *prefetch_new(PrefetcherType type, unsigned int degree,
+                         unsigned int distance, bool throttle,
+                         uint64_t cache_lines)
+{
+    if (type == PREFETCH_NONE)
+    {
+        return NULL;
+    }
+
+    Prefetcher *pf = (Prefetcher *)calloc(1, sizeof(Prefetcher));
+    if (!pf)
+    {
+        exit(1);
+    }
+
+    pf->type = type;
+    pf->degree = degree;
+    pf->distance = distance;
+    pf->throttle = throttle;
+    pf->level = PREFETCH_MID_LEVEL;
+
+    if (type == PREFETCH_IP_STRIDE)
+    {
+        pf->rpt = (PrefetchRptEntry *)calloc(PREFETCH_RPT_SIZE,
+                                             sizeof(PrefetchRptEntry));
+        if (!pf->rpt)
+        {
+            exit(1);
+        }
+    }
+    if (type == PREFETCH_STREAM)
+    {
+        pf->streams = (PrefetchStream *)calloc(PREFETCH_STREAMS,
+                                               sizeof(PrefetchStream));
+        if (!pf->streams)
+        {
+            exit(1);
+        }
+    }
+    if (type == PREFETCH_TEMPORAL)
+    {
+        pf->table = (PrefetchCorrelation *)calloc(
+            PREFETCH_TABLE_SIZE, sizeof(PrefetchCorrelation));
+        if (!pf->table)
+        {
+            exit(1);
+        }
+        pf->meta_cache = cache_new(PREFETCH_META_CACHE_SIZE,
+                                   PREFETCH_META_CACHE_ASSOC, CACHE_LINESIZE,
+                                   LRU);
+    }
+
+    uint64_t slots = 2;
+    while (slots < 2 * cache_lines)
+    {
+        slots *= 2;
+    }
+    pf->unused = (uint64_t *)calloc(slots, sizeof(uint64_t));
+    pf->unused_mask = slots - 1;
+    pf->queue = mshr_new(PREFETCH_QUEUE_SIZE);
+    pf->pollution_filter = (uint8_t *)calloc(PREFETCH_FILTER_BITS / 8, 1);
+    if (!pf->unused || !pf->pollution_filter)
+    {
+        exit(1);
+    }
+    return pf;
+}
+
+/**
+ * Hash a line or instruction address.
+ *
+ * @param key The address.
+ * @return The hash, whose low bits are all usable as an index.
+ */
+static uint64_t prefetch_hash(uint64_t key)
+{
+    return (key * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+/**
+ * Add a line to the set of prefetched lines not used yet.
+ *
+ * @param pf The prefetcher.
+ * @param line_addr The address of the line.
+ */
+static void prefetch_unused_insert(Prefetcher *pf, uint64_t line_addr)
+{
+    uint64_t i = prefetch_hash(line_addr) & pf->unused_mask;
+    while (pf->unused[i] && pf->unused[i] != line_addr + 1)
+    {
+        i = (i + 1) & pf->unused_mask;
+    }
+    pf->unused[i] = line_addr + 1;
+}
+
+/**
+ * Remove a line from the set of prefetched lines not used yet, if it is in
+ * it. The lines after it in its run of slots are moved back so that every
+ * line stays reachable from its hash.
+ *
+ * @param pf The prefetcher.
+ * @param line_addr The address of the line.
+ * @return Whether the line was in the set.
+ */
+static bool prefetch_unused_remove(Prefetcher *pf, uint64_t line_addr)
+{
+    uint64_t i = prefetch_hash(line_addr) & pf->unused_mask;
+    while (pf->unused[i] != line_addr + 1)
+    {
+        if (!pf->unused[i])
+        {
+            return false;
+        }
+        i = (i + 1) & pf->unused_mask;
+    }
+
+    for (uint64_t j = (i + 1) & pf->unused_mask; pf->unused[j];
+         j = (j + 1) & pf->unused_mask)
+    {
+        // The line in slot j can fill the hole in slot i unless its hash
+        // lies cyclically between the two.
+        uint64_t home = prefetch_hash(pf->unused[j] - 1) & pf->unused_mask;
+        bool between = (i < j) ? (home > i && home <= j)
+                               : (home > i || home <= j);
+        if (!between)
+        {
+            pf->unused[i] = pf->unused[j];
+            i = j;
+        }
+    }
+    pf->unused[i] = 0;
+    return true;
+}
+
+/**
+ * Scale a configured degree or distance to a throttling level, doubling it
+ * for each level above the middle one and halving it for each one below.
+ *
+ * @param value The configured value.
+ * @param level The throttling level.
+ * @return The value to use, at least 1.
+ */
+static unsigned int prefetch_scale(unsigned int value, unsigned int level)
+{
+    if (level >= PREFETCH_MID_LEVEL)
+    {
+        return value << (level - PREFETCH_MID_LEVEL);
+    }
+    unsigned int scaled = value >> (PREFETCH_MID_LEVEL - level);
+    return scaled ? scaled : 1;
+}
+
+/**
+ * Find the lines a prefetcher fetches ahead of an access along a stride.
+ *
+ * @param pf The prefetcher.
+ * @param line_addr The address of the line accessed.
+ * @param stride The stride in lines.
+ * @param lines Where to store the lines.
+ * @return The number of lines.
+ */
+static unsigned int prefetch_ahead(Prefetcher *pf, uint64_t line_addr,
+                                   int64_t stride, uint64_t *lines)
+{
+    unsigned int degree = prefetch_scale(pf->degree, pf->level);
+    unsigned int distance = prefetch_scale(pf->distance, pf->level);
+    for (unsigned int i = 0; i < degree; i++)
+    {
+        lines[i] = line_addr + (uint64_t)(stride * (int64_t)(distance + i));
+    }
+    return degree;
+}
+
+/**
+ * Train the reference prediction table of an IP-stride prefetcher on an
+ * access, and prefetch along the instruction's stride once it has repeated.
+ * Accesses to the line the instruction accessed last are ignored, so that
+ * strides shorter than a line are followed line by line.
+ *
+ * @param pf The prefetcher.
+ * @param pc The address of the instruction.
+ * @param line_addr The address of the line accessed.
+ * @param lines Where to store the lines to prefetch.
+ * @return The number of lines to prefetch.
+ */
+static unsigned int prefetch_train_ip_stride(Prefetcher *pf, uint64_t pc,
+                                             uint64_t line_addr,
+                                             uint64_t *lines)
+{
+    PrefetchRptEntry *e =
+        &pf->rpt[prefetch_hash(pc) & (PREFETCH_RPT_SIZE - 1)];
+    if (e->pc != pc)
+    {
+        e->pc = pc;
+        e->last_line = line_addr;
+        e->stride = 0;
+        e->confidence = 0;
+        return 0;
+    }
+
+    int64_t stride = (int64_t)(line_addr - e->last_line);
+    if (stride == 0)
+    {
+        return 0;
+    }
+    e->last_line = line_addr;
+
+    if (stride == e->stride)
+    {
+        if (e->confidence < PREFETCH_MAX_CONFIDENCE)
+        {
+            e->confidence++;
+        }
+    }
+    else
+    {
+        if (e->confidence > 0)
+        {
+            e->confidence--;
+        }
+        if (e->confidence == 0)
+        {
+            e->stride = stride;
+        }
+        return 0;
+    }
+
+    if (e->confidence < PREFETCH_CONFIDENT)
+    {
+        return 0;
+    }
+    return prefetch_ahead(pf, line_addr, e->stride, lines);
+}
+
+/**
+ * Follow a miss with the stream it belongs to, or start a new stream with
+ * it in place of the least recently used one, and prefetch along the
+ * stream once its direction is confirmed.
+ *
+ * @param pf The prefetcher.
+ * @param line_addr The address of the line that missed.
+ * @param lines Where to store the lines to prefetch.
+ * @return The number of lines to prefetch.
+ */
+static unsigned int prefetch_train_stream(Prefetcher *pf, uint64_t line_addr,
+                                          uint64_t *lines)
+{
+    pf->stream_clock++;
+
+    PrefetchStream *stream = NULL;
+    PrefetchStream *victim = &pf->streams[0];
+    for (unsigned int i = 0; i < PREFETCH_STREAMS; i++)
+    {
+        PrefetchStream *s = &pf->streams[i];
+        int64_t delta = (int64_t)(line_addr - s->last_line);
+        if (s->valid && delta >= -PREFETCH_STREAM_WINDOW &&
+            delta <= PREFETCH_STREAM_WINDOW)
+        {
+            stream = s;
+            break;
+        }
+        if (!s->valid)
+        {
+            victim = s;
+        }
+        else if (victim->valid && s->last_use < victim->last_use)
+        {
+            victim = s;
+        }
+    }
+
+    if (!stream)
+    {
+        victim->valid = true;
+        victim->last_line = line_addr;
+        victim->direction = 0;
+        victim->confidence = 0;
+        victim->last_use = pf->stream_clock;
+        return 0;
+    }
+
+    stream->last_use = pf->stream_clock;
+    int64_t delta = (int64_t)(line_addr - stream->last_line);
+    if (delta == 0)
+    {
+        return 0;
+    }
+
+    int direction = (delta > 0) ? 1 : -1;
+    if (direction == stream->direction)
+    {
+        if (stream->confidence < PREFETCH_MAX_CONFIDENCE)
+        {
+            stream->confidence++;
+        }
+    }
+    else
+    {
+        stream->direction = direction;
+        stream->confidence = 1;
+    }
+    stream->last_line = line_addr;
+
+    if (stream->confidence < PREFETCH_CONFIDENT)
+    {
+        return 0;
+    }
+    return prefetch_ahead(pf, line_addr, direction, lines);
+}
+
+/**
+ * Find the entry of the correlation table a line maps to, and bring the
+ * metadata line holding it into the on-chip cache, listing the DRAM
+ * accesses that takes: a read on a miss, and the writeback of a dirty
+ * victim.
+ *
+ * @param pf The temporal prefetcher.
+ * @param line_addr The address of the line the entry is for.
+ * @param is_write Whether the entry is updated.
+ * @return The entry.
+ */
+static PrefetchCorrelation *prefetch_lookup(Prefetcher *pf, uint64_t line_addr,
+                                            bool is_write)
+{
+    // The table takes the top bits of the product, which spread the lines
+    // of a small region better than the low bits prefetch_hash() keeps.
+    uint64_t index = (line_addr * 0x9E3779B97F4A7C15ULL) >>
+                     (64 - PREFETCH_TABLE_BITS);
+    uint64_t per_line = CACHE_LINESIZE / PREFETCH_ENTRY_BYTES;
+    uint64_t meta_line = PREFETCH_META_BASE + index / (per_line ? per_line : 1);
+
+    if (cache_access(pf->meta_cache, meta_line, is_write, 0) == MISS)
+    {
+        // Updates are read, modified and written back off the critical
+        // path; only the prefetches that follow a lookup wait for it.
+        PrefetchMetaAccess *read = &pf->meta[pf->num_meta++];
+        read->line_addr = meta_line;
+        read->is_write = false;
+        read->blocking = !is_write;
+        pf->stat_meta_reads++;
+
+        cache_install(pf->meta_cache, meta_line, is_write, 0);
+        CacheLine *evicted = &pf->meta_cache->last_evicted_line;
+        if (evicted->valid && evicted->dirty)
+        {
+            PrefetchMetaAccess *write = &pf->meta[pf->num_meta++];
+            write->line_addr = evicted->line_addr;
+            write->is_write = true;
+            write->blocking = false;
+            pf->stat_meta_writes++;
+            evicted->valid = false;
+        }
+    }
+    return &pf->table[index];
+}
+
+/**
+ * Record a miss as the successor of the one before it, and prefetch the
+ * misses that followed it last time, walking the chain of successors in
+ * the correlation table up to the distance plus the degree.
+ *
+ * @param pf The temporal prefetcher.
+ * @param line_addr The address of the line that missed.
+ * @param lines Where to store the lines to prefetch.
+ * @return The number of lines to prefetch.
+ */
+static unsigned int prefetch_train_temporal(Prefetcher *pf,
+                                            uint64_t line_addr,
+                                            uint64_t *lines)
+{
+    unsigned int degree = prefetch_scale(pf->degree, pf->level);
+    unsigned int distance = prefetch_scale(pf->distance, pf->level);
+    unsigned int n = 0;
+    uint64_t line = line_addr;
+    for (unsigned int hop = 1; hop < distance + degree; hop++)
+    {
+        PrefetchCorrelation *e = prefetch_lookup(pf, line, false);
+        if (e->trigger != line + 1 || !e->successor)
+        {
+            break;
+        }
+        line = e->successor - 1;
+        if (line == line_addr)
+        {
+            break;
+        }
+        if (hop >= distance)
+        {
+            lines[n++] = line;
+        }
+    }
+
+    if (pf->last_trigger && pf->last_trigger != line_addr + 1)
+    {
+        PrefetchCorrelation *e = prefetch_lookup(pf, pf->last_trigger - 1,
+                                                 true);
+        e->trigger = pf->last_trigger;
+        e->successor = line_addr + 1;
+    }
+    pf->last_trigger = line_addr + 1;
+    return n;
+}
+
+unsigned int prefetch_train(Prefetcher *pf, uint64_t pc, uint64_t line_addr,
+                            bool trigger, uint64_t *lines)
+{
+    pf->num_meta = 0;
+    if (pf->type == PREFETCH_IP_STRIDE)
+    {
+        return prefetch_train_ip_stride(pf, pc, line_addr, lines);
+    }
+    if (!trigger)
+    {
+        return 0;
+    }
+    if (pf->type == PREFETCH_STREAM)
+    {
+        return prefetch_train_stream(pf, line_addr, lines);
+    }
+    if (pf->type == PREFETCH_TEMPORAL)
+    {
+        return prefetch_train_temporal(pf, line_addr, lines);
+    }
+    return prefetch_ahead(pf, line_addr, 1, lines);
+}
+
+bool prefetch_can_issue(Prefetcher *pf, uint64_t cycle)
+{
+    for (unsigned int i = 0; i < pf->queue->size; i++)
+    {
+        if (pf->queue->ready_cycle[i] <= cycle)
+        {
+            return true;
+        }
+    }
+    pf->stat_dropped++;
+    return false;
+}
+
+void prefetch_issue(Prefetcher *pf, uint64_t line_addr, uint64_t cycle,
+                    uint64_t ready_cycle)
+{
+    pf->stat_issued++;
+    pf->interval[PREFETCH_FB_ISSUED]++;
+    prefetch_unused_insert(pf, line_addr);
+
+    if (ready_cycle)
+    {
+        uint64_t wait;
+        unsigned int index = mshr_allocate(pf->queue, line_addr, cycle, &wait);
+        mshr_fill(pf->queue, index, ready_cycle);
+    }
+}
+
+bool prefetch_hit(Prefetcher *pf, uint64_t line_addr, uint64_t cycle,
+                  uint64_t *ready_cycle)
+{
+    // Every access waits for a line in flight, but only the first use of
+    // the line makes the prefetch late.
+    *ready_cycle = 0;
+    bool in_flight = mshr_merge(pf->queue, line_addr, cycle, ready_cycle);
+    if (!prefetch_unused_remove(pf, line_addr))
+    {
+        return false;
+    }
+
+    pf->stat_useful++;
+    pf->interval[PREFETCH_FB_USEFUL]++;
+    if (in_flight)
+    {
+        pf->stat_late++;
+        pf->interval[PREFETCH_FB_LATE]++;
+    }
+    return true;
+}
+
+/**
+ * At the end of a feedback interval, average its counters into the earlier
+ * ones, and move the throttling level up or down a step from the accuracy,
+ * lateness and pollution of the prefetcher so far, as in feedback directed
+ * prefetching: late prefetches call for more aggressive prefetching unless
+ * the prefetcher is inaccurate or polluting, and pollution calls for less.
+ *
+ * @param pf The prefetcher.
+ */
+static void prefetch_adjust(Prefetcher *pf)
+{
+    for (unsigned int k = 0; k < PREFETCH_FB_COUNTERS; k++)
+    {
+        pf->history[k] = (pf->history[k] + pf->interval[k]) / 2;
+        pf->interval[k] = 0;
+    }
+
+    uint64_t *h = pf->history;
+    if (!h[PREFETCH_FB_ISSUED])
+    {
+        return;
+    }
+
+    double accuracy = (double)h[PREFETCH_FB_USEFUL] /
+                      (double)h[PREFETCH_FB_ISSUED];
+    bool late = h[PREFETCH_FB_USEFUL] &&
+                (double)h[PREFETCH_FB_LATE] / (double)h[PREFETCH_FB_USEFUL] >
+                    PREFETCH_LATENESS;
+    bool polluting = h[PREFETCH_FB_MISSES] &&
+                     (double)h[PREFETCH_FB_POLLUTION] /
+                             (double)h[PREFETCH_FB_MISSES] >
+                         PREFETCH_POLLUTION;
+
+    int step = 0;
+    if (accuracy >= PREFETCH_ACCURACY_HIGH)
+    {
+        step = late ? 1 : (polluting ? -1 : 0);
+    }
+    else if (accuracy >= PREFETCH_ACCURACY_LOW)
+    {
+        step = polluting ? -1 : (late ? 1 : 0);
+    }
+    else
+    {
+        step = (late || polluting) ? -1 : 0;
+    }
+
+    if (step > 0 && pf->level < PREFETCH_MAX_LEVEL)
+    {
+        pf->level++;
+    }
+    if (step < 0 && pf->level > PREFETCH_MIN_LEVEL)
+    {
+        pf->level--;
+    }
+}
+
+void prefetch_miss(Prefetcher *pf, uint64_t line_addr)
+{
+    pf->stat_misses++;
+    pf->interval[PREFETCH_FB_MISSES]++;
+
+    uint64_t bit = prefetch_hash(line_addr) % PREFETCH_FILTER_BITS;
+    uint8_t mask = 1 << (bit % 8);
+    if (pf->pollution_filter[bit / 8] & mask)
+    {
+        pf->pollution_filter[bit / 8] &= ~mask;
+        pf->stat_pollution++;
+        pf->interval[PREFETCH_FB_POLLUTION]++;
+    }
+
+    if (pf->throttle &&
+        pf->interval[PREFETCH_FB_MISSES] == PREFETCH_INTERVAL)
+    {
+        prefetch_adjust(pf);
+    }
+}
+
+void prefetch_evict(Prefetcher *pf, uint64_t line_addr, bool by_prefetch)
+{
+    if (prefetch_unused_remove(pf, line_addr))
+    {
+        pf->stat_useless++;
+        return;
+    }
+
+    if (by_prefetch)
+    {
+        uint64_t bit = prefetch_hash(line_addr) % PREFETCH_FILTER_BITS;
+        pf->pollution_filter[bit / 8] |= 1 << (bit % 8);
+    }
+}
+
+/**
+ * Write a block of prefetcher state to a checkpoint; see checkpoint_write().
+ */
+static bool prefetch_write_block(gzFile gz, void *data, uint64_t size)
+{
+    return checkpoint_write(gz, data, size);
+}
+
+/**
+ * Save or restore the state of a prefetcher.
+ *
+ * @param pf The prefetcher.
+ * @param gz The checkpoint file.
+ * @param load Whether to restore the state rather than save it.
+ * @return Whether the state was transferred in full.
+ */
+static bool prefetch_transfer(Prefetcher *pf, gzFile gz, bool load)
+{
+    bool (*transfer)(gzFile, void *, uint64_t) =
+        load ? checkpoint_read : prefetch_write_block;
+
+    uint64_t level = pf->level;
+    unsigned long long stats[9] = {pf->stat_issued, pf->stat_useful,
+                                   pf->stat_late, pf->stat_useless,
+                                   pf->stat_dropped, pf->stat_pollution,
+                                   pf->stat_misses, pf->stat_meta_reads,
+                                   pf->stat_meta_writes};
+    bool ok =
+        transfer(gz, &level, sizeof(level)) &&
+        transfer(gz, pf->unused, (pf->unused_mask + 1) * sizeof(uint64_t)) &&
+        transfer(gz, pf->pollution_filter, PREFETCH_FILTER_BITS / 8) &&
+        transfer(gz, pf->interval, sizeof(pf->interval)) &&
+        transfer(gz, pf->history, sizeof(pf->history)) &&
+        transfer(gz, stats, sizeof(stats)) &&
+        (load ? mshr_load(pf->queue, gz) : mshr_save(pf->queue, gz));
+    if (ok && pf->rpt)
+    {
+        ok = transfer(gz, pf->rpt,
+                      PREFETCH_RPT_SIZE * sizeof(PrefetchRptEntry));
+    }
+    if (ok && pf->streams)
+    {
+        ok = transfer(gz, &pf->stream_clock, sizeof(pf->stream_clock)) &&
+             transfer(gz, pf->streams,
+                      PREFETCH_STREAMS * sizeof(PrefetchStream));
+    }
+    if (ok && pf->table)
+    {
+        ok = transfer(gz, &pf->last_trigger, sizeof(pf->last_trigger)) &&
+             transfer(gz, pf->table,
+                      PREFETCH_TABLE_SIZE * sizeof(PrefetchCorrelation)) &&
+             (load ? cache_load(pf->meta_cache, gz)
+                   : cache_save(pf->meta_cache, gz));
+    }
+    if (!ok || !load)
+    {
+        return ok;
+    }
+
+    pf->level = level;
+    pf->stat_issued = stats[0];
+    pf->stat_useful = stats[1];
+    pf->stat_late = stats[2];
+    pf->stat_useless = stats[3];
+    pf->stat_dropped = stats[4];
+    pf->stat_pollution = stats[5];
+    pf->stat_misses = stats[6];
+    pf->stat_meta_reads = stats[7];
+    pf->stat_meta_writes = stats[8];
+    return true;
+}
+
+bool prefetch_save(Prefetcher *pf, gzFile gz)
+{
+    return prefetch_transfer(pf, gz, false);
+}
+
+bool prefetch_load(Prefetcher *pf, gzFile gz)
+{
+    return prefetch_transfer(pf, gz, true);
+}
+
+void prefetch_print_stats(Prefetcher *pf, const char *label,
+                          unsigned long long dram_accesses)
+{
+    double accuracy = 0.0;
+    if (pf->stat_issued)
+    {
+        accuracy = (double)pf->stat_useful / (double)pf->stat_issued;
+    }
+
+    // Coverage is the share of the misses there would have been without
+    // the prefetcher that it turned into hits.
+    double coverage = 0.0;
+    if (pf->stat_useful + pf->stat_misses)
+    {
+        coverage = (double)pf->stat_useful /
+                   (double)(pf->stat_useful + pf->stat_misses);
+    }
+
+    printf("%s_PF_ISSUED      \t\t : %10llu\n", label, pf->stat_issued);
+    printf("%s_PF_USEFUL      \t\t : %10llu\n", label, pf->stat_useful);
+    printf("%s_PF_LATE        \t\t : %10llu\n", label, pf->stat_late);
+    printf("%s_PF_USELESS     \t\t : %10llu\n", label, pf->stat_useless);
+    printf("%s_PF_DROPPED     \t\t : %10llu\n", label, pf->stat_dropped);
+    printf("%s_PF_POLLUTION   \t\t : %10llu\n", label, pf->stat_pollution);
+    printf("%s_PF_ACCURACY    \t\t : %10.3f\n", label, accuracy);
+    printf("%s_PF_COVERAGE    \t\t : %10.3f\n", label, coverage);
+    if (pf->throttle)
+    {
+        printf("%s_PF_LEVEL       \t\t : %10u\n", label, pf->level);
+    }
+    if (!pf->table)
+    {
+        return;
+    }
+
+    unsigned long long meta = pf->stat_meta_reads + pf->stat_meta_writes;
+    double meta_perc = 0.0;
+    if (dram_accesses)
+    {
+        meta_perc = 100.0 * (double)meta / (double)dram_accesses;
+    }
+    printf("%s_PF_META_READS  \t\t : %10llu\n", label, pf->stat_meta_reads);
+    printf("%s_PF_META_WRITES \t\t : %10llu\n", label, pf->stat_meta_writes);
+    printf("%s_PF_META_BYTES  \t\t : %10llu\n", label,
+           meta * (unsigned long long)CACHE_LINESIZE);
+    printf("%s_PF_META_DRAM_PERC\t\t : %10.3f\n", label, meta_perc);
+}
@@ -0,0 +1,344 @@
+// prefetch.h
+// Declares hardware prefetchers, which fetch lines into a cache before the
+// core asks for them, and the feedback that throttles them.
+//
+// A prefetcher watches the demand accesses to its cache and proposes lines
+// to fetch; the memory system drops the ones already in the cache and
+// installs the rest right away. Each prefetched line is tracked until its
+// first demand use, which makes the prefetch useful (and late, if the line
+// hadn't arrived yet), or its eviction, which makes it useless.
+//
+// The temporal prefetcher keeps its correlation table in DRAM, as a table
+// that large would be on a real chip. Each time it trains, it lists the
+// metadata lines it had to read from or write back to DRAM, and the memory
+// system makes those accesses along with its prefetches.
+
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include "types.h"
+#include "cache.h"
+#include "mshr.h"
+#include <zlib.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The kinds of prefetchers. */
+typedef enum PrefetcherTypeEnum
+{
+    PREFETCH_NONE = 0, // Don't prefetch.
+
+    /** On a miss or first use of a prefetched line, fetch the next lines. */
+    PREFETCH_NEXT_LINE = 1,
+
+    /**
+     * Fetch ahead along the stride of each load or store instruction, kept
+     * in a reference prediction table indexed by its address.
+     */
+    PREFETCH_IP_STRIDE = 2,
+
+    /**
+     * Follow several ascending or descending streams of misses at once,
+     * each confirmed by two misses in the same direction.
+     */
+    PREFETCH_STREAM = 3,
+
+    /**
+     * Remember which miss followed each miss in a correlation table kept
+     * in DRAM, and on a miss, prefetch the misses that followed it last
+     * time, for irregular streams such as pointer chasing.
+     */
+    PREFETCH_TEMPORAL = 4,
+} PrefetcherType;
+
+/** The largest degree and distance a prefetcher can be configured with. */
+#define PREFETCH_MAX_DEGREE 16
+#define PREFETCH_MAX_DISTANCE 64
+
+/**
+ * The most lines a prefetcher proposes at once: its configured degree at
+ * the most aggressive throttling level.
+ */
+#define PREFETCH_MAX_LINES (4 * PREFETCH_MAX_DEGREE)
+
+/**
+ * The most DRAM accesses to its metadata a temporal prefetcher can need
+ * for one trigger: a read and a writeback for each lookup along the chain
+ * of misses, at most as long as the degree plus the distance.
+ */
+#define PREFETCH_MAX_META \
+    (2 * (PREFETCH_MAX_LINES + 4 * PREFETCH_MAX_DISTANCE))
+
+/** The number of prefetches each prefetcher can have in flight. */
+#define PREFETCH_QUEUE_SIZE 32
+
+/** The counters of a feedback interval. */
+typedef enum PrefetchFeedbackEnum
+{
+    PREFETCH_FB_MISSES = 0,    // Demand misses.
+    PREFETCH_FB_ISSUED = 1,    // Prefetches made.
+    PREFETCH_FB_USEFUL = 2,    // Prefetched lines used.
+    PREFETCH_FB_LATE = 3,      // Prefetched lines used before they arrived.
+    PREFETCH_FB_POLLUTION = 4, // Demand misses on lines a prefetch evicted.
+    PREFETCH_FB_COUNTERS = 5,
+} PrefetchFeedback;
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** An entry of the reference prediction table of an IP-stride prefetcher. */
+typedef struct PrefetchRptEntry
+{
+    /* the address of the instruction, or 0 if the entry is unused */
+    uint64_t pc;
+
+    /* the line the instruction accessed last */
+    uint64_t last_line;
+
+    /* the stride between its last two lines, and how often it repeated */
+    int64_t stride;
+    unsigned int confidence;
+} PrefetchRptEntry;
+
+/** A stream followed by a stream prefetcher. */
+typedef struct PrefetchStream
+{
+    bool valid;
+
+    /* the line the stream missed on last */
+    uint64_t last_line;
+
+    /* the direction of the stream (1 or -1, or 0 until it is known) */
+    int direction;
+
+    /* the number of misses in a row in that direction */
+    unsigned int confidence;
+
+    /* when the stream was last used, to replace the least recently used */
+    uint64_t last_use;
+} PrefetchStream;
+
+/**
+ * An entry of the correlation table of a temporal prefetcher: a line that
+ * missed and the line that missed after it, both plus one (0 marks an
+ * unused entry).
+ */
+typedef struct PrefetchCorrelation
+{
+    uint64_t trigger;
+    uint64_t successor;
+} PrefetchCorrelation;
+
+/** An access a temporal prefetcher makes to its metadata in DRAM. */
+typedef struct PrefetchMetaAccess
+{
+    /* the address of the metadata line */
+    uint64_t line_addr;
+
+    bool is_write;
+
+    /* whether the prefetches wait for the line to be read */
+    bool blocking;
+} PrefetchMetaAccess;
+
+/** A prefetcher of one cache. */
+typedef struct Prefetcher
+{
+    PrefetcherType type;
+
+    /**
+     * The number of lines fetched for each trigger, and how many lines
+     * ahead of the triggering access the first of them is, at the middle
+     * throttling level.
+     */
+    unsigned int degree;
+    unsigned int distance;
+
+    /**
+     * Whether feedback throttling is on, and the throttling level, from 1
+     * (a quarter of the configured degree and distance) to 5 (four times
+     * them). Without feedback the level stays at 3.
+     */
+    bool throttle;
+    unsigned int level;
+
+    /* for PREFETCH_IP_STRIDE, the reference prediction table */
+    PrefetchRptEntry *rpt;
+
+    /* for PREFETCH_STREAM, the streams and a clock to age them */
+    PrefetchStream *streams;
+    uint64_t stream_clock;
+
+    /**
+     * For PREFETCH_TEMPORAL, the correlation table, the on-chip cache of its
+     * lines in DRAM, and the last line that missed plus one.
+     */
+    PrefetchCorrelation *table;
+    Cache *meta_cache;
+    uint64_t last_trigger;
+
+    /* the metadata accesses of the last call to prefetch_train() */
+    PrefetchMetaAccess meta[PREFETCH_MAX_META];
+    unsigned int num_meta;
+
+    /**
+     * The lines prefetched and not used or evicted since, as a hash set of
+     * line addresses plus one (0 marks an empty slot), with twice as many
+     * slots as the cache has lines.
+     */
+    uint64_t *unused;
+    uint64_t unused_mask;
+
+    /* the prefetches in flight, and the cycle the line of each arrives in */
+    MshrFile *queue;
+
+    /**
+     * A bit for each hash of a line address, set when a prefetch evicts a
+     * line, so that a later demand miss on the line counts as pollution.
+     */
+    uint8_t *pollution_filter;
+
+    /**
+     * The PREFETCH_FB_* counters of the current feedback interval, and their
+     * values averaged over the earlier intervals.
+     */
+    uint64_t interval[PREFETCH_FB_COUNTERS];
+    uint64_t history[PREFETCH_FB_COUNTERS];
+
+    /* the statistics of the prefetcher */
+    unsigned long long stat_issued;
+    unsigned long long stat_useful;
+    unsigned long long stat_late;
+    unsigned long long stat_useless;
+    unsigned long long stat_dropped;
+    unsigned long long stat_pollution;
+    unsigned long long stat_misses;
+    unsigned long long stat_meta_reads;
+    unsigned long long stat_meta_writes;
+} Prefetcher;
+
+///////////////////////////////////////////////////////////////////////////////
+//                            FUNCTION PROTOTYPES                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Allocate and initialize a prefetcher, or return NULL for PREFETCH_NONE.
+ *
+ * @param type The kind of prefetcher.
+ * @param degree The number of lines fetched for each trigger.
+ * @param distance How many lines ahead of the triggering access to start.
+ * @param throttle Whether to throttle the prefetcher by its feedback.
+ * @param cache_lines The number of lines in the cache it prefetches into.
+ * @return A pointer to the prefetcher, or NULL.
+ */
+Prefetcher *prefetch_new(PrefetcherType type, unsigned int degree,
+                         unsigned int distance, bool throttle,
+                         uint64_t cache_lines);
+
+/**
+ * Show a prefetcher a demand access to its cache, and find the lines it
+ * wants to prefetch in response.
+ *
+ * @param pf The prefetcher.
+ * @param pc The address of the instruction making the access.
+ * @param line_addr The address of the cache line accessed.
+ * @param trigger Whether the access missed or was the first use of a
+ *                prefetched line; only the IP-stride prefetcher also learns
+ *                from other hits.
+ * @param lines Where to store the lines to prefetch, PREFETCH_MAX_LINES at
+ *              most.
+ * @return The number of lines to prefetch. A temporal prefetcher also lists
+ *         the accesses to its metadata it needs in pf->meta.
+ */
+unsigned int prefetch_train(Prefetcher *pf, uint64_t pc, uint64_t line_addr,
+                            bool trigger, uint64_t *lines);
+
+/**
+ * Check whether a prefetcher has room for another prefetch in flight, and
+ * count the prefetch as dropped if it hasn't.
+ *
+ * @param pf The prefetcher.
+ * @param cycle The cycle the prefetch would be made in.
+ * @return Whether the prefetch can be made.
+ */
+bool prefetch_can_issue(Prefetcher *pf, uint64_t cycle);
+
+/**
+ * Record a prefetch that has been installed in the cache.
+ *
+ * @param pf The prefetcher.
+ * @param line_addr The address of the cache line prefetched.
+ * @param cycle The cycle the prefetch was made in.
+ * @param ready_cycle The cycle the line arrives in, or 0 if it isn't timed.
+ */
+void prefetch_issue(Prefetcher *pf, uint64_t line_addr, uint64_t cycle,
+                    uint64_t ready_cycle);
+
+/**
+ * Record a demand hit in a prefetcher's cache. If it is the first use of a
+ * prefetched line, the prefetch is useful, and late if the line is still in
+ * flight.
+ *
+ * @param pf The prefetcher.
+ * @param line_addr The address of the cache line hit.
+ * @param cycle The cycle the access is made in.
+ * @param ready_cycle Where to store the cycle the line arrives in if a
+ *                    prefetch of it is still in flight, or else 0.
+ * @return Whether the hit was the first use of a prefetched line.
+ */
+bool prefetch_hit(Prefetcher *pf, uint64_t line_addr, uint64_t cycle,
+                  uint64_t *ready_cycle);
+
+/**
+ * Record a demand miss in a prefetcher's cache, and with feedback, adjust
+ * the throttling level at the end of each interval.
+ *
+ * @param pf The prefetcher.
+ * @param line_addr The address of the cache line that missed.
+ */
+void prefetch_miss(Prefetcher *pf, uint64_t line_addr);
+
+/**
+ * Record the eviction of a line from a prefetcher's cache. A prefetched
+ * line evicted before its first use was a useless prefetch.
+ *
+ * @param pf The prefetcher.
+ * @param line_addr The address of the evicted line.
+ * @param by_prefetch Whether the line was evicted to install a prefetch.
+ */
+void prefetch_evict(Prefetcher *pf, uint64_t line_addr, bool by_prefetch);
+
+/**
+ * Save the state of a prefetcher to a checkpoint.
+ *
+ * @param pf The prefetcher.
+ * @param gz The checkpoint file.
+ * @return Whether the state was written.
+ */
+bool prefetch_save(Prefetcher *pf, gzFile gz);
+
+/**
+ * Restore the state of a prefetcher from a checkpoint. The prefetcher must
+ * have just been created with the same configuration as the one saved.
+ *
+ * @param pf The prefetcher.
+ * @param gz The checkpoint file.
+ * @return Whether the state was read in full.
+ */
+bool prefetch_load(Prefetcher *pf, gzFile gz);
+
+/**
+ * Print the statistics of a prefetcher.
+ *
+ * @param pf The prefetcher.
+ * @param label The label of its cache, e.g., "DCACHE_0".
+ * @param dram_accesses The number of DRAM accesses, to show what share of
+ *                      them went to the metadata of a temporal prefetcher.
+ */
+void prefetch_print_stats(Prefetcher *pf, const char *label,
+                          unsigned long long dram_accesses);
+
+#endif // __PREFETCH_H__
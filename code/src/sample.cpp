@@ -0,0 +1,426 @@
+// sample.cpp
+// Defines the functions for the sampling engine.
+//
+// Functional warming advances the clock by one cycle per round of
+// instructions, one from each core, so that replacement state still sees
+// the accesses in order. Those cycles are counted and left out of every
+// cycle count reported, and the cache and DRAM statistics they would have
+// added are rolled back, so the regular statistics cover exactly the
+// instructions simulated in detail.
+
+#include "sample.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The z-score of a two-sided 95% confidence interval. */
+#define SAMPLE_Z95 1.96
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The counters of the memory system and cores at some point in time. */
+typedef struct SampleSnapshot
+{
+    uint64_t cycle;
+    unsigned long long inst_count[CACHE_MAX_OWNERS];
+
+    unsigned long long cache_read_access[SAMPLE_MAX_CACHES];
+    unsigned long long cache_read_miss[SAMPLE_MAX_CACHES];
+    unsigned long long cache_write_access[SAMPLE_MAX_CACHES];
+    unsigned long long cache_write_miss[SAMPLE_MAX_CACHES];
+    unsigned long long cache_dirty_evicts[SAMPLE_MAX_CACHES];
+
+    unsigned long long dram_read_access;
+    uint64_t dram_read_delay;
+    unsigned long long dram_write_access;
+    uint64_t dram_write_delay;
+} SampleSnapshot;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  GLOBALS                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+extern uint64_t SAMPLE_PERIOD;
+extern uint64_t SAMPLE_WARMUP;
+extern uint64_t SAMPLE_WINDOW;
+extern Mode SIM_MODE;
+
+/** The current clock cycle number. */
+extern thread_local uint64_t current_cycle;
+
+static SampleStats sample_stats;
+
+///////////////////////////////////////////////////////////////////////////////
+//                           FUNCTION DEFINITIONS                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * List the caches of the memory system that are in use in this mode.
+ */
+static void sample_find_caches(MemorySystem *sys, unsigned int num_cores)
+{
+    SampleStats *s = &sample_stats;
+    s->num_caches = 0;
+
+    if (SIM_MODE == SIM_MODE_DEF)
+    {
+        for (unsigned int i = 0; i < num_cores; i++)
+        {
+            s->caches[s->num_caches] = sys->icache_coreid[i];
+            snprintf(s->labels[s->num_caches++], sizeof(s->labels[0]),
+                     "ICACHE_%u", i);
+            s->caches[s->num_caches] = sys->dcache_coreid[i];
+            snprintf(s->labels[s->num_caches++], sizeof(s->labels[0]),
+                     "DCACHE_%u", i);
+        }
+    }
+    else
+    {
+        s->caches[s->num_caches] = sys->icache;
+        strcpy(s->labels[s->num_caches++], "ICACHE");
+        s->caches[s->num_caches] = sys->dcache;
+        strcpy(s->labels[s->num_caches++], "DCACHE");
+    }
+
+    s->caches[s->num_caches] = sys->l2cache;
+    strcpy(s->labels[s->num_caches++], "L2CACHE");
+}
+
+/**
+ * Take a snapshot of the counters of the memory system and cores.
+ */
+static void sample_snapshot(SampleSnapshot *snap, MemorySystem *sys,
+                            Core **cores, unsigned int num_cores)
+{
+    snap->cycle = current_cycle + 1;
+    for (unsigned int i = 0; i < num_cores; i++)
+    {
+        snap->inst_count[i] = cores[i]->inst_count;
+    }
+
+    for (unsigned int i = 0; i < sample_stats.num_caches; i++)
+    {
+        Cache *c = sample_stats.caches[i];
+        snap->cache_read_access[i] = c->stat_read_access;
+        snap->cache_read_miss[i] = c->stat_read_miss;
+        snap->cache_write_access[i] = c->stat_write_access;
+        snap->cache_write_miss[i] = c->stat_write_miss;
+        snap->cache_dirty_evicts[i] = c->stat_dirty_evicts;
+    }
+
+    snap->dram_read_access = sys->dram->stat_read_access;
+    snap->dram_read_delay = sys->dram->stat_read_delay;
+    snap->dram_write_access = sys->dram->stat_write_access;
+    snap->dram_write_delay = sys->dram->stat_write_delay;
+}
+
+/**
+ * Roll the cache and DRAM statistics back to a snapshot.
+ */
+static void sample_restore(const SampleSnapshot *snap, MemorySystem *sys)
+{
+    for (unsigned int i = 0; i < sample_stats.num_caches; i++)
+    {
+        Cache *c = sample_stats.caches[i];
+        c->stat_read_access = snap->cache_read_access[i];
+        c->stat_read_miss = snap->cache_read_miss[i];
+        c->stat_write_access = snap->cache_write_access[i];
+        c->stat_write_miss = snap->cache_write_miss[i];
+        c->stat_dirty_evicts = snap->cache_dirty_evicts[i];
+    }
+
+    sys->dram->stat_read_access = snap->dram_read_access;
+    sys->dram->stat_read_delay = snap->dram_read_delay;
+    sys->dram->stat_write_access = snap->dram_write_access;
+    sys->dram->stat_write_delay = snap->dram_write_delay;
+}
+
+/**
+ * Add one window's value of a metric.
+ */
+static void sample_add(SampleMetric *m, double value)
+{
+    m->n++;
+    m->sum += value;
+    m->sum_sq += value * value;
+}
+
+/**
+ * Record the metrics of a window that started and ended with the given
+ * snapshots.
+ */
+static void sample_measure(const SampleSnapshot *start,
+                           const SampleSnapshot *end, Core **cores,
+                           unsigned int num_cores)
+{
+    SampleStats *s = &sample_stats;
+    uint64_t cycles = end->cycle - start->cycle;
+    s->stat_units++;
+
+    // A core that finished during the window idled through part of it.
+    for (unsigned int i = 0; i < num_cores; i++)
+    {
+        uint64_t inst = end->inst_count[i] - start->inst_count[i];
+        if (!cores[i]->done && inst)
+        {
+            sample_add(&s->cpi[i], (double)cycles / (double)inst);
+        }
+    }
+
+    for (unsigned int i = 0; i < s->num_caches; i++)
+    {
+        unsigned long long accesses =
+            (end->cache_read_access[i] - start->cache_read_access[i]) +
+            (end->cache_write_access[i] - start->cache_write_access[i]);
+        unsigned long long misses =
+            (end->cache_read_miss[i] - start->cache_read_miss[i]) +
+            (end->cache_write_miss[i] - start->cache_write_miss[i]);
+        if (accesses)
+        {
+            sample_add(&s->miss_perc[i],
+                       100.0 * (double)misses / (double)accesses);
+        }
+    }
+}
+
+/**
+ * Compute the mean of a metric and the half-width of its 95% confidence
+ * interval.
+ */
+static double sample_mean(const SampleMetric *m, double *ci95)
+{
+    *ci95 = 0.0;
+    if (!m->n)
+    {
+        return 0.0;
+    }
+
+    double mean = m->sum / m->n;
+    if (m->n > 1)
+    {
+        double var = (m->sum_sq - m->n * mean * mean) / (m->n - 1);
+        *ci95 = SAMPLE_Z95 * sqrt((var > 0) ? var : 0) / sqrt((double)m->n);
+    }
+    return mean;
+}
+
+/**
+ * Record that a core has just finished, leaving out the cycles fast-forwarded
+ * so far from its cycle count.
+ */
+static void sample_finish_core(Core *core)
+{
+    core->done_cycle_count -= sample_stats.stat_skipped_cycles;
+}
+
+/**
+ * Fast-forward each core to the given instruction, warming the caches and
+ * row buffers on the way.
+ *
+ * @param until The number of instructions, detailed and functional, each
+ *              core should have gone through afterwards.
+ */
+static void sample_warm(MemorySystem *sys, Core **cores,
+                        unsigned int num_cores, const uint64_t *until)
+{
+    SampleSnapshot before;
+    sample_snapshot(&before, sys, cores, num_cores);
+
+    bool warming = true;
+    while (warming)
+    {
+        warming = false;
+        for (unsigned int i = 0; i < num_cores; i++)
+        {
+            Core *core = cores[i];
+            if (core->done || core->fetch_done ||
+                sample_stats.stat_warm_inst[i] + core->inst_count >= until[i])
+            {
+                continue;
+            }
+
+            core_warm(core);
+            sample_stats.stat_warm_inst[i]++;
+            if (core->done)
+            {
+                sample_finish_core(core);
+            }
+            warming = true;
+        }
+
+        if (warming)
+        {
+            current_cycle++;
+            sample_stats.stat_skipped_cycles++;
+        }
+    }
+
+    sample_restore(&before, sys);
+}
+
+/**
+ * Simulate the cores in detail until each has executed SAMPLE_WARMUP
+ * instructions, and then measure them until each has executed another
+ * SAMPLE_WINDOW.
+ */
+static void sample_detail(MemorySystem *sys, Core **cores,
+                          unsigned int num_cores,
+                          void (*progress)(uint64_t cycle))
+{
+    uint64_t goal[CACHE_MAX_OWNERS];
+    for (unsigned int i = 0; i < num_cores; i++)
+    {
+        goal[i] = cores[i]->inst_count + SAMPLE_WARMUP;
+    }
+
+    SampleSnapshot start;
+    bool measuring = false;
+    while (true)
+    {
+        bool all_cores_done = true;
+        bool reached = true;
+        uint64_t next_cycle = UINT64_MAX;
+
+        for (unsigned int i = 0; i < num_cores; i++)
+        {
+            Core *core = cores[i];
+            bool was_done = core->done;
+            core_cycle(core);
+            if (core->done && !was_done)
+            {
+                sample_finish_core(core);
+            }
+
+            all_cores_done = all_cores_done && core->done;
+            reached = reached && (core->done || core->inst_count >= goal[i]);
+
+            uint64_t wake_cycle = core_next_cycle(core);
+            if (wake_cycle < next_cycle)
+            {
+                next_cycle = wake_cycle;
+            }
+        }
+        progress(current_cycle);
+
+        if (all_cores_done)
+        {
+            current_cycle++;
+            return;
+        }
+
+        if (reached && !measuring)
+        {
+            sample_snapshot(&start, sys, cores, num_cores);
+            for (unsigned int i = 0; i < num_cores; i++)
+            {
+                goal[i] = cores[i]->inst_count + SAMPLE_WINDOW;
+            }
+            measuring = true;
+        }
+        else if (reached)
+        {
+            SampleSnapshot end;
+            sample_snapshot(&end, sys, cores, num_cores);
+            sample_measure(&start, &end, cores, num_cores);
+
+            // Functional warming goes on from the next cycle; stalls still
+            // outstanding are dropped with the rest of the timing.
+            current_cycle++;
+            return;
+        }
+
+        current_cycle = next_cycle;
+    }
+}
+
+uint64_t sample_simulate(MemorySystem *sys, Core **cores,
+                         unsigned int num_cores,
+                         void (*progress)(uint64_t cycle))
+{
+    memset(&sample_stats, 0, sizeof(sample_stats));
+    sample_find_caches(sys, num_cores);
+
+    // Each unit starts with functional warming and ends with the detailed
+    // warmup and the window.
+    uint64_t unit_end = 0;
+    uint64_t until[CACHE_MAX_OWNERS];
+    while (true)
+    {
+        bool all_cores_done = true;
+        for (unsigned int i = 0; i < num_cores; i++)
+        {
+            all_cores_done = all_cores_done && cores[i]->done;
+        }
+        if (all_cores_done)
+        {
+            break;
+        }
+
+        unit_end += SAMPLE_PERIOD;
+        for (unsigned int i = 0; i < num_cores; i++)
+        {
+            until[i] = unit_end - SAMPLE_WARMUP - SAMPLE_WINDOW;
+        }
+        sample_warm(sys, cores, num_cores, until);
+        sample_detail(sys, cores, num_cores, progress);
+    }
+
+    uint64_t last_cycle = 0;
+    for (unsigned int i = 0; i < num_cores; i++)
+    {
+        if (cores[i]->done_cycle_count > last_cycle)
+        {
+            last_cycle = cores[i]->done_cycle_count;
+        }
+    }
+    return last_cycle + 1;
+}
+
+void sample_print_stats(Core **cores, unsigned int num_cores)
+{
+    SampleStats *s = &sample_stats;
+    char name[64];
+    double mean, ci95;
+
+    printf("\n");
+    printf("SAMPLE_UNITS           \t\t : %10llu\n", s->stat_units);
+    printf("SAMPLE_SKIPPED_CYCLES  \t\t : %10llu\n",
+           (unsigned long long)s->stat_skipped_cycles);
+
+    for (unsigned int i = 0; i < num_cores; i++)
+    {
+        unsigned long long inst = s->stat_warm_inst[i] + cores[i]->inst_count;
+        mean = sample_mean(&s->cpi[i], &ci95);
+
+        printf("\n");
+        snprintf(name, sizeof(name), "SAMPLE_CORE_%u_INST", i);
+        printf("%-23s\t\t : %10llu\n", name, inst);
+        snprintf(name, sizeof(name), "SAMPLE_CORE_%u_CPI", i);
+        printf("%-23s\t\t : %10.3f\n", name, mean);
+        snprintf(name, sizeof(name), "SAMPLE_CORE_%u_CPI_CI95", i);
+        printf("%-23s\t\t : %10.3f\n", name, ci95);
+        snprintf(name, sizeof(name), "SAMPLE_CORE_%u_IPC", i);
+        printf("%-23s\t\t : %10.3f\n", name, mean ? 1.0 / mean : 0.0);
+
+        // The whole run is estimated to take as long as all its
+        // instructions would at the mean CPI of the windows.
+        snprintf(name, sizeof(name), "SAMPLE_CORE_%u_CYCLES", i);
+        printf("%-23s\t\t : %10.0f\n", name, (double)inst * mean);
+    }
+
+    printf("\n");
+    for (unsigned int i = 0; i < s->num_caches; i++)
+    {
+        mean = sample_mean(&s->miss_perc[i], &ci95);
+        snprintf(name, sizeof(name), "SAMPLE_%s_MISS_PERC", s->labels[i]);
+        printf("%-23s\t\t : %10.3f\n", name, mean);
+        snprintf(name, sizeof(name), "SAMPLE_%s_MISS_CI95", s->labels[i]);
+        printf("%-23s\t\t : %10.3f\n", name, ci95);
+    }
+}
@@ -0,0 +1,97 @@
+// sample.h
+// Declares the sampling engine, which estimates the timing of a whole run
+// from short detailed windows spread evenly over it.
+//
+// Every core's trace is cut into sampling units of SAMPLE_PERIOD
+// instructions. Most of each unit is fast-forwarded functionally: the caches
+// and DRAM row buffers are updated as in a detailed simulation, but nothing
+// is timed and the cores never stall. The last SAMPLE_WARMUP + SAMPLE_WINDOW
+// instructions are simulated in detail, and the last SAMPLE_WINDOW of them
+// are measured. The CPI and miss rates of the measured windows are reported
+// with 95% confidence intervals.
+
+#ifndef __SAMPLE_H__
+#define __SAMPLE_H__
+
+#include "types.h"
+#include "core.h"
+#include "memsys.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The largest number of caches the sampling engine can measure. */
+#define SAMPLE_MAX_CACHES (2 * CACHE_MAX_OWNERS + 1)
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The values a metric took in each measured window. */
+typedef struct SampleMetric
+{
+    /* the number of windows that had a value */
+    unsigned long long n;
+
+    /* the sum of the values, and the sum of their squares */
+    double sum;
+    double sum_sq;
+} SampleMetric;
+
+/** The statistics of a sampled simulation. */
+typedef struct SampleStats
+{
+    /* the number of windows measured */
+    unsigned long long stat_units;
+
+    /* the number of cycles fast-forwarded, excluded from all cycle counts */
+    uint64_t stat_skipped_cycles;
+
+    /* the number of instructions each core fast-forwarded */
+    unsigned long long stat_warm_inst[CACHE_MAX_OWNERS];
+
+    /**
+     * The CPI of each core in each window. Cycles add up across windows and
+     * instructions don't, so the mean CPI, unlike the mean IPC, is an
+     * unbiased estimate of the CPI of the whole run.
+     */
+    SampleMetric cpi[CACHE_MAX_OWNERS];
+
+    /* the caches measured, with the labels they are printed with */
+    unsigned int num_caches;
+    Cache *caches[SAMPLE_MAX_CACHES];
+    char labels[SAMPLE_MAX_CACHES][32];
+
+    /* the miss rate of each cache in each window, in percent */
+    SampleMetric miss_perc[SAMPLE_MAX_CACHES];
+} SampleStats;
+
+///////////////////////////////////////////////////////////////////////////////
+//                            FUNCTION PROTOTYPES                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Simulate the cores until all of them are done, alternating functional
+ * warming with detailed windows. Afterwards, the cycle counts of the cores
+ * only count the cycles simulated in detail.
+ *
+ * @param sys The memory system the cores share.
+ * @param cores The cores to simulate.
+ * @param num_cores The number of cores.
+ * @param progress A function called now and then with the current cycle.
+ * @return The number of cycles simulated in detail.
+ */
+uint64_t sample_simulate(MemorySystem *sys, Core **cores,
+                         unsigned int num_cores,
+                         void (*progress)(uint64_t cycle));
+
+/**
+ * Print the estimates of the last sampled simulation.
+ *
+ * @param cores The cores that were simulated.
+ * @param num_cores The number of cores.
+ */
+void sample_print_stats(Core **cores, unsigned int num_cores);
+
+#endif // __SAMPLE_H__
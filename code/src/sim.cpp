@@ -9,13 +9,21 @@
 #include "types.h"
 #include "memsys.h"
 #include "core.h"
+#include "trace.h"
+#include "parallel.h"
+#include "sample.h"
+#include "checkpoint.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-#define MAX_CORES 2
+#define MAX_CORES 64
 #define PRINT_DOTS 1
 #define DOT_INTERVAL 100000
+#define MAX_SWEEP_LINE 4096
 
 /**
  * The current mode under which the simulation is running, corresponding to
@@ -35,6 +43,18 @@ uint64_t DCACHE_SIZE = 32 * 1024;
 /** The associativity of the data cache. */
 uint64_t DCACHE_ASSOC = 8;
 
+/**
+ * The largest dcache size covered by the stack-distance engine in bytes, or 0
+ * if the engine is disabled.
+ *
+ * In mode A, the engine reports LRU statistics for every power-of-two dcache
+ * size and associativity up to these limits in a single run.
+ */
+uint64_t STACKDIST_MAX_SIZE = 0;
+
+/** The largest dcache associativity covered by the stack-distance engine. */
+uint64_t STACKDIST_MAX_ASSOC = 16;
+
 /** The size of the instruction cache in bytes. */
 uint64_t ICACHE_SIZE = 32 * 1024;
 
@@ -60,18 +80,221 @@ ReplacementPolicy L2CACHE_REPL = LRU;
  */
 unsigned int SWP_CORE0_WAYS = 0;
 
+/**
+ * For dynamic way partitioning, the number of cycles between repartitions
+ * of the cache.
+ */
+uint64_t DWP_INTERVAL = 5000000;
+
+/**
+ * The number of MSHRs of each L1 cache in modes 2 to 4, or 0 for caches that
+ * block the core on every miss. With MSHRs, a core only stalls on a load
+ * when it uses the data, or when it runs out of MSHRs.
+ *
+ * An access to a line still on its way waits for it, even if a store miss
+ * fetched it; blocking caches treat store misses as done at once. So with
+ * -load_use_dist 1 and enough MSHRs, the timing is that of the blocking
+ * caches plus the waits of accesses that follow a store miss to its line.
+ */
+unsigned int MSHRS = 0;
+
+/** The number of MSHRs of the L2 cache, when the L1 caches have MSHRs. */
+unsigned int L2_MSHRS = 32;
+
+/**
+ * With MSHRs, how many instructions after a load the first use of its data
+ * comes. The traces don't record dependences, so every load gets the same.
+ */
+unsigned int LOAD_USE_DIST = 8;
+
+/**
+ * The prefetcher of each data cache in modes 2 to 4: none, next-line,
+ * IP-stride (indexed by the address of each load and store), or stream.
+ */
+PrefetcherType L1_PREFETCHER = PREFETCH_NONE;
+
+/**
+ * The number of lines the data cache prefetcher fetches at once, and how
+ * many lines ahead of the access it starts.
+ */
+unsigned int L1_PF_DEGREE = 2;
+unsigned int L1_PF_DISTANCE = 1;
+
+/**
+ * The prefetcher of the L2 cache in modes 2 to 4: none, next-line,
+ * IP-stride, a stream prefetcher following several miss streams, or a
+ * temporal prefetcher replaying the misses that followed each miss before,
+ * with its correlation table in DRAM.
+ */
+PrefetcherType L2_PREFETCHER = PREFETCH_NONE;
+
+/**
+ * The number of lines the L2 prefetcher fetches at once, and how many lines
+ * ahead of the access it starts.
+ */
+unsigned int L2_PF_DEGREE = 4;
+unsigned int L2_PF_DISTANCE = 4;
+
+/**
+ * Whether to throttle each prefetcher by feedback, moving its degree and
+ * distance up or down from the configured ones by its accuracy, lateness
+ * and the cache pollution it causes.
+ */
+bool PF_THROTTLE = false;
+
+/**
+ * The number of entries of the reorder buffer of each core in modes 2 to 4,
+ * or 0 for the in-order core. With a reorder buffer, instructions are
+ * dispatched and retired in order, ISSUE_WIDTH per cycle, and loads
+ * overlap their latencies as far as the MSHRs allow, so it needs them.
+ */
+unsigned int ROB_SIZE = 0;
+
+/** The number of instructions an out-of-order core dispatches per cycle. */
+unsigned int ISSUE_WIDTH = 4;
+
+/** The number of loads and stores an out-of-order core keeps in flight. */
+unsigned int LSQ_SIZE = 48;
+
+/** The execution latency of ALU instructions on an out-of-order core. */
+unsigned int ALU_LATENCY = 1;
+
+/**
+ * The execution latency of instructions that are neither ALU instructions
+ * nor loads or stores on an out-of-order core.
+ */
+unsigned int OTHER_LATENCY = 3;
+
+/**
+ * The size of the aligned blocks the cores fetch instructions in, in bytes,
+ * in modes 2 to 4, or 0 to fetch every instruction from the icache. With
+ * fetch blocks, the icache is only accessed when an instruction is outside
+ * the block fetched last.
+ */
+unsigned int FETCH_BLOCK = 0;
+
+/**
+ * With fetch blocks, the number of instructions the fetch buffer of an
+ * out-of-order core delivers per cycle.
+ */
+unsigned int FETCH_WIDTH = 4;
+
 /** The number of cores being simulated. */
 unsigned int NUM_CORES = 0;
 
 /** Which page policy the DRAM should use. */
 DRAMPolicy DRAM_PAGE_POLICY = OPEN_PAGE;
 
+/** How physical addresses map to DRAM banks and rows in parts C through F. */
+DRAMMapping DRAM_MAPPING = DRAM_MAP_ROW;
+
+/**
+ * Whether to count and print the accesses and row conflicts of each DRAM
+ * bank, to see how evenly the address mapping spreads them.
+ */
+bool DRAM_BANK_STATS = false;
+
+/**
+ * The number of DRAM channels in parts C through F. Each channel has a data
+ * bus and a request queue of its own.
+ */
+unsigned int DRAM_CHANNELS = 1;
+
+/** The number of ranks of each DRAM channel in parts C through F. */
+unsigned int DRAM_RANKS = 1;
+
+/** The number of banks of each DRAM rank in parts C through F. */
+unsigned int DRAM_BANKS = NUM_BANKS;
+
+/**
+ * The number of writes the write queue of each DRAM channel holds in parts C
+ * through F, or 0 for none. With a write queue, reads are issued ahead of
+ * writes, which are drained in bursts once the queue fills up.
+ */
+unsigned int DRAM_WQ_SIZE = 0;
+
+/**
+ * The write queue length at which a DRAM channel starts draining writes, or
+ * DRAM_WQ_AUTO for 3/4 of the queue.
+ */
+unsigned int DRAM_WQ_HIGH = DRAM_WQ_AUTO;
+
+/**
+ * The write queue length at which a DRAM channel stops draining writes, or
+ * DRAM_WQ_AUTO for 1/4 of the queue.
+ */
+unsigned int DRAM_WQ_LOW = DRAM_WQ_AUTO;
+
+/**
+ * How the DRAM controller schedules requests in parts C through F. With the
+ * fixed model, every access takes the latency of its row-buffer state;
+ * otherwise requests queue for busy banks and the data bus.
+ */
+DRAMScheduler DRAM_SCHEDULER = DRAM_SCHED_FIXED;
+
+/**
+ * A file listing the configurations to simulate in sweep mode, one line of
+ * options per configuration, or NULL to simulate a single configuration.
+ */
+const char *SWEEP_FILENAME = NULL;
+
+/**
+ * The number of instructions to skip at the start of each trace, e.g., to
+ * simulate only a late region of interest.
+ */
+uint64_t SKIP_INST = 0;
+
+/**
+ * The engine to simulate the cores with in mode D, E, or F. Each core can be
+ * simulated on a thread of its own, either with results identical to the
+ * sequential engine or with cross-core timing synchronized every quantum.
+ */
+ParallelMode PARALLEL_MODE = PARALLEL_NONE;
+
+/** For the relaxed parallel engine, the number of cycles in a quantum. */
+uint64_t PARALLEL_QUANTUM = 1000;
+
+/**
+ * For sampled simulation, the number of instructions of each core in a
+ * sampling unit, or 0 to simulate every instruction in detail.
+ */
+uint64_t SAMPLE_PERIOD = 0;
+
+/**
+ * For sampled simulation, the number of instructions at the end of each unit
+ * that are measured.
+ */
+uint64_t SAMPLE_WINDOW = 1000;
+
+/**
+ * For sampled simulation, the number of instructions simulated in detail
+ * before each window, to bring the timing state up to date.
+ */
+uint64_t SAMPLE_WARMUP = 2000;
+
+/**
+ * A file to save a checkpoint of the simulation to once every core has
+ * executed CHECKPOINT_INST instructions, or NULL not to save one. The
+ * simulation stops after saving it.
+ */
+const char *SAVE_CHECKPOINT_FILENAME = NULL;
+
+/** The number of instructions of each core to simulate before a checkpoint. */
+uint64_t CHECKPOINT_INST = 0;
+
+/**
+ * A checkpoint file to restore the simulation from before it starts, or NULL
+ * to start from the beginning of the traces.
+ */
+const char *LOAD_CHECKPOINT_FILENAME = NULL;
+
 /**
  * The current clock cycle number.
  * 
  * This can be used as a timestamp for implementing the LRU replacement policy.
+ * Each thread of the parallel engine has a clock of its own.
  */
-uint64_t current_cycle;
+thread_local uint64_t current_cycle;
 
 MemorySystem *memsys;
 Core *core[MAX_CORES];
@@ -79,7 +302,13 @@ const char *trace_filename[MAX_CORES];
 uint64_t last_printdot_cycle;
 
 int parse_args(int argc, char **argv);
-void print_dots();
+int simulate(TraceReader **trace, Checkpoint *ck);
+int run_sweep(const char *program_name);
+int run_sweep_config(const char *program_name, char *line,
+                     TraceBroadcast *bc, unsigned int config);
+bool checkpoint_due();
+void print_dots(uint64_t cycle);
+void print_dots_until(uint64_t cycle);
 void print_stats();
 void print_usage(const char *program_name);
 
@@ -91,39 +320,332 @@ int main(int argc, char **argv)
         return status;
     }
 
+    if (SWEEP_FILENAME)
+    {
+        return run_sweep(argv[0]);
+    }
+
+    Checkpoint *ck = NULL;
+    if (LOAD_CHECKPOINT_FILENAME)
+    {
+        ck = checkpoint_open(LOAD_CHECKPOINT_FILENAME);
+        if (!ck)
+        {
+            return 1;
+        }
+    }
+
+    TraceReader *trace[MAX_CORES];
+    for (unsigned int i = 0; i < NUM_CORES; i++)
+    {
+        uint64_t start = ck ? checkpoint_trace_start(ck, i) : SKIP_INST;
+        trace[i] = trace_open_at(trace_filename[i], start);
+        if (!trace[i])
+        {
+            return 1;
+        }
+    }
+
+    return simulate(trace, ck);
+}
+
+/**
+ * Simulate the cores on the given traces, starting from a checkpoint if one
+ * is given.
+ */
+int simulate(TraceReader **trace, Checkpoint *ck)
+{
     srand(42);
     memsys = memsys_new();
     for (unsigned int i = 0; i < NUM_CORES; i++)
     {
-        core[i] = core_new(memsys, trace_filename[i], i);
+        core[i] = core_new(memsys, trace[i], i);
+    }
+
+    if (ck)
+    {
+        if (!checkpoint_restore(ck, memsys, core))
+        {
+            return 1;
+        }
+        last_printdot_cycle = current_cycle - current_cycle % DOT_INTERVAL;
+    }
+    else
+    {
+        print_dots(current_cycle);
+    }
+
+    if (SAMPLE_PERIOD)
+    {
+        uint64_t detailed_cycles = sample_simulate(memsys, core, NUM_CORES,
+                                                   print_dots_until);
+        print_dots_until(current_cycle - 1);
+        current_cycle = detailed_cycles;
+        print_stats();
+        return 0;
     }
 
-    print_dots();
+    if (PARALLEL_MODE != PARALLEL_NONE)
+    {
+        current_cycle = parallel_simulate(memsys, core, NUM_CORES,
+                                          print_dots_until);
+        print_dots_until(current_cycle - 1);
+        memsys_merge_core_stats(memsys);
+        print_stats();
+        return 0;
+    }
 
     // Iterate until all cores are done.
     bool all_cores_done = false;
     while (!all_cores_done)
     {
         all_cores_done = true;
+        uint64_t next_cycle = UINT64_MAX;
 
         for (unsigned int i = 0; i < NUM_CORES; i++)
         {
             core_cycle(core[i]);
             all_cores_done = all_cores_done && core[i]->done;
+
+            uint64_t wake_cycle = core_next_cycle(core[i]);
+            if (wake_cycle < next_cycle)
+            {
+                next_cycle = wake_cycle;
+            }
         }
 
-        if (current_cycle - last_printdot_cycle >= DOT_INTERVAL)
+        // Cycles skipped below are caught up here, so the dots come out the
+        // same as if every cycle had been simulated.
+        print_dots_until(current_cycle);
+
+        // Jump straight to the earliest cycle in which some core has work to
+        // do. Cycles in between would only find every core snoozing.
+        if (all_cores_done)
+        {
+            current_cycle++;
+        }
+        else
         {
-            print_dots();
+            current_cycle = next_cycle;
         }
 
-        current_cycle++;
+        if (SAVE_CHECKPOINT_FILENAME && !all_cores_done &&
+            checkpoint_due())
+        {
+            if (!checkpoint_save(SAVE_CHECKPOINT_FILENAME, memsys, core,
+                                 NUM_CORES))
+            {
+                return 1;
+            }
+            print_stats();
+            return 0;
+        }
     }
 
     print_stats();
     return 0;
 }
 
+/**
+ * Simulate every configuration listed in the sweep file on the traces given
+ * on the command line.
+ *
+ * Each configuration runs in its own worker process, since the simulator's
+ * configuration lives in globals, while every trace is decoded only once and
+ * broadcast to all workers through shared memory. The stats block of each
+ * configuration is printed in the order the configurations are listed.
+ */
+int run_sweep(const char *program_name)
+{
+    FILE *sweep_file = fopen(SWEEP_FILENAME, "r");
+    if (!sweep_file)
+    {
+        perror("Couldn't open sweep file");
+        return 1;
+    }
+
+    // Each non-blank line that isn't a comment is one configuration.
+    char *config_line[TRACE_BROADCAST_MAX_CONSUMERS];
+    unsigned int num_configs = 0;
+    char line[MAX_SWEEP_LINE];
+    while (fgets(line, sizeof(line), sweep_file))
+    {
+        line[strcspn(line, "#\r\n")] = '\0';
+        if (line[strspn(line, " \t")] == '\0')
+        {
+            continue;
+        }
+
+        if (num_configs >= TRACE_BROADCAST_MAX_CONSUMERS)
+        {
+            fprintf(stderr, "Error: too many configurations in sweep file "
+                            "(maximum %d)\n", TRACE_BROADCAST_MAX_CONSUMERS);
+            fclose(sweep_file);
+            return 2;
+        }
+        config_line[num_configs++] = strdup(line);
+    }
+    fclose(sweep_file);
+
+    if (num_configs == 0)
+    {
+        fprintf(stderr, "Error: no configurations in sweep file\n");
+        return 2;
+    }
+
+    TraceBroadcast *bc = trace_broadcast_new(NUM_CORES, trace_filename,
+                                             num_configs, SKIP_INST);
+    if (!bc)
+    {
+        return 1;
+    }
+
+    // Fork the workers before starting any decoder threads.
+    FILE *config_output[TRACE_BROADCAST_MAX_CONSUMERS];
+    pid_t config_pid[TRACE_BROADCAST_MAX_CONSUMERS];
+    int config_status[TRACE_BROADCAST_MAX_CONSUMERS];
+    fflush(stdout);
+    for (unsigned int c = 0; c < num_configs; c++)
+    {
+        config_output[c] = tmpfile();
+        if (!config_output[c])
+        {
+            perror("Couldn't create sweep output file");
+            return 1;
+        }
+
+        config_pid[c] = fork();
+        if (config_pid[c] == -1)
+        {
+            perror("Couldn't fork");
+            return 1;
+        }
+
+        if (config_pid[c] == 0)
+        {
+            // Worker process: simulate this configuration into its output
+            // file.
+            setpgid(0, c == 0 ? 0 : config_pid[0]);
+            dup2(fileno(config_output[c]), STDOUT_FILENO);
+            int status = run_sweep_config(program_name, config_line[c], bc,
+                                          c);
+            fflush(stdout);
+            _exit(status);
+        }
+
+        // The workers share a process group, so that waiting for them can't
+        // reap any other child of this process.
+        setpgid(config_pid[c], config_pid[0]);
+    }
+
+    if (!trace_broadcast_start(bc))
+    {
+        return 1;
+    }
+
+    // A worker that exits early must not hold up the decoders.
+    for (unsigned int left = num_configs; left > 0; left--)
+    {
+        int status;
+        pid_t pid = waitpid(-config_pid[0], &status, 0);
+        if (pid == -1)
+        {
+            perror("Couldn't wait for sweep worker");
+            return 1;
+        }
+
+        for (unsigned int c = 0; c < num_configs; c++)
+        {
+            if (config_pid[c] == pid)
+            {
+                config_status[c] = status;
+                trace_broadcast_detach(bc, c);
+            }
+        }
+    }
+    trace_broadcast_join(bc);
+
+    int sweep_status = 0;
+    for (unsigned int c = 0; c < num_configs; c++)
+    {
+        printf("\n");
+        printf("SWEEP_CONFIG        \t\t : %u\n", c);
+        printf("SWEEP_OPTIONS       \t\t : %s\n", config_line[c]);
+
+        char buf[4096];
+        size_t n;
+        rewind(config_output[c]);
+        while ((n = fread(buf, 1, sizeof(buf), config_output[c])) > 0)
+        {
+            fwrite(buf, 1, n, stdout);
+        }
+        fclose(config_output[c]);
+        printf("\n");
+
+        if (!WIFEXITED(config_status[c]) ||
+            WEXITSTATUS(config_status[c]) != 0)
+        {
+            fprintf(stderr, "Error: sweep configuration %u failed: %s\n", c,
+                    config_line[c]);
+            sweep_status = 1;
+        }
+        free(config_line[c]);
+    }
+
+    return sweep_status;
+}
+
+/**
+ * In a sweep worker process, apply one configuration line on top of the
+ * command line options and simulate it on the broadcast traces.
+ */
+int run_sweep_config(const char *program_name, char *line,
+                     TraceBroadcast *bc, unsigned int config)
+{
+    char *config_argv[MAX_SWEEP_LINE / 2 + 2];
+    int config_argc = 0;
+    config_argv[config_argc++] = (char *)program_name;
+    for (char *arg = strtok(line, " \t"); arg; arg = strtok(NULL, " \t"))
+    {
+        config_argv[config_argc++] = arg;
+    }
+    config_argv[config_argc] = NULL;
+
+    unsigned int num_traces = NUM_CORES;
+    uint64_t skip_inst = SKIP_INST;
+    int status = parse_args(config_argc, config_argv);
+    if (status != 0)
+    {
+        return status;
+    }
+
+    if (SKIP_INST != skip_inst)
+    {
+        fprintf(stderr, "Error: -skip_inst can't be given in a sweep "
+                        "configuration\n");
+        return 2;
+    }
+
+    if (NUM_CORES != num_traces)
+    {
+        fprintf(stderr, "Error: trace files can't be given in a sweep "
+                        "configuration\n");
+        return 2;
+    }
+
+    TraceReader *trace[MAX_CORES];
+    for (unsigned int i = 0; i < NUM_CORES; i++)
+    {
+        trace[i] = trace_open_broadcast(bc, i, config);
+        if (!trace[i])
+        {
+            return 1;
+        }
+    }
+
+    return simulate(trace, NULL);
+}
+
 int parse_args(int argc, char **argv)
 {
     if (argc < 2)
@@ -191,9 +713,9 @@ int parse_args(int argc, char **argv)
                 }
 
                 int repl = atoi(argv[i]);
-                if (repl < 0 || repl > 3)
+                if (repl < 0 || repl > 5)
                 {
-                    fprintf(stderr, "Error: repl must be between 0 and 3\n");
+                    fprintf(stderr, "Error: repl must be between 0 and 5\n");
                     return 2;
                 }
 
@@ -220,6 +742,36 @@ int parse_args(int argc, char **argv)
                 DCACHE_ASSOC = atoi(argv[i]);
             }
 
+            else if (strcasecmp(argv[i], "-SD_maxKB") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -SD_maxKB\n");
+                    return 2;
+                }
+                STACKDIST_MAX_SIZE = atoi(argv[i]) * 1024;
+            }
+
+            else if (strcasecmp(argv[i], "-SD_maxassoc") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-SD_maxassoc\n");
+                    return 2;
+                }
+
+                int sd_maxassoc = atoi(argv[i]);
+                if (sd_maxassoc < 1 || sd_maxassoc > 128)
+                {
+                    fprintf(stderr, "Error: SD_maxassoc must be between 1 and "
+                                    "128\n");
+                    return 2;
+                }
+
+                STACKDIST_MAX_ASSOC = sd_maxassoc;
+            }
+
             else if (strcasecmp(argv[i], "-L2sizeKB") == 0)
             {
                 if (++i >= argc)
@@ -239,48 +791,610 @@ int parse_args(int argc, char **argv)
                 }
 
                 int l2repl = atoi(argv[i]);
-                if (l2repl < 0 || l2repl > 3)
+                if (l2repl < 0 || l2repl > 5)
                 {
-                    fprintf(stderr, "Error: L2repl must be between 0 and 3\n");
+                    fprintf(stderr, "Error: L2repl must be between 0 and 5\n");
                     return 2;
                 }
 
                 L2CACHE_REPL = (ReplacementPolicy)l2repl;
             }
 
-            else if (strcasecmp(argv[i], "-SWP_core0ways") == 0)
+            else if (strcasecmp(argv[i], "-mshrs") == 0)
             {
                 if (++i >= argc)
                 {
-                    fprintf(stderr, "Error: missing argument to "
-                                    "-SWP_core0ways\n");
+                    fprintf(stderr, "Error: missing argument to -mshrs\n");
+                    return 2;
+                }
+                MSHRS = atoi(argv[i]);
+                if (MSHRS > MSHR_MAX)
+                {
+                    fprintf(stderr, "Error: mshrs must be at most %d\n",
+                            MSHR_MAX);
                     return 2;
                 }
-                SWP_CORE0_WAYS = atoi(argv[i]);
             }
 
-            else if (strcasecmp(argv[i], "-dram_policy") == 0)
+            else if (strcasecmp(argv[i], "-L2mshrs") == 0)
             {
                 if (++i >= argc)
                 {
-                    fprintf(stderr, "Error: missing argument to "
-                                    "-dram_policy\n");
+                    fprintf(stderr, "Error: missing argument to -L2mshrs\n");
                     return 2;
                 }
-
-                int dram_policy = atoi(argv[i]);
-                if (dram_policy < 0 || dram_policy > 1)
+                L2_MSHRS = atoi(argv[i]);
+                if (L2_MSHRS == 0 || L2_MSHRS > MSHR_MAX)
                 {
-                    fprintf(stderr, "Error: dram_policy must be between 0 and 1\n");
+                    fprintf(stderr, "Error: L2mshrs must be between 1 and "
+                                    "%d\n",
+                            MSHR_MAX);
                     return 2;
                 }
-
-                DRAM_PAGE_POLICY = (DRAMPolicy)dram_policy;
             }
 
-            else
+            else if (strcasecmp(argv[i], "-load_use_dist") == 0)
             {
-                fprintf(stderr, "Error: unrecognized option: %s\n", argv[i]);
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-load_use_dist\n");
+                    return 2;
+                }
+                LOAD_USE_DIST = atoi(argv[i]);
+                if (LOAD_USE_DIST == 0)
+                {
+                    fprintf(stderr, "Error: load_use_dist must be at least "
+                                    "1\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-L1pf") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -L1pf\n");
+                    return 2;
+                }
+
+                int pf = atoi(argv[i]);
+                if (pf < PREFETCH_NONE || pf > PREFETCH_STREAM)
+                {
+                    fprintf(stderr, "Error: L1pf must be between 0 and "
+                                    "3\n");
+                    return 2;
+                }
+
+                L1_PREFETCHER = (PrefetcherType)pf;
+            }
+
+            else if (strcasecmp(argv[i], "-L1pf_degree") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-L1pf_degree\n");
+                    return 2;
+                }
+                L1_PF_DEGREE = atoi(argv[i]);
+                if (L1_PF_DEGREE == 0 || L1_PF_DEGREE > PREFETCH_MAX_DEGREE)
+                {
+                    fprintf(stderr, "Error: L1pf_degree must be between 1 "
+                                    "and %d\n",
+                            PREFETCH_MAX_DEGREE);
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-L1pf_dist") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-L1pf_dist\n");
+                    return 2;
+                }
+                L1_PF_DISTANCE = atoi(argv[i]);
+                if (L1_PF_DISTANCE == 0 ||
+                    L1_PF_DISTANCE > PREFETCH_MAX_DISTANCE)
+                {
+                    fprintf(stderr, "Error: L1pf_dist must be between 1 "
+                                    "and %d\n",
+                            PREFETCH_MAX_DISTANCE);
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-L2pf") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -L2pf\n");
+                    return 2;
+                }
+
+                int pf = atoi(argv[i]);
+                if (pf < PREFETCH_NONE || pf > PREFETCH_TEMPORAL)
+                {
+                    fprintf(stderr, "Error: L2pf must be between 0 and "
+                                    "4\n");
+                    return 2;
+                }
+
+                L2_PREFETCHER = (PrefetcherType)pf;
+            }
+
+            else if (strcasecmp(argv[i], "-L2pf_degree") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-L2pf_degree\n");
+                    return 2;
+                }
+                L2_PF_DEGREE = atoi(argv[i]);
+                if (L2_PF_DEGREE == 0 || L2_PF_DEGREE > PREFETCH_MAX_DEGREE)
+                {
+                    fprintf(stderr, "Error: L2pf_degree must be between 1 "
+                                    "and %d\n",
+                            PREFETCH_MAX_DEGREE);
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-L2pf_dist") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-L2pf_dist\n");
+                    return 2;
+                }
+                L2_PF_DISTANCE = atoi(argv[i]);
+                if (L2_PF_DISTANCE == 0 ||
+                    L2_PF_DISTANCE > PREFETCH_MAX_DISTANCE)
+                {
+                    fprintf(stderr, "Error: L2pf_dist must be between 1 "
+                                    "and %d\n",
+                            PREFETCH_MAX_DISTANCE);
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-pf_throttle") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-pf_throttle\n");
+                    return 2;
+                }
+                PF_THROTTLE = atoi(argv[i]) != 0;
+            }
+
+            else if (strcasecmp(argv[i], "-rob") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -rob\n");
+                    return 2;
+                }
+                ROB_SIZE = atoi(argv[i]);
+            }
+
+            else if (strcasecmp(argv[i], "-issue_width") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-issue_width\n");
+                    return 2;
+                }
+                ISSUE_WIDTH = atoi(argv[i]);
+                if (ISSUE_WIDTH == 0)
+                {
+                    fprintf(stderr, "Error: issue_width must be at least "
+                                    "1\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-lsq") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -lsq\n");
+                    return 2;
+                }
+                LSQ_SIZE = atoi(argv[i]);
+                if (LSQ_SIZE == 0)
+                {
+                    fprintf(stderr, "Error: lsq must be at least 1\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-alu_lat") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -alu_lat\n");
+                    return 2;
+                }
+                ALU_LATENCY = atoi(argv[i]);
+                if (ALU_LATENCY == 0)
+                {
+                    fprintf(stderr, "Error: alu_lat must be at least 1\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-other_lat") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-other_lat\n");
+                    return 2;
+                }
+                OTHER_LATENCY = atoi(argv[i]);
+                if (OTHER_LATENCY == 0)
+                {
+                    fprintf(stderr, "Error: other_lat must be at least 1\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-fetch_block") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-fetch_block\n");
+                    return 2;
+                }
+                FETCH_BLOCK = atoi(argv[i]);
+                if ((FETCH_BLOCK & (FETCH_BLOCK - 1)) != 0)
+                {
+                    fprintf(stderr, "Error: fetch_block must be a power of "
+                                    "two\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-fetch_width") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-fetch_width\n");
+                    return 2;
+                }
+                FETCH_WIDTH = atoi(argv[i]);
+                if (FETCH_WIDTH == 0)
+                {
+                    fprintf(stderr, "Error: fetch_width must be at least "
+                                    "1\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-SWP_core0ways") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-SWP_core0ways\n");
+                    return 2;
+                }
+                SWP_CORE0_WAYS = atoi(argv[i]);
+            }
+
+            else if (strcasecmp(argv[i], "-DWP_interval") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-DWP_interval\n");
+                    return 2;
+                }
+
+                DWP_INTERVAL = strtoull(argv[i], NULL, 10);
+                if (DWP_INTERVAL == 0)
+                {
+                    fprintf(stderr, "Error: DWP_interval must be positive\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-parallel") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -parallel\n");
+                    return 2;
+                }
+
+                int parallel_mode = atoi(argv[i]);
+                if (parallel_mode < PARALLEL_NONE ||
+                    parallel_mode > PARALLEL_RELAXED)
+                {
+                    fprintf(stderr, "Error: invalid parallel mode: %s\n",
+                            argv[i]);
+                    return 2;
+                }
+
+                PARALLEL_MODE = (ParallelMode)parallel_mode;
+            }
+
+            else if (strcasecmp(argv[i], "-quantum") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -quantum\n");
+                    return 2;
+                }
+
+                PARALLEL_QUANTUM = strtoull(argv[i], NULL, 10);
+                if (PARALLEL_QUANTUM == 0)
+                {
+                    fprintf(stderr, "Error: quantum must be positive\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-sample_period") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-sample_period\n");
+                    return 2;
+                }
+                SAMPLE_PERIOD = strtoull(argv[i], NULL, 10);
+            }
+
+            else if (strcasecmp(argv[i], "-sample_window") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-sample_window\n");
+                    return 2;
+                }
+
+                SAMPLE_WINDOW = strtoull(argv[i], NULL, 10);
+                if (SAMPLE_WINDOW == 0)
+                {
+                    fprintf(stderr, "Error: sample_window must be "
+                                    "positive\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-sample_warmup") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-sample_warmup\n");
+                    return 2;
+                }
+                SAMPLE_WARMUP = strtoull(argv[i], NULL, 10);
+            }
+
+            else if (strcasecmp(argv[i], "-save_checkpoint") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-save_checkpoint\n");
+                    return 2;
+                }
+                SAVE_CHECKPOINT_FILENAME = argv[i];
+            }
+
+            else if (strcasecmp(argv[i], "-checkpoint_inst") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-checkpoint_inst\n");
+                    return 2;
+                }
+                CHECKPOINT_INST = strtoull(argv[i], NULL, 10);
+            }
+
+            else if (strcasecmp(argv[i], "-load_checkpoint") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-load_checkpoint\n");
+                    return 2;
+                }
+                LOAD_CHECKPOINT_FILENAME = argv[i];
+            }
+
+            else if (strcasecmp(argv[i], "-dram_policy") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-dram_policy\n");
+                    return 2;
+                }
+
+                int dram_policy = atoi(argv[i]);
+                if (dram_policy < 0 || dram_policy > 1)
+                {
+                    fprintf(stderr, "Error: dram_policy must be between 0 and 1\n");
+                    return 2;
+                }
+
+                DRAM_PAGE_POLICY = (DRAMPolicy)dram_policy;
+            }
+
+            else if (strcasecmp(argv[i], "-dram_sched") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-dram_sched\n");
+                    return 2;
+                }
+
+                int dram_sched = atoi(argv[i]);
+                if (dram_sched < 0 || dram_sched > 2)
+                {
+                    fprintf(stderr, "Error: dram_sched must be between 0 and "
+                                    "2\n");
+                    return 2;
+                }
+
+                DRAM_SCHEDULER = (DRAMScheduler)dram_sched;
+            }
+
+            else if (strcasecmp(argv[i], "-dram_map") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -dram_map\n");
+                    return 2;
+                }
+
+                int dram_map = atoi(argv[i]);
+                if (dram_map < 0 || dram_map > 2)
+                {
+                    fprintf(stderr, "Error: dram_map must be between 0 and "
+                                    "2\n");
+                    return 2;
+                }
+
+                DRAM_MAPPING = (DRAMMapping)dram_map;
+            }
+
+            else if (strcasecmp(argv[i], "-dram_bank_stats") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-dram_bank_stats\n");
+                    return 2;
+                }
+                DRAM_BANK_STATS = atoi(argv[i]) != 0;
+            }
+
+            else if (strcasecmp(argv[i], "-dram_channels") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-dram_channels\n");
+                    return 2;
+                }
+
+                DRAM_CHANNELS = atoi(argv[i]);
+                if (DRAM_CHANNELS == 0 || (DRAM_CHANNELS & (DRAM_CHANNELS - 1)) != 0)
+                {
+                    fprintf(stderr, "Error: dram_channels must be a power of "
+                                    "two\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-dram_ranks") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-dram_ranks\n");
+                    return 2;
+                }
+
+                DRAM_RANKS = atoi(argv[i]);
+                if (DRAM_RANKS == 0 || (DRAM_RANKS & (DRAM_RANKS - 1)) != 0)
+                {
+                    fprintf(stderr, "Error: dram_ranks must be a power of "
+                                    "two\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-dram_banks") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-dram_banks\n");
+                    return 2;
+                }
+
+                DRAM_BANKS = atoi(argv[i]);
+                if (DRAM_BANKS == 0 || (DRAM_BANKS & (DRAM_BANKS - 1)) != 0)
+                {
+                    fprintf(stderr, "Error: dram_banks must be a power of "
+                                    "two\n");
+                    return 2;
+                }
+            }
+
+            else if (strcasecmp(argv[i], "-dram_wq") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -dram_wq\n");
+                    return 2;
+                }
+                DRAM_WQ_SIZE = atoi(argv[i]);
+            }
+
+            else if (strcasecmp(argv[i], "-dram_wq_high") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-dram_wq_high\n");
+                    return 2;
+                }
+                DRAM_WQ_HIGH = atoi(argv[i]);
+            }
+
+            else if (strcasecmp(argv[i], "-dram_wq_low") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to "
+                                    "-dram_wq_low\n");
+                    return 2;
+                }
+                DRAM_WQ_LOW = atoi(argv[i]);
+            }
+
+            else if (strcasecmp(argv[i], "-skip_inst") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -skip_inst\n");
+                    return 2;
+                }
+                SKIP_INST = strtoull(argv[i], NULL, 10);
+            }
+
+            else if (strcasecmp(argv[i], "-sweep") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -sweep\n");
+                    return 2;
+                }
+                SWEEP_FILENAME = argv[i];
+            }
+
+            else
+            {
+                fprintf(stderr, "Error: unrecognized option: %s\n", argv[i]);
                 return 2;
             }
         }
@@ -304,26 +1418,221 @@ int parse_args(int argc, char **argv)
         return 2;
     }
 
+    if (STACKDIST_MAX_SIZE && SIM_MODE != SIM_MODE_A)
+    {
+        fprintf(stderr, "Error: -SD_maxKB is only supported in mode 1\n");
+        return 2;
+    }
+
+    if (DRAM_SCHEDULER != DRAM_SCHED_FIXED && SIM_MODE != SIM_MODE_C &&
+        SIM_MODE != SIM_MODE_DEF)
+    {
+        fprintf(stderr, "Error: -dram_sched is only supported in modes 3 "
+                        "and 4\n");
+        return 2;
+    }
+
+    if ((DRAM_MAPPING != DRAM_MAP_ROW || DRAM_BANK_STATS) &&
+        SIM_MODE != SIM_MODE_C && SIM_MODE != SIM_MODE_DEF)
+    {
+        fprintf(stderr, "Error: -dram_map and -dram_bank_stats are only "
+                        "supported in modes 3 and 4\n");
+        return 2;
+    }
+
+    if ((DRAM_CHANNELS != 1 || DRAM_RANKS != 1 || DRAM_BANKS != NUM_BANKS) &&
+        SIM_MODE != SIM_MODE_C && SIM_MODE != SIM_MODE_DEF)
+    {
+        fprintf(stderr, "Error: -dram_channels, -dram_ranks, and -dram_banks "
+                        "are only supported in modes 3 and 4\n");
+        return 2;
+    }
+
+    if (DRAM_WQ_SIZE)
+    {
+        if (DRAM_SCHEDULER == DRAM_SCHED_FIXED)
+        {
+            fprintf(stderr, "Error: -dram_wq requires -dram_sched 1 or 2\n");
+            return 2;
+        }
+        unsigned int high, low;
+        dram_wq_watermarks(&high, &low);
+        if (low >= high || high > DRAM_WQ_SIZE)
+        {
+            fprintf(stderr, "Error: the DRAM write queue watermarks must "
+                            "satisfy low < high <= size\n");
+            return 2;
+        }
+    }
+
+    if (MSHRS && SIM_MODE == SIM_MODE_A)
+    {
+        fprintf(stderr, "Error: -mshrs is only supported in modes 2 to 4\n");
+        return 2;
+    }
+
+    if (MSHRS && PARALLEL_MODE != PARALLEL_NONE)
+    {
+        fprintf(stderr, "Error: -mshrs can't be combined with -parallel\n");
+        return 2;
+    }
+
+    bool prefetch = (L1_PREFETCHER != PREFETCH_NONE ||
+                     L2_PREFETCHER != PREFETCH_NONE);
+    if (prefetch && SIM_MODE == SIM_MODE_A)
+    {
+        fprintf(stderr, "Error: -L1pf and -L2pf are only supported in modes 2 "
+                        "to 4\n");
+        return 2;
+    }
+
+    if (prefetch && PARALLEL_MODE != PARALLEL_NONE)
+    {
+        fprintf(stderr, "Error: -L1pf and -L2pf can't be combined with "
+                        "-parallel\n");
+        return 2;
+    }
+
+    if (FETCH_BLOCK && SIM_MODE == SIM_MODE_A)
+    {
+        fprintf(stderr, "Error: -fetch_block is only supported in modes 2 "
+                        "to 4\n");
+        return 2;
+    }
+
+    if (FETCH_BLOCK > CACHE_LINESIZE)
+    {
+        fprintf(stderr, "Error: fetch_block must be at most the line "
+                        "size\n");
+        return 2;
+    }
+
+    if (ROB_SIZE && SIM_MODE == SIM_MODE_A)
+    {
+        fprintf(stderr, "Error: -rob is only supported in modes 2 to 4\n");
+        return 2;
+    }
+
+    if (ROB_SIZE && !MSHRS)
+    {
+        fprintf(stderr, "Error: -rob requires -mshrs, since blocking caches "
+                        "allow one miss at a time\n");
+        return 2;
+    }
+
+    if (ROB_SIZE && PARALLEL_MODE != PARALLEL_NONE)
+    {
+        fprintf(stderr, "Error: -rob can't be combined with -parallel\n");
+        return 2;
+    }
+
+    if (PARALLEL_MODE != PARALLEL_NONE && SIM_MODE != SIM_MODE_DEF)
+    {
+        fprintf(stderr, "Error: -parallel is only supported in mode 4\n");
+        return 2;
+    }
+
+    if (SAMPLE_PERIOD)
+    {
+        if (SIM_MODE == SIM_MODE_A)
+        {
+            fprintf(stderr, "Error: -sample_period is only supported in "
+                            "modes 2 to 4\n");
+            return 2;
+        }
+
+        if (SAMPLE_PERIOD < SAMPLE_WARMUP + SAMPLE_WINDOW)
+        {
+            fprintf(stderr, "Error: sample_period must be at least "
+                            "sample_warmup + sample_window\n");
+            return 2;
+        }
+
+        if (PARALLEL_MODE != PARALLEL_NONE)
+        {
+            fprintf(stderr, "Error: -sample_period can't be combined with "
+                            "-parallel\n");
+            return 2;
+        }
+    }
+
+    if (SAVE_CHECKPOINT_FILENAME)
+    {
+        if (CHECKPOINT_INST == 0)
+        {
+            fprintf(stderr, "Error: -save_checkpoint needs a positive "
+                            "-checkpoint_inst\n");
+            return 2;
+        }
+
+        if (PARALLEL_MODE != PARALLEL_NONE || SAMPLE_PERIOD ||
+            STACKDIST_MAX_SIZE)
+        {
+            fprintf(stderr, "Error: -save_checkpoint can't be combined with "
+                            "-parallel, -sample_period, or -SD_maxKB\n");
+            return 2;
+        }
+    }
+
+    if (LOAD_CHECKPOINT_FILENAME && (SKIP_INST || STACKDIST_MAX_SIZE))
+    {
+        fprintf(stderr, "Error: -load_checkpoint can't be combined with "
+                        "-skip_inst or -SD_maxKB\n");
+        return 2;
+    }
+
+    // Checkpoints hold the state of a single configuration.
+    if ((SAVE_CHECKPOINT_FILENAME || LOAD_CHECKPOINT_FILENAME) &&
+        SWEEP_FILENAME)
+    {
+        fprintf(stderr, "Error: checkpoints can't be combined with "
+                        "-sweep\n");
+        return 2;
+    }
+
+    // Trace broadcast consumers are single-threaded.
+    if (PARALLEL_MODE != PARALLEL_NONE && SWEEP_FILENAME)
+    {
+        fprintf(stderr, "Error: -parallel can't be combined with -sweep\n");
+        return 2;
+    }
+
     return 0;
 }
 
-void print_dots()
+/**
+ * Whether every core has executed the instructions to simulate before the
+ * checkpoint, or run out of them.
+ */
+bool checkpoint_due()
+{
+    for (unsigned int i = 0; i < NUM_CORES; i++)
+    {
+        if (!core[i]->done && core[i]->inst_count < CHECKPOINT_INST)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void print_dots(uint64_t cycle)
 {
     unsigned int LINE_INTERVAL = 50 * DOT_INTERVAL;
-    last_printdot_cycle = current_cycle;
+    last_printdot_cycle = cycle;
 
     if (!PRINT_DOTS)
     {
         return;
     }
 
-    if (current_cycle % LINE_INTERVAL == 0)
+    if (cycle % LINE_INTERVAL == 0)
     {
-        if (current_cycle != 0)
+        if (cycle != 0)
         {
             printf("\n");
         }
-        printf("%4llu M\t", (unsigned long long)current_cycle / 1000000);
+        printf("%4llu M\t", (unsigned long long)cycle / 1000000);
         fflush(stdout);
     }
     else
@@ -333,6 +1642,18 @@ void print_dots()
     }
 }
 
+/**
+ * Print the dots for every interval boundary up to the given cycle that
+ * hasn't been printed yet.
+ */
+void print_dots_until(uint64_t cycle)
+{
+    while (cycle - last_printdot_cycle >= DOT_INTERVAL)
+    {
+        print_dots(last_printdot_cycle + DOT_INTERVAL);
+    }
+}
+
 void print_stats()
 {
     printf("\n\n");
@@ -345,6 +1666,11 @@ void print_stats()
     }
 
     memsys_print_stats(memsys);
+    parallel_print_stats();
+    if (SAMPLE_PERIOD)
+    {
+        sample_print_stats(core, NUM_CORES);
+    }
 }
 
 void print_usage(const char *program_name)
@@ -363,22 +1689,157 @@ void print_usage(const char *program_name)
     fprintf(stderr, "                            (default: 64)\n");
     fprintf(stderr, "    -repl <num>             Set replacement policy for "
                     "L1 cache [0: LRU,\n");
-    fprintf(stderr, "                            1: random, 2: SWP, 3: DWP] "
-                    "(default: 0)\n");
+    fprintf(stderr, "                            1: random, 2: SWP, 3: DWP, "
+                    "4: tree PLRU,\n");
+    fprintf(stderr, "                            5: bit PLRU] (default: 0)\n");
     fprintf(stderr, "    -DsizeKB <num>          Set capacity in KB of the L1 "
                     "dcache (default: 32 KB)\n");
     fprintf(stderr, "    -Dassoc <num>           Set associativity of the L1 "
                     "dcache (default: 8)\n");
+    fprintf(stderr, "    -SD_maxKB <num>         In mode 1, also report LRU "
+                    "stats for every\n");
+    fprintf(stderr, "                            power-of-two dcache size up "
+                    "to <num> KB\n");
+    fprintf(stderr, "                            (default: 0, disabled)\n");
+    fprintf(stderr, "    -SD_maxassoc <num>      Set the largest associativity "
+                    "covered by -SD_maxKB\n");
+    fprintf(stderr, "                            (default: 16)\n");
     fprintf(stderr, "    -L2sizeKB <num>         Set capacity in KB of the "
                     "unified L2 cache\n");
     fprintf(stderr, "                            (default: 512 KB)\n");
     fprintf(stderr, "    -L2repl <num>           Set replacement policy for "
                     "L2 cache [0: LRU,\n");
-    fprintf(stderr, "                            1: random, 2: SWP, 3: DWP] "
+    fprintf(stderr, "                            1: random, 2: SWP, 3: DWP, "
+                    "4: tree PLRU,\n");
+    fprintf(stderr, "                            5: bit PLRU] (default: 0)\n");
+    fprintf(stderr, "    -mshrs <num>            In modes 2 to 4, give each L1 "
+                    "cache <num> MSHRs,\n");
+    fprintf(stderr, "                            so loads only stall the core "
+                    "when their data is\n");
+    fprintf(stderr, "                            used (default: 0, blocking "
+                    "caches)\n");
+    fprintf(stderr, "    -L2mshrs <num>          Set MSHRs of the L2 cache "
+                    "with -mshrs (default: 32)\n");
+    fprintf(stderr, "    -load_use_dist <num>    With -mshrs, set instructions "
+                    "from a load to the\n");
+    fprintf(stderr, "                            first use of its data "
+                    "(default: 8)\n");
+    fprintf(stderr, "    -L1pf <num>             In modes 2 to 4, set prefetcher "
+                    "of the dcache [0: none,\n");
+    fprintf(stderr, "                            1: next-line, 2: IP-stride, "
+                    "3: stream] (default: 0)\n");
+    fprintf(stderr, "    -L1pf_degree <num>      Set lines prefetched at once "
+                    "by -L1pf (default: 2)\n");
+    fprintf(stderr, "    -L1pf_dist <num>        Set lines ahead -L1pf "
+                    "prefetches (default: 1)\n");
+    fprintf(stderr, "    -L2pf <num>             In modes 2 to 4, set prefetcher "
+                    "of the L2 cache, as\n");
+    fprintf(stderr, "                            for -L1pf or 4: temporal "
                     "(default: 0)\n");
+    fprintf(stderr, "    -L2pf_degree <num>      Set lines prefetched at once "
+                    "by -L2pf (default: 4)\n");
+    fprintf(stderr, "    -L2pf_dist <num>        Set lines ahead -L2pf "
+                    "prefetches (default: 4)\n");
+    fprintf(stderr, "    -pf_throttle <0|1>      Throttle the prefetchers by "
+                    "their accuracy,\n");
+    fprintf(stderr, "                            lateness and pollution "
+                    "(default: 0)\n");
+    fprintf(stderr, "    -rob <num>              In modes 2 to 4 with -mshrs, "
+                    "simulate out-of-order\n");
+    fprintf(stderr, "                            cores with <num> ROB entries "
+                    "(default: 0, in-order)\n");
+    fprintf(stderr, "    -issue_width <num>      Set instructions dispatched "
+                    "and retired per cycle\n");
+    fprintf(stderr, "                            with -rob (default: 4)\n");
+    fprintf(stderr, "    -lsq <num>              Set load/store queue entries "
+                    "with -rob (default: 48)\n");
+    fprintf(stderr, "    -alu_lat <num>          Set latency of ALU "
+                    "instructions with -rob\n");
+    fprintf(stderr, "                            (default: 1)\n");
+    fprintf(stderr, "    -other_lat <num>        Set latency of other "
+                    "non-memory instructions\n");
+    fprintf(stderr, "                            with -rob (default: 3)\n");
+    fprintf(stderr, "    -fetch_block <num>      In modes 2 to 4, fetch "
+                    "instructions in aligned\n");
+    fprintf(stderr, "                            blocks of <num> bytes "
+                    "(default: 0, one at a time)\n");
+    fprintf(stderr, "    -fetch_width <num>      Set instructions fetched per "
+                    "cycle with -fetch_block\n");
+    fprintf(stderr, "                            and -rob (default: 4)\n");
     fprintf(stderr, "    -SWP_core0ways <num>    Set static quota for core 0 "
                     "in SWP (default: 1)\n");
+    fprintf(stderr, "    -DWP_interval <num>     Set cycles between DWP "
+                    "repartitions\n");
+    fprintf(stderr, "                            (default: 5000000)\n");
+    fprintf(stderr, "    -parallel <num>         In mode 4, simulate each "
+                    "core on its own thread\n");
+    fprintf(stderr, "                            [0: off, 1: strict, "
+                    "2: relaxed] (default: 0)\n");
+    fprintf(stderr, "    -quantum <num>          Set cycles between core "
+                    "synchronizations in relaxed\n");
+    fprintf(stderr, "                            parallel mode (default: "
+                    "1000)\n");
+    fprintf(stderr, "    -sample_period <num>    In modes 2 to 4, simulate in "
+                    "detail only the last\n");
+    fprintf(stderr, "                            instructions of every <num> "
+                    "per core, and warm\n");
+    fprintf(stderr, "                            the caches functionally in "
+                    "between (default: 0, off)\n");
+    fprintf(stderr, "    -sample_window <num>    Set instructions measured "
+                    "per sampling unit\n");
+    fprintf(stderr, "                            (default: 1000)\n");
+    fprintf(stderr, "    -sample_warmup <num>    Set instructions simulated "
+                    "in detail before each\n");
+    fprintf(stderr, "                            window (default: 2000)\n");
+    fprintf(stderr, "    -save_checkpoint <file> Save the state of the "
+                    "simulation to <file> and\n");
+    fprintf(stderr, "                            stop once every core has "
+                    "run -checkpoint_inst\n");
+    fprintf(stderr, "                            instructions\n");
+    fprintf(stderr, "    -checkpoint_inst <num>  Set instructions per core "
+                    "before the checkpoint\n");
+    fprintf(stderr, "    -load_checkpoint <file> Restore the state of the "
+                    "simulation from <file>\n");
+    fprintf(stderr, "                            before starting\n");
     fprintf(stderr, "    -dram_policy <num>      Set DRAM page policy "
                     "[0: open-page, 1: close-page]\n");
     fprintf(stderr, "                            (default: 0)\n");
+    fprintf(stderr, "    -dram_sched <num>       In modes 3 and 4, set DRAM "
+                    "scheduling [0: fixed\n");
+    fprintf(stderr, "                            latency, 1: FCFS, 2: FR-FCFS] "
+                    "(default: 0)\n");
+    fprintf(stderr, "    -dram_map <num>         In modes 3 and 4, set DRAM "
+                    "address mapping\n");
+    fprintf(stderr, "                            [0: row:bank:column, "
+                    "1: row:column:bank,\n");
+    fprintf(stderr, "                            2: XOR bank hashing] "
+                    "(default: 0)\n");
+    fprintf(stderr, "    -dram_bank_stats <num>  In modes 3 and 4, report "
+                    "accesses and row\n");
+    fprintf(stderr, "                            conflicts per DRAM bank "
+                    "[0: off, 1: on] (default: 0)\n");
+    fprintf(stderr, "    -dram_channels <num>    In modes 3 and 4, set DRAM "
+                    "channels (default: 1)\n");
+    fprintf(stderr, "    -dram_ranks <num>       In modes 3 and 4, set ranks "
+                    "per channel (default: 1)\n");
+    fprintf(stderr, "    -dram_banks <num>       In modes 3 and 4, set banks "
+                    "per rank (default: 16)\n");
+    fprintf(stderr, "    -dram_wq <num>          With -dram_sched 1 or 2, give "
+                    "each DRAM channel a\n");
+    fprintf(stderr, "                            write queue of <num> entries "
+                    "(default: 0, none)\n");
+    fprintf(stderr, "    -dram_wq_high <num>     Start draining the write "
+                    "queue at <num> entries\n");
+    fprintf(stderr, "                            (default: 3/4 of -dram_wq)\n");
+    fprintf(stderr, "    -dram_wq_low <num>      Stop draining the write queue "
+                    "at <num> entries\n");
+    fprintf(stderr, "                            (default: 1/4 of -dram_wq)\n");
+    fprintf(stderr, "    -skip_inst <num>        Skip the first <num> "
+                    "instructions of each trace\n");
+    fprintf(stderr, "                            (default: 0; .mtr.gz traces "
+                    "are indexed on first use)\n");
+    fprintf(stderr, "    -sweep <file>           Simulate each line of "
+                    "options in <file> as a\n");
+    fprintf(stderr, "                            separate configuration, "
+                    "decoding the traces once\n");
 }
@@ -0,0 +1,218 @@
+// stackdist.cpp
+// Defines the functions for the stack-distance engine.
+//
+// For a fixed number of sets, LRU caches obey the inclusion property: a cache
+// with associativity A holds exactly the A most recently used lines of each
+// set. Keeping one LRU stack per set therefore simulates every associativity
+// at once, and an access at stack distance d hits exactly the caches with
+// associativity greater than d. One such set of stacks is kept for every
+// power-of-two number of sets.
+
+#include "stackdist.h"
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** Marks a line that is clean in every cache. */
+#define STACKDIST_CLEAN 0xFF
+
+///////////////////////////////////////////////////////////////////////////////
+//                           FUNCTION DEFINITIONS                            //
+///////////////////////////////////////////////////////////////////////////////
+
+StackDist *stackdist_new(uint64_t max_size, uint64_t max_assoc,
+                         uint64_t line_size)
+{
+    StackDist *sd = (StackDist *)calloc(1, sizeof(StackDist));
+    if (!sd)
+    {
+        exit(1);
+    }
+
+    sd->max_size = max_size;
+    sd->max_assoc = max_assoc;
+    sd->line_size = line_size;
+
+    // The largest number of sets is that of a direct-mapped cache of the
+    // largest size.
+    uint64_t max_lines = max_size / line_size;
+    for (uint64_t num_sets = 1; num_sets <= max_lines; num_sets *= 2)
+    {
+        sd->num_levels++;
+    }
+
+    sd->levels = (StackDistLevel *)calloc(sd->num_levels,
+                                          sizeof(StackDistLevel));
+    if (!sd->levels)
+    {
+        exit(1);
+    }
+
+    for (unsigned int i = 0; i < sd->num_levels; i++)
+    {
+        StackDistLevel *level = &sd->levels[i];
+        level->num_sets = (uint64_t)1 << i;
+
+        // Only keep as many lines per set as the largest cache with this
+        // number of sets can hold.
+        uint64_t depth = max_lines / level->num_sets;
+        level->depth = (depth < max_assoc) ? depth : max_assoc;
+
+        uint64_t entries = level->num_sets * level->depth;
+        level->line_addr = (uint64_t *)calloc(entries, sizeof(uint64_t));
+        level->dirty_from = (uint8_t *)calloc(entries, sizeof(uint8_t));
+        level->count = (uint8_t *)calloc(level->num_sets, sizeof(uint8_t));
+        level->read_hits = (unsigned long long *)calloc(
+            level->depth, sizeof(unsigned long long));
+        level->write_hits = (unsigned long long *)calloc(
+            level->depth, sizeof(unsigned long long));
+        level->dirty_evicts = (unsigned long long *)calloc(
+            level->depth + 1, sizeof(unsigned long long));
+        if (!level->line_addr || !level->dirty_from || !level->count ||
+            !level->read_hits || !level->write_hits || !level->dirty_evicts)
+        {
+            exit(1);
+        }
+    }
+
+    return sd;
+}
+
+/** Access the stacks of one level. */
+static void stackdist_level_access(StackDistLevel *level, uint64_t line_addr,
+                                   bool is_write)
+{
+    uint64_t set_index = line_addr & (level->num_sets - 1);
+    uint64_t *stack = &level->line_addr[set_index * level->depth];
+    uint8_t *dirty_from = &level->dirty_from[set_index * level->depth];
+    unsigned int count = level->count[set_index];
+
+    /* find the stack distance; count means it's not in any cache */
+    unsigned int distance = 0;
+    while (distance < count && stack[distance] != line_addr)
+    {
+        distance++;
+    }
+
+    uint8_t line_dirty_from;
+    if (distance < count)
+    {
+        if (is_write)
+        {
+            level->write_hits[distance]++;
+            line_dirty_from = 1;
+        }
+        else
+        {
+            level->read_hits[distance]++;
+
+            // Caches with associativity up to the distance missed and
+            // reinstalled the line clean; the others kept it as it was.
+            line_dirty_from = dirty_from[distance];
+            if (line_dirty_from != STACKDIST_CLEAN &&
+                line_dirty_from < distance + 1)
+            {
+                line_dirty_from = distance + 1;
+            }
+        }
+    }
+    else
+    {
+        line_dirty_from = is_write ? 1 : STACKDIST_CLEAN;
+
+        // The bottom line falls off the stack if the stack is full.
+        if (count < level->depth)
+        {
+            count++;
+            level->count[set_index] = count;
+            distance = count - 1;
+        }
+        else
+        {
+            distance = count - 1;
+            if (dirty_from[distance] <= level->depth)
+            {
+                level->dirty_evicts[level->depth]++;
+            }
+        }
+    }
+
+    // Every line above the accessed one moves down one position, i.e., out
+    // of the cache whose associativity equals its new position.
+    for (unsigned int k = distance; k > 0; k--)
+    {
+        if (dirty_from[k - 1] <= k)
+        {
+            level->dirty_evicts[k]++;
+        }
+        stack[k] = stack[k - 1];
+        dirty_from[k] = dirty_from[k - 1];
+    }
+
+    stack[0] = line_addr;
+    dirty_from[0] = line_dirty_from;
+}
+
+void stackdist_access(StackDist *sd, uint64_t line_addr, bool is_write)
+{
+    sd->stat_write_access += is_write;
+    sd->stat_read_access += !is_write;
+
+    for (unsigned int i = 0; i < sd->num_levels; i++)
+    {
+        stackdist_level_access(&sd->levels[i], line_addr, is_write);
+    }
+}
+
+void stackdist_print_stats(StackDist *sd, const char *label)
+{
+    for (uint64_t size = sd->line_size; size <= sd->max_size; size *= 2)
+    {
+        for (unsigned int i = 0; i < sd->num_levels; i++)
+        {
+            StackDistLevel *level = &sd->levels[i];
+            uint64_t assoc = size / (level->num_sets * sd->line_size);
+            if (assoc == 0 || assoc > level->depth ||
+                assoc * level->num_sets * sd->line_size != size ||
+                (assoc & (assoc - 1)) != 0)
+            {
+                continue;
+            }
+
+            // Fill in a cache's statistics, so they're printed exactly like
+            // those of a simulated cache.
+            Cache c;
+            memset(&c, 0, sizeof(c));
+            c.stat_read_access = sd->stat_read_access;
+            c.stat_write_access = sd->stat_write_access;
+            c.stat_read_miss = sd->stat_read_access;
+            c.stat_write_miss = sd->stat_write_access;
+            for (unsigned int d = 0; d < assoc; d++)
+            {
+                c.stat_read_miss -= level->read_hits[d];
+                c.stat_write_miss -= level->write_hits[d];
+            }
+            c.stat_dirty_evicts = level->dirty_evicts[assoc];
+
+            char cache_label[64];
+            if (size >= 1024)
+            {
+                snprintf(cache_label, sizeof(cache_label), "%s_%lluKB_%lluWAY",
+                         label, (unsigned long long)(size / 1024),
+                         (unsigned long long)assoc);
+            }
+            else
+            {
+                snprintf(cache_label, sizeof(cache_label), "%s_%lluB_%lluWAY",
+                         label, (unsigned long long)size,
+                         (unsigned long long)assoc);
+            }
+            cache_print_stats(&c, cache_label);
+        }
+    }
+}
@@ -0,0 +1,115 @@
+// stackdist.h
+// Declares a Mattson stack-distance engine, which simulates LRU caches of
+// every power-of-two size and associativity in a single pass.
+
+#ifndef __STACKDIST_H__
+#define __STACKDIST_H__
+
+#include "types.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The LRU stacks of every set for one power-of-two number of sets, which
+ * cover all caches with that number of sets at once: a cache with
+ * associativity A holds exactly the top A lines of each stack.
+ */
+typedef struct StackDistLevel
+{
+    /* number of sets */
+    uint64_t num_sets;
+
+    /* number of lines kept per set, i.e., the largest associativity covered */
+    unsigned int depth;
+
+    /* the line address at each stack position of each set (MRU first) */
+    uint64_t *line_addr;
+
+    /**
+     * For each stack position, the smallest associativity in which that line
+     * is dirty, or STACKDIST_CLEAN if it is clean in every cache.
+     */
+    uint8_t *dirty_from;
+
+    /* number of valid stack positions in each set */
+    uint8_t *count;
+
+    /**
+     * Read and write hits by stack distance, i.e., index d counts accesses
+     * that hit every cache with associativity greater than d.
+     */
+    unsigned long long *read_hits;
+    unsigned long long *write_hits;
+
+    /**
+     * Dirty evictions by associativity, i.e., index A counts dirty lines
+     * evicted from the cache with associativity A.
+     */
+    unsigned long long *dirty_evicts;
+} StackDistLevel;
+
+/** A stack-distance engine covering all caches up to a maximum geometry. */
+typedef struct StackDist
+{
+    /* the largest cache size covered, in bytes */
+    uint64_t max_size;
+
+    /* the largest associativity covered */
+    unsigned int max_assoc;
+
+    /* line size of all caches, in bytes */
+    unsigned int line_size;
+
+    /* one level per power-of-two number of sets, starting at 1 */
+    unsigned int num_levels;
+    StackDistLevel *levels;
+
+    /* total number of read and write accesses */
+    unsigned long long stat_read_access;
+    unsigned long long stat_write_access;
+} StackDist;
+
+///////////////////////////////////////////////////////////////////////////////
+//                            FUNCTION PROTOTYPES                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Allocate and initialize a stack-distance engine.
+ *
+ * @param max_size The largest cache size to cover, in bytes.
+ * @param max_assoc The largest associativity to cover.
+ * @param line_size The size of a cache line in bytes.
+ * @return A pointer to the stack-distance engine.
+ */
+StackDist *stackdist_new(uint64_t max_size, uint64_t max_assoc,
+                         uint64_t line_size);
+
+/**
+ * Access every covered cache at the given address, as cache_access() followed
+ * by cache_install() on a miss would with LRU replacement.
+ *
+ * @param sd The stack-distance engine to access.
+ * @param line_addr The address of the cache line to access (in units of the
+ *                  cache line size, i.e., excluding the line offset bits).
+ * @param is_write Whether this access is a write.
+ */
+void stackdist_access(StackDist *sd, uint64_t line_addr, bool is_write);
+
+/**
+ * Print the statistics of every covered cache in the format of
+ * cache_print_stats(), labeled with the cache's size and associativity.
+ *
+ * These are the statistics of true LRU caches. A simulated cache differs
+ * on lines whose address is below its number of sets, since those have a
+ * tag of 0 and hit its empty ways (see cache_lookup() in cache.cpp), so a
+ * trace that touches them can show a few more misses here than a run with
+ * the same -DsizeKB and -Dassoc.
+ *
+ * @param sd The stack-distance engine to print the statistics of.
+ * @param label A label prefix for the caches, e.g., "DCACHE".
+ */
+void stackdist_print_stats(StackDist *sd, const char *label);
+
+#endif // __STACKDIST_H__
@@ -0,0 +1,1029 @@
+// trace.cpp
+// Defines the functions for reading trace files and for broadcasting decoded
+// traces to several simulations.
+
+#include "trace.h"
+#include "tracedelta.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                               TRACE READERS                               //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Allocate a trace reader along with storage for batches of up to the given
+ * number of records.
+ */
+static TraceReader *trace_reader_new(TraceSource source, size_t batch_records)
+{
+    TraceReader *r = (TraceReader *)calloc(1, sizeof(TraceReader));
+    if (!r)
+    {
+        exit(1);
+    }
+
+    r->source = source;
+    if (batch_records == 0)
+    {
+        return r;
+    }
+
+    r->batch_inst_addr = (uint64_t *)malloc(batch_records * sizeof(uint64_t));
+    r->batch_inst_type = (uint8_t *)malloc(batch_records * sizeof(uint8_t));
+    r->batch_ldst_addr = (uint64_t *)malloc(batch_records * sizeof(uint64_t));
+    if (!r->batch_inst_addr || !r->batch_inst_type || !r->batch_ldst_addr)
+    {
+        exit(1);
+    }
+
+    r->inst_addr = r->batch_inst_addr;
+    r->inst_type = r->batch_inst_type;
+    r->ldst_addr = r->batch_ldst_addr;
+    return r;
+}
+
+/** Wake the other side of a reader's ring if it is asleep. */
+static void trace_ring_wake(TraceReader *r, std::atomic<bool> *waiting)
+{
+    if (waiting->load())
+    {
+        pthread_mutex_lock(&r->ring_lock);
+        pthread_cond_signal(&r->ring_changed);
+        pthread_mutex_unlock(&r->ring_lock);
+    }
+}
+
+/**
+ * Inflate the next batch of .mtr records into the given columns. A partial
+ * record at the end of the trace is ignored.
+ *
+ * @return The number of records decoded, or 0 at the end of the trace.
+ */
+static size_t trace_inflate_batch(TraceReader *r, uint64_t *inst_addr,
+                                  uint8_t *inst_type, uint64_t *ldst_addr)
+{
+    const size_t buf_size = TRACE_BATCH_RECORDS * TRACE_RECORD_SIZE;
+    long bytes_read;
+    if (r->inflater)
+    {
+        // The inflater reports its own errors.
+        bytes_read = traceindex_read(r->inflater,
+                                     r->read_buf + r->read_buf_left,
+                                     buf_size - r->read_buf_left);
+        if (bytes_read < 0)
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        bytes_read = gzread(r->gz, r->read_buf + r->read_buf_left,
+                            buf_size - r->read_buf_left);
+        if (bytes_read < 0)
+        {
+            int errnum;
+            fprintf(stderr, "Couldn't read from trace file: %s\n",
+                    gzerror(r->gz, &errnum));
+            return 0;
+        }
+    }
+    r->read_buf_left += bytes_read;
+
+    size_t count = r->read_buf_left / TRACE_RECORD_SIZE;
+    const uint8_t *record = r->read_buf;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t record_inst_addr;
+        uint32_t record_ldst_addr;
+        memcpy(&record_inst_addr, record, sizeof(record_inst_addr));
+        memcpy(&record_ldst_addr, record + 5, sizeof(record_ldst_addr));
+        inst_addr[i] = record_inst_addr;
+        inst_type[i] = record[4];
+        ldst_addr[i] = record_ldst_addr;
+        record += TRACE_RECORD_SIZE;
+    }
+
+    // Keep the bytes of a record split across reads for the next batch.
+    r->read_buf_left -= count * TRACE_RECORD_SIZE;
+    memmove(r->read_buf, record, r->read_buf_left);
+    return count;
+}
+
+/**
+ * Decode the next block of a delta-compressed trace into the given columns.
+ *
+ * @return The number of records decoded, or 0 at the end of the trace.
+ */
+static size_t trace_expand_batch(TraceReader *r, uint64_t *inst_addr,
+                                 uint8_t *inst_type, uint64_t *ldst_addr)
+{
+    uint32_t block[2];
+    if ((size_t)(r->delta_end - r->delta_pos) < sizeof(block))
+    {
+        return 0;
+    }
+    memcpy(block, r->delta_pos, sizeof(block));
+
+    const uint8_t *payload = r->delta_pos + sizeof(block);
+    size_t count = block[0];
+    size_t bytes = block[1];
+    if (count > TRACE_BATCH_RECORDS ||
+        bytes > (size_t)(r->delta_end - payload))
+    {
+        fprintf(stderr, "Error: corrupt block in delta trace\n");
+        return 0;
+    }
+    r->delta_pos = payload + bytes;
+
+    const uint8_t *encoded = payload;
+    size_t encoded_bytes = bytes;
+    if (r->delta_deflated)
+    {
+        uLongf inflated = count * TRACE_DELTA_MAX_RECORD_BYTES;
+        if (uncompress(r->delta_buf, &inflated, payload, bytes) != Z_OK)
+        {
+            fprintf(stderr, "Error: corrupt block in delta trace\n");
+            return 0;
+        }
+        encoded = r->delta_buf;
+        encoded_bytes = inflated;
+    }
+
+    if (!tracedelta_decode_block(encoded, encoded_bytes, count, inst_addr,
+                                 inst_type, ldst_addr))
+    {
+        fprintf(stderr, "Error: corrupt block in delta trace\n");
+        return 0;
+    }
+    return count;
+}
+
+/**
+ * Decode the trace into the ring of batches, until the end of the trace or
+ * until the reader is closed.
+ */
+static void *trace_decode(void *arg)
+{
+    TraceReader *r = (TraceReader *)arg;
+
+    while (!r->ring_stop.load())
+    {
+        // Wait for the reader to release a batch if the ring is full.
+        uint64_t head = r->ring_head.load();
+        if (head - r->ring_tail.load() == TRACE_RING_BATCHES)
+        {
+            pthread_mutex_lock(&r->ring_lock);
+            r->decoder_waiting.store(true);
+            while (head - r->ring_tail.load() == TRACE_RING_BATCHES &&
+                   !r->ring_stop.load())
+            {
+                pthread_cond_wait(&r->ring_changed, &r->ring_lock);
+            }
+            r->decoder_waiting.store(false);
+            pthread_mutex_unlock(&r->ring_lock);
+            continue;
+        }
+
+        size_t offset = (head % TRACE_RING_BATCHES) * TRACE_BATCH_RECORDS;
+        uint64_t *inst_addr = r->batch_inst_addr + offset;
+        uint8_t *inst_type = r->batch_inst_type + offset;
+        uint64_t *ldst_addr = r->batch_ldst_addr + offset;
+        size_t count;
+        if (r->source == TRACE_SOURCE_DELTA)
+        {
+            count = trace_expand_batch(r, inst_addr, inst_type, ldst_addr);
+        }
+        else
+        {
+            count = trace_inflate_batch(r, inst_addr, inst_type, ldst_addr);
+        }
+
+        if (count == 0)
+        {
+            // EOF
+            break;
+        }
+
+        r->ring_len[head % TRACE_RING_BATCHES] = count;
+        r->ring_head.store(head + 1);
+        trace_ring_wake(r, &r->reader_waiting);
+    }
+
+    r->ring_eof.store(true);
+    trace_ring_wake(r, &r->reader_waiting);
+    return NULL;
+}
+
+/** Allocate a reader whose decoder thread fills a ring of batches. */
+static TraceReader *trace_ring_new(TraceSource source)
+{
+    TraceReader *r = trace_reader_new(source,
+                                      TRACE_RING_BATCHES *
+                                          TRACE_BATCH_RECORDS);
+    pthread_mutex_init(&r->ring_lock, NULL);
+    pthread_cond_init(&r->ring_changed, NULL);
+    return r;
+}
+
+/** Start the decoder thread of a reader. */
+static void trace_ring_start(TraceReader *r)
+{
+    if (pthread_create(&r->decoder, NULL, trace_decode, r) != 0)
+    {
+        perror("Couldn't start trace decoder thread");
+        exit(1);
+    }
+}
+
+/** Whether the file starts with the given magic bytes. */
+static bool trace_fd_has_magic(int fd, const char *expected)
+{
+    char magic[4];
+    size_t len = strlen(expected);
+    return pread(fd, magic, len, 0) == (ssize_t)len &&
+           memcmp(magic, expected, len) == 0;
+}
+
+/** Whether the column of the given entry size fits within the file. */
+static bool trace_v2_column_fits(const TraceFileHeader *h, uint64_t offset,
+                                 size_t entry_size, uint64_t file_size)
+{
+    return offset % TRACE_V2_ALIGN == 0 && offset >= h->header_size &&
+           offset <= file_size &&
+           h->num_records <= (file_size - offset) / entry_size;
+}
+
+/** Map a v2 trace and point a reader's columns into the mapping. */
+static TraceReader *trace_open_v2(int fd, const char *filename,
+                                  uint64_t skip)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        perror("Couldn't open trace file");
+        close(fd);
+        return NULL;
+    }
+
+    uint64_t file_size = st.st_size;
+    TraceFileHeader h;
+    if (file_size < sizeof(h) || pread(fd, &h, sizeof(h), 0) != sizeof(h))
+    {
+        fprintf(stderr, "Error: truncated v2 trace: %s\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    if (h.version != TRACE_V2_VERSION || h.header_size < sizeof(h) ||
+        !trace_v2_column_fits(&h, h.inst_addr_offset, sizeof(uint64_t),
+                              file_size) ||
+        !trace_v2_column_fits(&h, h.inst_type_offset, sizeof(uint8_t),
+                              file_size) ||
+        !trace_v2_column_fits(&h, h.ldst_addr_offset, sizeof(uint64_t),
+                              file_size))
+    {
+        fprintf(stderr, "Error: unsupported or corrupt v2 trace: %s\n",
+                filename);
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("Couldn't map trace file");
+        return NULL;
+    }
+    madvise(map, file_size, MADV_SEQUENTIAL);
+
+    TraceReader *r = trace_reader_new(TRACE_SOURCE_MAPPED, 0);
+    const uint8_t *base = (const uint8_t *)map;
+    r->map = map;
+    r->map_size = file_size;
+    r->inst_addr = (const uint64_t *)(base + h.inst_addr_offset);
+    r->inst_type = base + h.inst_type_offset;
+    r->ldst_addr = (const uint64_t *)(base + h.ldst_addr_offset);
+    r->pos = skip < h.num_records ? skip : h.num_records;
+    r->len = h.num_records;
+    return r;
+}
+
+/**
+ * Map a delta-compressed trace and start decoding it at the block holding
+ * the given record.
+ *
+ * @return The reader, and in skip the number of records left to skip
+ *         within the first batch.
+ */
+static TraceReader *trace_open_delta(int fd, const char *filename,
+                                     uint64_t *skip)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        perror("Couldn't open trace file");
+        close(fd);
+        return NULL;
+    }
+
+    uint64_t file_size = st.st_size;
+    TraceDeltaHeader h;
+    if (file_size < sizeof(h) || pread(fd, &h, sizeof(h), 0) != sizeof(h))
+    {
+        fprintf(stderr, "Error: truncated delta trace: %s\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    if ((h.version != TRACE_DELTA_VERSION &&
+         h.version != TRACE_DELTA_VERSION_RAW) ||
+        h.header_size < sizeof(h) ||
+        h.header_size > file_size || h.block_records > TRACE_BATCH_RECORDS)
+    {
+        fprintf(stderr, "Error: unsupported or corrupt delta trace: %s\n",
+                filename);
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("Couldn't map trace file");
+        return NULL;
+    }
+    madvise(map, file_size, MADV_SEQUENTIAL);
+
+    TraceReader *r = trace_ring_new(TRACE_SOURCE_DELTA);
+    r->map = map;
+    r->map_size = file_size;
+    r->delta_pos = (const uint8_t *)map + h.header_size;
+    r->delta_end = (const uint8_t *)map + file_size;
+    r->delta_deflated = h.version != TRACE_DELTA_VERSION_RAW;
+    if (r->delta_deflated)
+    {
+        r->delta_buf = (uint8_t *)malloc(TRACE_BATCH_RECORDS *
+                                         TRACE_DELTA_MAX_RECORD_BYTES);
+        if (!r->delta_buf)
+        {
+            exit(1);
+        }
+    }
+
+    // Whole blocks can be skipped without decoding them.
+    uint32_t block[2];
+    while ((size_t)(r->delta_end - r->delta_pos) >= sizeof(block))
+    {
+        memcpy(block, r->delta_pos, sizeof(block));
+        size_t left = r->delta_end - r->delta_pos - sizeof(block);
+        if (block[0] > *skip || block[1] > left)
+        {
+            break;
+        }
+        *skip -= block[0];
+        r->delta_pos += sizeof(block) + block[1];
+    }
+
+    trace_ring_start(r);
+    return r;
+}
+
+/** Advance a reader past the given number of records. */
+static bool trace_skip(TraceReader *r, uint64_t skip)
+{
+    while (skip > 0)
+    {
+        if (r->pos == r->len && !trace_refill(r))
+        {
+            return false;
+        }
+
+        size_t n = r->len - r->pos;
+        if (n > skip)
+        {
+            n = skip;
+        }
+        r->pos += n;
+        skip -= n;
+    }
+    return true;
+}
+
+TraceReader *trace_open(const char *filename)
+{
+    return trace_open_at(filename, 0);
+}
+
+TraceReader *trace_open_at(const char *filename, uint64_t skip)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Couldn't open trace file");
+        return NULL;
+    }
+
+    if (trace_fd_has_magic(fd, TRACE_V2_MAGIC))
+    {
+        return trace_open_v2(fd, filename, skip);
+    }
+    if (trace_fd_has_magic(fd, TRACE_DELTA_MAGIC))
+    {
+        TraceReader *r = trace_open_delta(fd, filename, &skip);
+        if (r && skip > 0)
+        {
+            trace_skip(r, skip);
+        }
+        return r;
+    }
+
+    TraceInflater *inflater = NULL;
+    gzFile gz = NULL;
+    if (skip > 0 && trace_fd_has_magic(fd, "\x1f\x8b"))
+    {
+        close(fd);
+        inflater = traceindex_open_at(filename, skip * TRACE_RECORD_SIZE);
+        if (!inflater)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        gz = gzdopen(fd, "rb");
+        if (!gz)
+        {
+            perror("Couldn't open trace file");
+            close(fd);
+            return NULL;
+        }
+        gzbuffer(gz, 256 * 1024);
+
+        // An uncompressed trace is seeked directly.
+        if (skip > 0 &&
+            gzseek(gz, skip * TRACE_RECORD_SIZE, SEEK_SET) < 0)
+        {
+            fprintf(stderr, "Error: couldn't seek in trace %s\n", filename);
+            gzclose(gz);
+            return NULL;
+        }
+    }
+
+    TraceReader *r = trace_ring_new(TRACE_SOURCE_ZLIB);
+    r->gz = gz;
+    r->inflater = inflater;
+    r->read_buf = (uint8_t *)malloc(TRACE_BATCH_RECORDS * TRACE_RECORD_SIZE);
+    if (!r->read_buf)
+    {
+        exit(1);
+    }
+    trace_ring_start(r);
+    return r;
+}
+
+/** Release the batch being consumed and take the next one from the ring. */
+static bool trace_refill_ring(TraceReader *r)
+{
+    uint64_t tail = r->ring_tail.load();
+    if (r->holding_batch)
+    {
+        r->holding_batch = false;
+        r->ring_tail.store(++tail);
+        trace_ring_wake(r, &r->decoder_waiting);
+    }
+
+    // Wait for the decoder if the ring is empty.
+    if (r->ring_head.load() == tail && !r->ring_eof.load())
+    {
+        pthread_mutex_lock(&r->ring_lock);
+        r->reader_waiting.store(true);
+        while (r->ring_head.load() == tail && !r->ring_eof.load())
+        {
+            pthread_cond_wait(&r->ring_changed, &r->ring_lock);
+        }
+        r->reader_waiting.store(false);
+        pthread_mutex_unlock(&r->ring_lock);
+    }
+
+    // The decoder sets ring_eof only after its last batch is published.
+    if (r->ring_head.load() == tail)
+    {
+        return false;
+    }
+
+    size_t slot = tail % TRACE_RING_BATCHES;
+    size_t offset = slot * TRACE_BATCH_RECORDS;
+    r->inst_addr = r->batch_inst_addr + offset;
+    r->inst_type = r->batch_inst_type + offset;
+    r->ldst_addr = r->batch_ldst_addr + offset;
+    r->pos = 0;
+    r->len = r->ring_len[slot];
+    r->holding_batch = true;
+    return true;
+}
+
+static bool trace_refill_broadcast(TraceReader *r);
+
+bool trace_refill(TraceReader *r)
+{
+    bool refilled = false;
+    switch (r->source)
+    {
+        case TRACE_SOURCE_ZLIB:
+        case TRACE_SOURCE_DELTA:
+            refilled = trace_refill_ring(r);
+            break;
+
+        case TRACE_SOURCE_BROADCAST:
+            refilled = trace_refill_broadcast(r);
+            break;
+
+        case TRACE_SOURCE_MAPPED:
+            // The whole trace was the first batch.
+            break;
+    }
+
+    if (!refilled)
+    {
+        r->pos = 0;
+        r->len = 0;
+    }
+    return refilled;
+}
+
+void trace_close(TraceReader *r)
+{
+    if (r->source == TRACE_SOURCE_ZLIB || r->source == TRACE_SOURCE_DELTA)
+    {
+        pthread_mutex_lock(&r->ring_lock);
+        r->ring_stop.store(true);
+        pthread_cond_broadcast(&r->ring_changed);
+        pthread_mutex_unlock(&r->ring_lock);
+        pthread_join(r->decoder, NULL);
+
+        pthread_mutex_destroy(&r->ring_lock);
+        pthread_cond_destroy(&r->ring_changed);
+    }
+
+    if (r->source == TRACE_SOURCE_ZLIB)
+    {
+        if (r->inflater)
+        {
+            traceindex_close(r->inflater);
+        }
+        else
+        {
+            gzclose(r->gz);
+        }
+        free(r->read_buf);
+    }
+    else if (r->map)
+    {
+        munmap(r->map, r->map_size);
+        free(r->delta_buf);
+    }
+
+    if (r->fallback)
+    {
+        trace_close(r->fallback);
+    }
+
+    free(r->batch_inst_addr);
+    free(r->batch_inst_type);
+    free(r->batch_ldst_addr);
+    free(r);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                             TRACE BROADCASTS                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** Whether the consumer is holding up the producer of the stream. */
+static bool trace_stream_is_blocked_by(TraceStream *st, unsigned int c)
+{
+    return !st->detached[c] &&
+           st->next[c] + TRACE_BROADCAST_SLOTS <= st->produced;
+}
+
+/** Whether any consumer is still reading from the stream. */
+static bool trace_stream_is_attached(TraceBroadcast *bc, TraceStream *st)
+{
+    for (unsigned int c = 0; c < bc->num_consumers; c++)
+    {
+        if (!st->detached[c])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Whether the producer of the stream can decode into the next slot. */
+static bool trace_stream_has_space(TraceBroadcast *bc, TraceStream *st)
+{
+    for (unsigned int c = 0; c < bc->num_consumers; c++)
+    {
+        if (trace_stream_is_blocked_by(st, c))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Whether the consumer is, directly or through held-up producers and the
+ * consumers holding them up, waiting for the given stream.
+ */
+static bool trace_broadcast_waits_on(TraceBroadcast *bc, unsigned int c,
+                                     unsigned int target, bool *visited)
+{
+    int s = bc->waiting[c];
+    if (s < 0)
+    {
+        return false;
+    }
+    if ((unsigned int)s == target)
+    {
+        return true;
+    }
+
+    TraceStream *st = &bc->streams[s];
+    if (!st->full || visited[s])
+    {
+        return false;
+    }
+    visited[s] = true;
+
+    for (unsigned int c2 = 0; c2 < bc->num_consumers; c2++)
+    {
+        if (trace_stream_is_blocked_by(st, c2) &&
+            trace_broadcast_waits_on(bc, c2, target, visited))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Detach one consumer that holds up a producer while waiting on that same
+ * producer (through a chain of other streams). Must be called with the lock
+ * held.
+ *
+ * @return Whether a consumer was detached.
+ */
+static bool trace_broadcast_break_cycles(TraceBroadcast *bc)
+{
+    for (unsigned int s = 0; s < bc->num_streams; s++)
+    {
+        TraceStream *st = &bc->streams[s];
+        if (!st->full)
+        {
+            continue;
+        }
+
+        for (unsigned int c = 0; c < bc->num_consumers; c++)
+        {
+            bool visited[TRACE_BROADCAST_MAX_STREAMS] = {false};
+            if (trace_stream_is_blocked_by(st, c) &&
+                trace_broadcast_waits_on(bc, c, s, visited))
+            {
+                st->detached[c] = true;
+                pthread_cond_broadcast(&bc->changed);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+TraceBroadcast *trace_broadcast_new(unsigned int num_streams,
+                                    const char **filenames,
+                                    unsigned int num_consumers, uint64_t skip)
+{
+    if (num_streams > TRACE_BROADCAST_MAX_STREAMS ||
+        num_consumers > TRACE_BROADCAST_MAX_CONSUMERS)
+    {
+        return NULL;
+    }
+
+    TraceBroadcast *bc = (TraceBroadcast *)mmap(
+        NULL, sizeof(TraceBroadcast), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (bc == MAP_FAILED)
+    {
+        perror("Couldn't map trace broadcast");
+        return NULL;
+    }
+
+    size_t slot_records = (size_t)TRACE_BROADCAST_SLOTS *
+                          TRACE_BROADCAST_BLOCK_RECORDS;
+    size_t stream_bytes = slot_records * (2 * sizeof(uint64_t) +
+                                          sizeof(uint8_t));
+    uint8_t *slots = (uint8_t *)mmap(NULL, num_streams * stream_bytes,
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (slots == MAP_FAILED)
+    {
+        perror("Couldn't map trace broadcast");
+        munmap(bc, sizeof(TraceBroadcast));
+        return NULL;
+    }
+
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&bc->lock, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&bc->changed, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    bc->num_streams = num_streams;
+    bc->num_consumers = num_consumers;
+    bc->skip = skip;
+    for (unsigned int c = 0; c < num_consumers; c++)
+    {
+        bc->waiting[c] = -1;
+    }
+
+    for (unsigned int s = 0; s < num_streams; s++)
+    {
+        TraceStream *st = &bc->streams[s];
+        uint8_t *base = slots + s * stream_bytes;
+        st->broadcast = bc;
+        st->filename = filenames[s];
+
+        int fd = open(filenames[s], O_RDONLY);
+        if (fd >= 0)
+        {
+            st->mapped = trace_fd_has_magic(fd, TRACE_V2_MAGIC);
+            close(fd);
+        }
+        st->inst_addr = (uint64_t *)base;
+        st->ldst_addr = (uint64_t *)(base + slot_records * sizeof(uint64_t));
+        st->inst_type = base + 2 * slot_records * sizeof(uint64_t);
+    }
+
+    return bc;
+}
+
+/** Decode one trace into its ring until EOF or until nobody is reading. */
+static void *trace_broadcast_produce(void *arg)
+{
+    TraceStream *st = (TraceStream *)arg;
+    TraceBroadcast *bc = st->broadcast;
+    TraceReader *src = trace_open_at(st->filename, bc->skip);
+
+    while (src)
+    {
+        pthread_mutex_lock(&bc->lock);
+        for (;;)
+        {
+            if (trace_stream_has_space(bc, st) ||
+                !trace_stream_is_attached(bc, st))
+            {
+                break;
+            }
+            st->full = true;
+            if (trace_broadcast_break_cycles(bc))
+            {
+                continue;
+            }
+            pthread_cond_wait(&bc->changed, &bc->lock);
+        }
+        st->full = false;
+        bool attached = trace_stream_is_attached(bc, st);
+        size_t slot = st->produced % TRACE_BROADCAST_SLOTS;
+        pthread_mutex_unlock(&bc->lock);
+
+        if (!attached)
+        {
+            break;
+        }
+
+        // The slot is free, so it can be filled without holding the lock.
+        size_t offset = slot * TRACE_BROADCAST_BLOCK_RECORDS;
+        size_t count = 0;
+        while (count < TRACE_BROADCAST_BLOCK_RECORDS)
+        {
+            if (src->pos == src->len && !trace_refill(src))
+            {
+                break;
+            }
+
+            size_t n = src->len - src->pos;
+            if (n > TRACE_BROADCAST_BLOCK_RECORDS - count)
+            {
+                n = TRACE_BROADCAST_BLOCK_RECORDS - count;
+            }
+            memcpy(st->inst_addr + offset + count, src->inst_addr + src->pos,
+                   n * sizeof(uint64_t));
+            memcpy(st->inst_type + offset + count, src->inst_type + src->pos,
+                   n * sizeof(uint8_t));
+            memcpy(st->ldst_addr + offset + count, src->ldst_addr + src->pos,
+                   n * sizeof(uint64_t));
+            src->pos += n;
+            count += n;
+        }
+
+        pthread_mutex_lock(&bc->lock);
+        st->slot_len[slot] = count;
+        if (count > 0)
+        {
+            st->produced++;
+        }
+        bool done = count < TRACE_BROADCAST_BLOCK_RECORDS;
+        pthread_cond_broadcast(&bc->changed);
+        pthread_mutex_unlock(&bc->lock);
+
+        if (done)
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&bc->lock);
+    st->eof = true;
+    pthread_cond_broadcast(&bc->changed);
+    pthread_mutex_unlock(&bc->lock);
+
+    if (src)
+    {
+        trace_close(src);
+    }
+    return NULL;
+}
+
+bool trace_broadcast_start(TraceBroadcast *bc)
+{
+    for (unsigned int s = 0; s < bc->num_streams; s++)
+    {
+        TraceStream *st = &bc->streams[s];
+        if (st->mapped)
+        {
+            continue;
+        }
+        if (pthread_create(&st->producer, NULL, trace_broadcast_produce,
+                           st) != 0)
+        {
+            perror("Couldn't start trace decoder thread");
+            return false;
+        }
+    }
+    return true;
+}
+
+void trace_broadcast_detach(TraceBroadcast *bc, unsigned int consumer)
+{
+    pthread_mutex_lock(&bc->lock);
+    for (unsigned int s = 0; s < bc->num_streams; s++)
+    {
+        bc->streams[s].detached[consumer] = true;
+    }
+    bc->waiting[consumer] = -1;
+    pthread_cond_broadcast(&bc->changed);
+    pthread_mutex_unlock(&bc->lock);
+}
+
+void trace_broadcast_join(TraceBroadcast *bc)
+{
+    for (unsigned int s = 0; s < bc->num_streams; s++)
+    {
+        if (!bc->streams[s].mapped)
+        {
+            pthread_join(bc->streams[s].producer, NULL);
+        }
+    }
+}
+
+TraceReader *trace_open_broadcast(TraceBroadcast *bc, unsigned int stream,
+                                  unsigned int consumer)
+{
+    if (bc->streams[stream].mapped)
+    {
+        return trace_open_at(bc->streams[stream].filename, bc->skip);
+    }
+
+    TraceReader *r = trace_reader_new(TRACE_SOURCE_BROADCAST,
+                                      TRACE_BROADCAST_BLOCK_RECORDS);
+    r->broadcast = bc;
+    r->stream = stream;
+    r->consumer = consumer;
+    return r;
+}
+
+/** Hand out the fallback reader's current batch as this reader's batch. */
+static bool trace_take_fallback_batch(TraceReader *r)
+{
+    TraceReader *fb = r->fallback;
+    if (fb->pos == fb->len && !trace_refill(fb))
+    {
+        return false;
+    }
+
+    r->inst_addr = fb->inst_addr + fb->pos;
+    r->inst_type = fb->inst_type + fb->pos;
+    r->ldst_addr = fb->ldst_addr + fb->pos;
+    r->pos = 0;
+    r->len = fb->len - fb->pos;
+    fb->pos = fb->len;
+    return true;
+}
+
+/**
+ * Switch a detached consumer over to decoding the trace itself, past the
+ * given number of records it already read from the ring.
+ */
+static bool trace_fall_back(TraceReader *r, uint64_t consumed)
+{
+    TraceBroadcast *bc = r->broadcast;
+    r->fallback = trace_open_at(bc->streams[r->stream].filename, bc->skip);
+    if (!r->fallback || !trace_skip(r->fallback, consumed))
+    {
+        return false;
+    }
+
+    return trace_take_fallback_batch(r);
+}
+
+/** Copy the next block of a broadcast ring into the reader's batch. */
+static bool trace_refill_broadcast(TraceReader *r)
+{
+    if (r->fallback)
+    {
+        return trace_take_fallback_batch(r);
+    }
+
+    TraceBroadcast *bc = r->broadcast;
+    TraceStream *st = &bc->streams[r->stream];
+    unsigned int c = r->consumer;
+
+    pthread_mutex_lock(&bc->lock);
+    for (;;)
+    {
+        if (st->detached[c] || st->next[c] < st->produced || st->eof)
+        {
+            break;
+        }
+        bc->waiting[c] = r->stream;
+        if (trace_broadcast_break_cycles(bc))
+        {
+            continue;
+        }
+        pthread_cond_wait(&bc->changed, &bc->lock);
+    }
+    bc->waiting[c] = -1;
+
+    if (st->detached[c])
+    {
+        uint64_t consumed = st->next[c] * TRACE_BROADCAST_BLOCK_RECORDS;
+        pthread_mutex_unlock(&bc->lock);
+        return trace_fall_back(r, consumed);
+    }
+
+    if (st->next[c] >= st->produced)
+    {
+        // EOF
+        pthread_mutex_unlock(&bc->lock);
+        return false;
+    }
+
+    size_t slot = st->next[c] % TRACE_BROADCAST_SLOTS;
+    size_t count = st->slot_len[slot];
+    pthread_mutex_unlock(&bc->lock);
+
+    // The producer won't reuse the slot until next[c] moves past it, and this
+    // consumer can't be detached while it isn't waiting.
+    size_t offset = slot * TRACE_BROADCAST_BLOCK_RECORDS;
+    memcpy(r->batch_inst_addr, st->inst_addr + offset,
+           count * sizeof(uint64_t));
+    memcpy(r->batch_inst_type, st->inst_type + offset,
+           count * sizeof(uint8_t));
+    memcpy(r->batch_ldst_addr, st->ldst_addr + offset,
+           count * sizeof(uint64_t));
+
+    pthread_mutex_lock(&bc->lock);
+    st->next[c]++;
+    pthread_cond_broadcast(&bc->changed);
+    pthread_mutex_unlock(&bc->lock);
+
+    r->inst_addr = r->batch_inst_addr;
+    r->inst_type = r->batch_inst_type;
+    r->ldst_addr = r->batch_ldst_addr;
+    r->pos = 0;
+    r->len = count;
+    return true;
+}
@@ -0,0 +1,342 @@
+// trace.h
+// Declares the trace reader, which decodes .mtr, v2 and delta-compressed
+// trace files into batches of records for the cores to consume, and the trace
+// broadcast, which lets several simulations share one decode of the same
+// traces.
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "types.h"
+#include "traceindex.h"
+#include <atomic>
+#include <pthread.h>
+#include <stddef.h>
+#include <zlib.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The size of one record in an .mtr trace, in bytes. */
+#define TRACE_RECORD_SIZE 9
+
+/** The magic bytes at the start of a v2 trace. */
+#define TRACE_V2_MAGIC "MTR2"
+
+/** The version number stored in the header of a v2 trace. */
+#define TRACE_V2_VERSION 2
+
+/** The maximum length of the workload name in a v2 trace, including NUL. */
+#define TRACE_V2_WORKLOAD_LEN 64
+
+/** The alignment of each column of a v2 trace within the file, in bytes. */
+#define TRACE_V2_ALIGN 4096
+
+/** The number of records a decoder thread decodes into each batch. */
+#define TRACE_BATCH_RECORDS (16 * 1024)
+
+/** The number of batches in the ring between a decoder thread and a reader. */
+#define TRACE_RING_BATCHES 8
+
+/** The number of records in each block of a trace broadcast ring. */
+#define TRACE_BROADCAST_BLOCK_RECORDS (64 * 1024)
+
+/** The number of blocks each trace broadcast ring can hold at once. */
+#define TRACE_BROADCAST_SLOTS 16
+
+/** The maximum number of traces a trace broadcast can decode. */
+#define TRACE_BROADCAST_MAX_STREAMS 64
+
+/** The maximum number of simulations a trace broadcast can feed. */
+#define TRACE_BROADCAST_MAX_CONSUMERS 64
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** Possible sources a trace reader can decode records from. */
+typedef enum TraceSourceEnum
+{
+    TRACE_SOURCE_ZLIB = 0,      // A decoder thread inflating an .mtr.gz.
+    TRACE_SOURCE_BROADCAST = 1, // A ring shared through a trace broadcast.
+    TRACE_SOURCE_MAPPED = 2,    // A v2 trace mapped into memory.
+    TRACE_SOURCE_DELTA = 3,     // A decoder thread expanding a delta trace.
+} TraceSource;
+
+/**
+ * The header at the start of a v2 trace. All fields are little-endian.
+ *
+ * The header is followed by three columns of num_records entries each, which
+ * start at the given byte offsets (multiples of TRACE_V2_ALIGN): instruction
+ * addresses and load/store addresses as uint64_t, and instruction types as
+ * uint8_t. The columns can be read in place from a mapping of the file.
+ */
+typedef struct TraceFileHeader
+{
+    /* TRACE_V2_MAGIC, without the terminating NUL */
+    char magic[4];
+
+    /* TRACE_V2_VERSION */
+    uint32_t version;
+
+    /* number of records in the trace */
+    uint64_t num_records;
+
+    /* number of significant bits in the addresses, i.e., 32 or 64 */
+    uint32_t addr_bits;
+
+    /* size of this header in bytes */
+    uint32_t header_size;
+
+    /* byte offsets of the columns from the start of the file */
+    uint64_t inst_addr_offset;
+    uint64_t inst_type_offset;
+    uint64_t ldst_addr_offset;
+
+    /* the name of the traced workload, NUL-terminated */
+    char workload[TRACE_V2_WORKLOAD_LEN];
+} TraceFileHeader;
+
+typedef struct TraceBroadcast TraceBroadcast;
+
+/** A reader that hands out the records of one trace in batches. */
+typedef struct TraceReader
+{
+    /**
+     * The current batch of records, stored column by column. Consumers read
+     * record pos of each column and then advance pos; once pos reaches len,
+     * trace_refill() must be called to get the next batch.
+     */
+    const uint64_t *inst_addr;
+    const uint8_t *inst_type;
+    const uint64_t *ldst_addr;
+    size_t pos;
+    size_t len;
+
+    /* where the records come from */
+    TraceSource source;
+
+    /* storage for batches decoded by this reader */
+    uint64_t *batch_inst_addr;
+    uint8_t *batch_inst_type;
+    uint64_t *batch_ldst_addr;
+
+    /**
+     * TRACE_SOURCE_ZLIB and TRACE_SOURCE_DELTA: the decoder thread fills a
+     * single-producer/single-consumer ring of TRACE_RING_BATCHES batches in
+     * the batch storage. ring_head counts the batches filled and ring_tail
+     * the batches released by the reader; the reader holds batch ring_tail
+     * while it consumes it. Either side only takes ring_lock to sleep when
+     * the ring is full or empty.
+     */
+    pthread_t decoder;
+    size_t ring_len[TRACE_RING_BATCHES];
+    std::atomic<uint64_t> ring_head;
+    std::atomic<uint64_t> ring_tail;
+    std::atomic<bool> ring_eof;
+    std::atomic<bool> ring_stop;
+    std::atomic<bool> decoder_waiting;
+    std::atomic<bool> reader_waiting;
+    bool holding_batch;
+    pthread_mutex_t ring_lock;
+    pthread_cond_t ring_changed;
+
+    /**
+     * TRACE_SOURCE_ZLIB: the trace being inflated (through gz, or through
+     * inflater when reading started partway through a gzip trace), and the
+     * inflated bytes of a record split across reads.
+     */
+    gzFile gz;
+    TraceInflater *inflater;
+    uint8_t *read_buf;
+    size_t read_buf_left;
+
+    /**
+     * TRACE_SOURCE_DELTA: the next block to decode and the end of the
+     * blocks, within the mapping below.
+     */
+    const uint8_t *delta_pos;
+    const uint8_t *delta_end;
+
+    /**
+     * TRACE_SOURCE_DELTA: whether the blocks are deflated, and if so, where
+     * the decoder thread inflates each one before decoding it.
+     */
+    bool delta_deflated;
+    uint8_t *delta_buf;
+
+    /**
+     * TRACE_SOURCE_MAPPED and TRACE_SOURCE_DELTA: the mapping of the whole
+     * file. For a v2 trace, the columns point straight into it, so the trace
+     * is a single batch.
+     */
+    void *map;
+    size_t map_size;
+
+    /* TRACE_SOURCE_BROADCAST: the ring this reader consumes */
+    TraceBroadcast *broadcast;
+    unsigned int stream;
+    unsigned int consumer;
+
+    /**
+     * TRACE_SOURCE_BROADCAST: a private reader that takes over once this
+     * consumer has been detached from the ring.
+     */
+    struct TraceReader *fallback;
+} TraceReader;
+
+/** One trace decoded by a trace broadcast, and the ring it is decoded into. */
+typedef struct TraceStream
+{
+    /* the trace broadcast this stream belongs to */
+    TraceBroadcast *broadcast;
+
+    /* the trace file being decoded */
+    const char *filename;
+
+    /* whether the trace is a v2 trace, which consumers map themselves */
+    bool mapped;
+
+    /* the ring of TRACE_BROADCAST_SLOTS blocks, stored column by column */
+    uint64_t *inst_addr;
+    uint8_t *inst_type;
+    uint64_t *ldst_addr;
+    size_t slot_len[TRACE_BROADCAST_SLOTS];
+
+    /* the number of blocks decoded so far */
+    uint64_t produced;
+
+    /* whether the whole trace has been decoded */
+    bool eof;
+
+    /* whether the producer is waiting for consumers to free a slot */
+    bool full;
+
+    /* the next block each consumer will copy out of the ring */
+    uint64_t next[TRACE_BROADCAST_MAX_CONSUMERS];
+
+    /* whether each consumer has stopped reading from the ring */
+    bool detached[TRACE_BROADCAST_MAX_CONSUMERS];
+
+    /* the thread decoding the trace into the ring */
+    pthread_t producer;
+} TraceStream;
+
+/**
+ * A set of traces, each decoded once into a ring in shared memory and read by
+ * several consumers (simulations running in forked worker processes).
+ *
+ * A consumer that falls too far behind holds up the producer of its ring. If
+ * that would deadlock (the slow consumer is itself waiting on another ring
+ * whose producer is held up, transitively, by a faster consumer), the slow
+ * consumer is detached and decodes the rest of that trace privately.
+ */
+struct TraceBroadcast
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    unsigned int num_streams;
+    unsigned int num_consumers;
+
+    /* the number of records skipped at the start of every trace */
+    uint64_t skip;
+
+    /* the stream each consumer is waiting for, or -1 if it is running */
+    int waiting[TRACE_BROADCAST_MAX_CONSUMERS];
+
+    TraceStream streams[TRACE_BROADCAST_MAX_STREAMS];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//                            FUNCTION PROTOTYPES                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Open a trace file for reading. A v2 trace is mapped into memory and a
+ * delta-compressed trace is decoded from a mapping; anything else is read as
+ * a gzip-compressed (or uncompressed) .mtr trace.
+ *
+ * @param filename The name of the trace file.
+ * @return A reader positioned at the first record, or NULL on error.
+ */
+TraceReader *trace_open(const char *filename);
+
+/**
+ * Open a trace file for reading, starting partway through it. Gzip traces
+ * are indexed (see traceindex.h) to avoid decompressing the skipped part.
+ *
+ * @param filename The name of the trace file.
+ * @param skip The number of records to skip.
+ * @return A reader positioned at record skip, or NULL on error.
+ */
+TraceReader *trace_open_at(const char *filename, uint64_t skip);
+
+/**
+ * Replace the reader's exhausted batch with the next batch of records.
+ *
+ * @param r The reader to refill.
+ * @return Whether any records are left; false at the end of the trace.
+ */
+bool trace_refill(TraceReader *r);
+
+/**
+ * Close a trace reader and release everything it holds.
+ *
+ * @param r The reader to close.
+ */
+void trace_close(TraceReader *r);
+
+/**
+ * Allocate a trace broadcast in shared memory. This must be done before the
+ * consumer processes are forked.
+ *
+ * @param num_streams The number of traces to decode.
+ * @param filenames The names of the trace files.
+ * @param num_consumers The number of consumers reading every trace.
+ * @param skip The number of records to skip at the start of every trace.
+ * @return A pointer to the trace broadcast, or NULL on error.
+ */
+TraceBroadcast *trace_broadcast_new(unsigned int num_streams,
+                                    const char **filenames,
+                                    unsigned int num_consumers, uint64_t skip);
+
+/**
+ * Start one producer thread per trace. This must be done after the consumer
+ * processes are forked.
+ *
+ * @param bc The trace broadcast to start.
+ * @return Whether all producer threads were started.
+ */
+bool trace_broadcast_start(TraceBroadcast *bc);
+
+/**
+ * Detach a consumer from every ring, e.g., because its process has exited,
+ * so that producers no longer wait for it.
+ *
+ * @param bc The trace broadcast.
+ * @param consumer The consumer to detach.
+ */
+void trace_broadcast_detach(TraceBroadcast *bc, unsigned int consumer);
+
+/**
+ * Wait for all producer threads to finish.
+ *
+ * @param bc The trace broadcast.
+ */
+void trace_broadcast_join(TraceBroadcast *bc);
+
+/**
+ * Open a reader for one trace of a trace broadcast. A v2 trace is mapped
+ * directly instead, since reading it needs no decoding to share.
+ *
+ * @param bc The trace broadcast.
+ * @param stream The index of the trace to read.
+ * @param consumer The consumer that is reading.
+ * @return A reader positioned at the first record, or NULL on error.
+ */
+TraceReader *trace_open_broadcast(TraceBroadcast *bc, unsigned int stream,
+                                  unsigned int consumer);
+
+#endif // __TRACE_H__
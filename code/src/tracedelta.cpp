@@ -0,0 +1,268 @@
+// tracedelta.cpp
+// Defines the functions for the delta codec for traces.
+
+#include "tracedelta.h"
+#include <string.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The tag byte code for a PC that matches the predicted successor. */
+#define TRACE_DELTA_PC_PREDICTED 0
+
+/** The largest forward PC delta that fits in the tag byte. */
+#define TRACE_DELTA_PC_MAX_SHORT 14
+
+/** The tag byte code for a PC delta that follows as a varint. */
+#define TRACE_DELTA_PC_ESCAPE 15
+
+/** The tag byte bit for a load/store address that matches its prediction. */
+#define TRACE_DELTA_LDST_PREDICTED 0x4
+
+/** The tag byte bit for a residual that is stored divided by 8. */
+#define TRACE_DELTA_LDST_SCALED 0x8
+
+/** The tag byte bits for a load/store address that is stored as it is. */
+#define TRACE_DELTA_LDST_ABSOLUTE \
+    (TRACE_DELTA_LDST_PREDICTED | TRACE_DELTA_LDST_SCALED)
+
+/**
+ * How many bytes longer than the residual an address may be and still be
+ * stored as it is: an address that keeps coming back costs deflate a short
+ * match, while the residual against a different prediction each time doesn't
+ * repeat.
+ */
+#define TRACE_DELTA_ABSOLUTE_SLACK 2
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** What the codec remembers about the PCs hashing to one table entry. */
+typedef struct TraceDeltaEntry
+{
+    /* the last load/store address and the stride that led to it */
+    uint64_t last_ldst_addr;
+    uint64_t stride;
+
+    /* the PC that last followed this one */
+    uint64_t next_pc;
+} TraceDeltaEntry;
+
+///////////////////////////////////////////////////////////////////////////////
+//                           FUNCTION DEFINITIONS                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The table entry for a PC. */
+static inline TraceDeltaEntry *tracedelta_entry(TraceDeltaEntry *table,
+                                                uint64_t pc)
+{
+    return &table[(pc ^ (pc >> 10)) & (TRACE_DELTA_TABLE_SIZE - 1)];
+}
+
+/**
+ * Whether records of the given type access memory. Loads and stores are
+ * predicted per PC; the (normally unused) load/store address of any other
+ * record is predicted from that of the previous such record.
+ */
+static inline bool tracedelta_is_mem(uint8_t inst_type)
+{
+    return inst_type == INST_TYPE_LOAD || inst_type == INST_TYPE_STORE;
+}
+
+static inline uint64_t tracedelta_zigzag(uint64_t delta)
+{
+    // Zigzag encoding keeps small negative deltas short.
+    return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+static inline unsigned int tracedelta_varint_bytes(uint64_t delta)
+{
+    unsigned int bytes = 1;
+    for (uint64_t v = tracedelta_zigzag(delta); v >= 0x80; v >>= 7)
+    {
+        bytes++;
+    }
+    return bytes;
+}
+
+static inline uint8_t *tracedelta_put_varint(uint8_t *out, uint64_t delta)
+{
+    uint64_t v = tracedelta_zigzag(delta);
+    while (v >= 0x80)
+    {
+        *out++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (uint8_t)v;
+    return out;
+}
+
+static inline const uint8_t *tracedelta_get_varint(const uint8_t *in,
+                                                   const uint8_t *end,
+                                                   uint64_t *delta)
+{
+    uint64_t v = 0;
+    for (unsigned int shift = 0; in < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *in++;
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            *delta = (v >> 1) ^ (0 - (v & 1));
+            return in;
+        }
+    }
+    return NULL;
+}
+
+size_t tracedelta_encode_block(const uint64_t *inst_addr,
+                               const uint8_t *inst_type,
+                               const uint64_t *ldst_addr, size_t count,
+                               uint8_t *out)
+{
+    TraceDeltaEntry table[TRACE_DELTA_TABLE_SIZE];
+    TraceDeltaEntry other;
+    memset(table, 0, sizeof(table));
+    memset(&other, 0, sizeof(other));
+
+    uint8_t *start = out;
+    uint64_t prev_pc = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t pc = inst_addr[i];
+        uint8_t *tag = out++;
+        *tag = inst_type[i] & 0x3;
+
+        TraceDeltaEntry *prev = tracedelta_entry(table, prev_pc);
+        uint64_t pc_delta = pc - prev_pc;
+        if (pc == prev->next_pc)
+        {
+            *tag |= TRACE_DELTA_PC_PREDICTED << 4;
+        }
+        else if (pc_delta >= 1 && pc_delta <= TRACE_DELTA_PC_MAX_SHORT)
+        {
+            *tag |= pc_delta << 4;
+        }
+        else
+        {
+            *tag |= TRACE_DELTA_PC_ESCAPE << 4;
+            out = tracedelta_put_varint(out, pc_delta);
+        }
+        prev->next_pc = pc;
+        prev_pc = pc;
+
+        TraceDeltaEntry *e = tracedelta_is_mem(inst_type[i])
+                                 ? tracedelta_entry(table, pc)
+                                 : &other;
+        uint64_t predicted = e->last_ldst_addr + e->stride;
+        if (ldst_addr[i] == predicted)
+        {
+            *tag |= TRACE_DELTA_LDST_PREDICTED;
+        }
+        else
+        {
+            // Most accesses are aligned, so most residuals are too.
+            uint64_t residual = ldst_addr[i] - predicted;
+            uint8_t scaled = 0;
+            if ((residual & 0x7) == 0)
+            {
+                scaled = TRACE_DELTA_LDST_SCALED;
+                residual = (uint64_t)((int64_t)residual >> 3);
+            }
+            if (tracedelta_varint_bytes(residual) +
+                    TRACE_DELTA_ABSOLUTE_SLACK >=
+                tracedelta_varint_bytes(ldst_addr[i]))
+            {
+                *tag |= TRACE_DELTA_LDST_ABSOLUTE;
+                out = tracedelta_put_varint(out, ldst_addr[i]);
+            }
+            else
+            {
+                *tag |= scaled;
+                out = tracedelta_put_varint(out, residual);
+            }
+        }
+        e->stride = ldst_addr[i] - e->last_ldst_addr;
+        e->last_ldst_addr = ldst_addr[i];
+    }
+
+    return out - start;
+}
+
+bool tracedelta_decode_block(const uint8_t *in, size_t in_bytes, size_t count,
+                             uint64_t *inst_addr, uint8_t *inst_type,
+                             uint64_t *ldst_addr)
+{
+    TraceDeltaEntry table[TRACE_DELTA_TABLE_SIZE];
+    TraceDeltaEntry other;
+    memset(table, 0, sizeof(table));
+    memset(&other, 0, sizeof(other));
+
+    const uint8_t *end = in + in_bytes;
+    uint64_t prev_pc = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (in >= end)
+        {
+            return false;
+        }
+        uint8_t tag = *in++;
+        inst_type[i] = tag & 0x3;
+
+        TraceDeltaEntry *prev = tracedelta_entry(table, prev_pc);
+        unsigned int pc_code = tag >> 4;
+        uint64_t pc;
+        if (pc_code == TRACE_DELTA_PC_PREDICTED)
+        {
+            pc = prev->next_pc;
+        }
+        else if (pc_code <= TRACE_DELTA_PC_MAX_SHORT)
+        {
+            pc = prev_pc + pc_code;
+        }
+        else
+        {
+            uint64_t pc_delta;
+            in = tracedelta_get_varint(in, end, &pc_delta);
+            if (!in)
+            {
+                return false;
+            }
+            pc = prev_pc + pc_delta;
+        }
+        prev->next_pc = pc;
+        prev_pc = pc;
+        inst_addr[i] = pc;
+
+        TraceDeltaEntry *e = tracedelta_is_mem(inst_type[i])
+                                 ? tracedelta_entry(table, pc)
+                                 : &other;
+        uint64_t addr = e->last_ldst_addr + e->stride;
+        uint8_t ldst_code = tag & TRACE_DELTA_LDST_ABSOLUTE;
+        if (ldst_code != TRACE_DELTA_LDST_PREDICTED)
+        {
+            uint64_t value;
+            in = tracedelta_get_varint(in, end, &value);
+            if (!in)
+            {
+                return false;
+            }
+            if (ldst_code == TRACE_DELTA_LDST_ABSOLUTE)
+            {
+                addr = value;
+            }
+            else
+            {
+                addr += ldst_code == TRACE_DELTA_LDST_SCALED ? value << 3
+                                                             : value;
+            }
+        }
+        e->stride = addr - e->last_ldst_addr;
+        e->last_ldst_addr = addr;
+        ldst_addr[i] = addr;
+    }
+
+    return in == end;
+}
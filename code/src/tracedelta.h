@@ -0,0 +1,119 @@
+// tracedelta.h
+// Declares the delta codec for traces, which encodes each record against the
+// one before it and against a per-PC stride predictor, so that a typical
+// record takes one or two bytes, before each block is deflated.
+
+#ifndef __TRACEDELTA_H__
+#define __TRACEDELTA_H__
+
+#include "types.h"
+#include "trace.h"
+#include <stddef.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The magic bytes at the start of a delta-compressed trace. */
+#define TRACE_DELTA_MAGIC "MTRD"
+
+/** The version number stored in the header of a delta-compressed trace. */
+#define TRACE_DELTA_VERSION 2
+
+/** The last version whose blocks weren't deflated, which can still be read. */
+#define TRACE_DELTA_VERSION_RAW 1
+
+/** The number of entries in the per-PC prediction table (a power of 2). */
+#define TRACE_DELTA_TABLE_SIZE 1024
+
+/**
+ * The largest number of bytes a single encoded record can take: a tag byte
+ * and two 10-byte varints.
+ */
+#define TRACE_DELTA_MAX_RECORD_BYTES 21
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The header at the start of a delta-compressed trace. All fields are
+ * little-endian.
+ *
+ * The header is followed by blocks of up to block_records records each. Every
+ * block is encoded on its own (the prediction table starts out empty), and
+ * starts with two uint32_t: its number of records and the number of bytes
+ * that follow. Those bytes are the encoded records, deflated with zlib, since
+ * the residuals of irregular addresses are far from uniform; version 1 stores
+ * the encoded records as they are.
+ *
+ * Each record starts with a tag byte:
+ *   bits 0-1  the instruction type
+ *   bits 2-3  1 if ldst_addr is exactly the stride prediction for the PC,
+ *             0 or 2 if the residual below is stored as it is or divided by
+ *             8, or 3 if ldst_addr itself follows instead
+ *   bits 4-7  0 if inst_addr is the PC that last followed the previous PC,
+ *             1-14 for that forward delta from the previous PC, or 15 if a
+ *             zigzag varint with the delta follows
+ * followed, unless bits 2-3 are 1, by a zigzag varint with the residual,
+ * i.e., the difference between ldst_addr and its prediction, or with
+ * ldst_addr. Version 1 never stores ldst_addr itself.
+ */
+typedef struct TraceDeltaHeader
+{
+    /* TRACE_DELTA_MAGIC, without the terminating NUL */
+    char magic[4];
+
+    /* TRACE_DELTA_VERSION */
+    uint32_t version;
+
+    /* number of records in the trace */
+    uint64_t num_records;
+
+    /* largest number of records in a block */
+    uint32_t block_records;
+
+    /* size of this header in bytes */
+    uint32_t header_size;
+
+    /* the name of the traced workload, NUL-terminated */
+    char workload[TRACE_V2_WORKLOAD_LEN];
+} TraceDeltaHeader;
+
+///////////////////////////////////////////////////////////////////////////////
+//                            FUNCTION PROTOTYPES                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Encode one block of records.
+ *
+ * @param inst_addr The instruction address of each record.
+ * @param inst_type The instruction type of each record, which must be an
+ *                  InstType.
+ * @param ldst_addr The load/store address of each record.
+ * @param count The number of records to encode.
+ * @param out Where to write the encoded records, which must have room for
+ *            count * TRACE_DELTA_MAX_RECORD_BYTES bytes.
+ * @return The number of bytes written to out.
+ */
+size_t tracedelta_encode_block(const uint64_t *inst_addr,
+                               const uint8_t *inst_type,
+                               const uint64_t *ldst_addr, size_t count,
+                               uint8_t *out);
+
+/**
+ * Decode one block of records.
+ *
+ * @param in The encoded records.
+ * @param in_bytes The number of encoded bytes.
+ * @param count The number of records in the block.
+ * @param inst_addr Where to write the instruction address of each record.
+ * @param inst_type Where to write the instruction type of each record.
+ * @param ldst_addr Where to write the load/store address of each record.
+ * @return Whether exactly in_bytes bytes decoded into count records.
+ */
+bool tracedelta_decode_block(const uint8_t *in, size_t in_bytes, size_t count,
+                             uint64_t *inst_addr, uint8_t *inst_type,
+                             uint64_t *ldst_addr);
+
+#endif // __TRACEDELTA_H__
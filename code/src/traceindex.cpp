@@ -0,0 +1,484 @@
+// traceindex.cpp
+// Defines the functions for the random-access index over gzip-compressed
+// traces, following the approach of zran.c from the zlib examples.
+
+#include "traceindex.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The number of compressed bytes read from a trace at a time. */
+#define TRACE_INDEX_CHUNK (64 * 1024)
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/** An index held in memory. */
+typedef struct TraceIndex
+{
+    TraceIndexHeader header;
+    TraceIndexPoint *points;
+
+    /**
+     * The dictionaries of the access points, if the index was just built, or
+     * NULL if they're still in the index file open as index_fd.
+     */
+    uint8_t *windows;
+    int index_fd;
+} TraceIndex;
+
+///////////////////////////////////////////////////////////////////////////////
+//                           FUNCTION DEFINITIONS                            //
+///////////////////////////////////////////////////////////////////////////////
+
+static void traceindex_free(TraceIndex *idx)
+{
+    if (idx->index_fd >= 0)
+    {
+        close(idx->index_fd);
+    }
+    free(idx->points);
+    free(idx->windows);
+    free(idx);
+}
+
+/** Read exactly len bytes at an offset of a file. */
+static bool traceindex_pread(int fd, void *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = pread(fd, (uint8_t *)buf + done, len - done,
+                          offset + done);
+        if (n <= 0)
+        {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+/** Write exactly len bytes to a file. */
+static bool traceindex_write(int fd, const void *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = write(fd, (const uint8_t *)buf + done, len - done);
+        if (n < 0)
+        {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+/**
+ * Load the index of a trace from its index file.
+ *
+ * @return The index, or NULL if there is no index file or if it doesn't
+ *         match the trace's current size and modification time.
+ */
+static TraceIndex *traceindex_load(const char *index_name,
+                                   const struct stat *trace_st)
+{
+    int fd = open(index_name, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    TraceIndexHeader h;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !traceindex_pread(fd, &h, sizeof(h), 0) ||
+        memcmp(h.magic, TRACE_INDEX_MAGIC, sizeof(h.magic)) != 0 ||
+        h.version != TRACE_INDEX_VERSION ||
+        h.trace_size != (uint64_t)trace_st->st_size ||
+        h.trace_mtime != (int64_t)trace_st->st_mtime ||
+        h.num_points > ((uint64_t)st.st_size - sizeof(h)) /
+                           (sizeof(TraceIndexPoint) + TRACE_INDEX_WINDOW))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    TraceIndex *idx = (TraceIndex *)calloc(1, sizeof(TraceIndex));
+    if (!idx)
+    {
+        exit(1);
+    }
+    idx->points = (TraceIndexPoint *)malloc(
+        (h.num_points + 1) * sizeof(TraceIndexPoint));
+    if (!idx->points)
+    {
+        exit(1);
+    }
+    idx->header = h;
+    idx->index_fd = fd;
+    if (!traceindex_pread(fd, idx->points,
+                          h.num_points * sizeof(TraceIndexPoint), sizeof(h)))
+    {
+        traceindex_free(idx);
+        return NULL;
+    }
+    return idx;
+}
+
+/** Add an access point at the current position of a decompressor. */
+static void traceindex_add_point(TraceIndex *idx, uint64_t in, uint64_t out,
+                                 int bits, const uint8_t *window,
+                                 size_t window_left)
+{
+    uint64_t n = idx->header.num_points;
+    if ((n & (n - 1)) == 0)
+    {
+        // Grow the arrays whenever the number of points reaches a power of 2.
+        uint64_t capacity = n ? 2 * n : 1;
+        idx->points = (TraceIndexPoint *)realloc(
+            idx->points, capacity * sizeof(TraceIndexPoint));
+        idx->windows = (uint8_t *)realloc(idx->windows,
+                                          capacity * TRACE_INDEX_WINDOW);
+        if (!idx->points || !idx->windows)
+        {
+            exit(1);
+        }
+    }
+
+    TraceIndexPoint *p = &idx->points[n];
+    memset(p, 0, sizeof(*p));
+    p->out = out;
+    p->in = in;
+    p->bits = bits;
+
+    // The output window is circular: the oldest bytes are the window_left
+    // bytes at its end, which haven't been overwritten yet.
+    uint8_t *dict = idx->windows + n * TRACE_INDEX_WINDOW;
+    memcpy(dict, window + TRACE_INDEX_WINDOW - window_left, window_left);
+    memcpy(dict + window_left, window, TRACE_INDEX_WINDOW - window_left);
+    idx->header.num_points++;
+}
+
+/** Decompress a whole trace to build its index. */
+static TraceIndex *traceindex_build(int fd, const struct stat *trace_st)
+{
+    TraceIndex *idx = (TraceIndex *)calloc(1, sizeof(TraceIndex));
+    uint8_t *in_buf = (uint8_t *)malloc(TRACE_INDEX_CHUNK);
+    uint8_t *window = (uint8_t *)malloc(TRACE_INDEX_WINDOW);
+    if (!idx || !in_buf || !window)
+    {
+        exit(1);
+    }
+    memcpy(idx->header.magic, TRACE_INDEX_MAGIC, sizeof(idx->header.magic));
+    idx->header.version = TRACE_INDEX_VERSION;
+    idx->header.trace_size = trace_st->st_size;
+    idx->header.trace_mtime = trace_st->st_mtime;
+    idx->header.span = TRACE_INDEX_SPAN;
+    idx->index_fd = -1;
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    inflateInit2(&strm, 47); // Decode the gzip header, too.
+
+    // inflate() with Z_BLOCK stops at the end of each deflate block, which
+    // is where access points can be placed.
+    uint64_t total_in = 0;
+    uint64_t total_out = 0;
+    uint64_t last_point = 0;
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END)
+    {
+        ssize_t n = read(fd, in_buf, TRACE_INDEX_CHUNK);
+        if (n <= 0)
+        {
+            // A truncated trace is indexed up to where it ends.
+            break;
+        }
+        strm.next_in = in_buf;
+        strm.avail_in = n;
+
+        do
+        {
+            if (strm.avail_out == 0)
+            {
+                strm.next_out = window;
+                strm.avail_out = TRACE_INDEX_WINDOW;
+            }
+
+            total_in += strm.avail_in;
+            total_out += strm.avail_out;
+            ret = inflate(&strm, Z_BLOCK);
+            total_in -= strm.avail_in;
+            total_out -= strm.avail_out;
+
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+            {
+                fprintf(stderr, "Error: couldn't index trace: %s\n",
+                        strm.msg ? strm.msg : "corrupt gzip data");
+                inflateEnd(&strm);
+                free(in_buf);
+                free(window);
+                traceindex_free(idx);
+                return NULL;
+            }
+
+            bool block_end = (strm.data_type & 128) &&
+                             !(strm.data_type & 64);
+            if (ret != Z_STREAM_END && block_end &&
+                (total_out == 0 || total_out - last_point > TRACE_INDEX_SPAN))
+            {
+                traceindex_add_point(idx, total_in, total_out,
+                                     strm.data_type & 7, window,
+                                     strm.avail_out);
+                last_point = total_out;
+            }
+        } while (strm.avail_in != 0 && ret != Z_STREAM_END);
+    }
+
+    inflateEnd(&strm);
+    free(in_buf);
+    free(window);
+    return idx;
+}
+
+/**
+ * Save an index to its index file. The file is written under a temporary
+ * name and then renamed, so a reader never sees a partial index.
+ */
+static void traceindex_save(TraceIndex *idx, const char *index_name)
+{
+    size_t tmp_len = strlen(index_name) + 32;
+    char *tmp_name = (char *)malloc(tmp_len);
+    if (!tmp_name)
+    {
+        exit(1);
+    }
+    snprintf(tmp_name, tmp_len, "%s.%d", index_name, (int)getpid());
+
+    uint64_t n = idx->header.num_points;
+    int fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0 &&
+              traceindex_write(fd, &idx->header, sizeof(idx->header)) &&
+              traceindex_write(fd, idx->points,
+                               n * sizeof(TraceIndexPoint)) &&
+              traceindex_write(fd, idx->windows, n * TRACE_INDEX_WINDOW);
+    if (fd >= 0 && close(fd) != 0)
+    {
+        ok = false;
+    }
+    if (ok && rename(tmp_name, index_name) == 0)
+    {
+        free(tmp_name);
+        return;
+    }
+
+    fprintf(stderr, "Warning: couldn't save trace index %s\n", index_name);
+    if (fd >= 0)
+    {
+        unlink(tmp_name);
+    }
+    free(tmp_name);
+}
+
+/** Read the dictionary of an access point. */
+static bool traceindex_window(TraceIndex *idx, uint64_t point, uint8_t *dict)
+{
+    if (idx->windows)
+    {
+        memcpy(dict, idx->windows + point * TRACE_INDEX_WINDOW,
+               TRACE_INDEX_WINDOW);
+        return true;
+    }
+
+    uint64_t offset = sizeof(TraceIndexHeader) +
+                      idx->header.num_points * sizeof(TraceIndexPoint) +
+                      point * TRACE_INDEX_WINDOW;
+    return traceindex_pread(idx->index_fd, dict, TRACE_INDEX_WINDOW, offset);
+}
+
+/**
+ * Set up an inflater to resume at an access point, or at the start of the
+ * trace if point is num_points.
+ */
+static bool traceindex_resume(TraceInflater *inf, TraceIndex *idx,
+                              uint64_t point)
+{
+    if (point == idx->header.num_points)
+    {
+        return inflateInit2(&inf->strm, 47) == Z_OK &&
+               lseek(inf->fd, 0, SEEK_SET) == 0;
+    }
+
+    // An access point can start in the middle of a byte, whose remaining
+    // bits are fed to the decompressor first.
+    TraceIndexPoint *p = &idx->points[point];
+    uint8_t dict[TRACE_INDEX_WINDOW];
+    uint8_t byte = 0;
+    uint64_t in = p->in - (p->bits ? 1 : 0);
+    if (inflateInit2(&inf->strm, -15) != Z_OK ||
+        lseek(inf->fd, in, SEEK_SET) != (off_t)in ||
+        (p->bits && read(inf->fd, &byte, 1) != 1) ||
+        !traceindex_window(idx, point, dict))
+    {
+        return false;
+    }
+
+    if (p->bits)
+    {
+        inflatePrime(&inf->strm, p->bits, byte >> (8 - p->bits));
+    }
+    return inflateSetDictionary(&inf->strm, dict, TRACE_INDEX_WINDOW) == Z_OK;
+}
+
+TraceInflater *traceindex_open_at(const char *filename, uint64_t offset)
+{
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror("Couldn't open trace file");
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    size_t name_len = strlen(filename) + sizeof(TRACE_INDEX_SUFFIX);
+    char *index_name = (char *)malloc(name_len);
+    if (!index_name)
+    {
+        exit(1);
+    }
+    snprintf(index_name, name_len, "%s%s", filename, TRACE_INDEX_SUFFIX);
+
+    TraceIndex *idx = traceindex_load(index_name, &st);
+    if (!idx)
+    {
+        fprintf(stderr, "Indexing %s...\n", filename);
+        idx = traceindex_build(fd, &st);
+        if (idx)
+        {
+            traceindex_save(idx, index_name);
+        }
+    }
+    free(index_name);
+    if (!idx)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // Resume at the last access point at or before the offset.
+    uint64_t point = idx->header.num_points;
+    for (uint64_t i = 0; i < idx->header.num_points; i++)
+    {
+        if (idx->points[i].out <= offset)
+        {
+            point = i;
+        }
+    }
+    uint64_t skip = offset;
+    if (point < idx->header.num_points)
+    {
+        skip -= idx->points[point].out;
+    }
+
+    TraceInflater *inf = (TraceInflater *)calloc(1, sizeof(TraceInflater));
+    if (!inf)
+    {
+        exit(1);
+    }
+    inf->fd = fd;
+    inf->in_buf = (uint8_t *)malloc(TRACE_INDEX_CHUNK);
+    if (!inf->in_buf)
+    {
+        exit(1);
+    }
+
+    bool ok = traceindex_resume(inf, idx, point);
+    traceindex_free(idx);
+    if (!ok)
+    {
+        fprintf(stderr, "Error: couldn't seek in trace %s\n", filename);
+        traceindex_close(inf);
+        return NULL;
+    }
+
+    // Decompress and drop what comes before the offset.
+    uint8_t *scratch = (uint8_t *)malloc(TRACE_INDEX_CHUNK);
+    if (!scratch)
+    {
+        exit(1);
+    }
+    while (skip > 0 && !inf->done)
+    {
+        size_t n = skip < TRACE_INDEX_CHUNK ? skip : TRACE_INDEX_CHUNK;
+        long got = traceindex_read(inf, scratch, n);
+        if (got < 0)
+        {
+            free(scratch);
+            traceindex_close(inf);
+            return NULL;
+        }
+        skip -= got;
+    }
+    free(scratch);
+    return inf;
+}
+
+long traceindex_read(TraceInflater *inf, uint8_t *buf, size_t len)
+{
+    inf->strm.next_out = buf;
+    inf->strm.avail_out = len;
+    while (inf->strm.avail_out > 0 && !inf->done)
+    {
+        if (inf->strm.avail_in == 0)
+        {
+            ssize_t n = read(inf->fd, inf->in_buf, TRACE_INDEX_CHUNK);
+            if (n < 0)
+            {
+                perror("Couldn't read from trace file");
+                return -1;
+            }
+            if (n == 0)
+            {
+                // A truncated trace ends where its data does.
+                inf->done = true;
+                break;
+            }
+            inf->strm.next_in = inf->in_buf;
+            inf->strm.avail_in = n;
+        }
+
+        int ret = inflate(&inf->strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+        {
+            inf->done = true;
+        }
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+            fprintf(stderr, "Couldn't read from trace file: %s\n",
+                    inf->strm.msg ? inf->strm.msg : "corrupt gzip data");
+            return -1;
+        }
+    }
+    return len - inf->strm.avail_out;
+}
+
+void traceindex_close(TraceInflater *inf)
+{
+    inflateEnd(&inf->strm);
+    close(inf->fd);
+    free(inf->in_buf);
+    free(inf);
+}
@@ -0,0 +1,128 @@
+// traceindex.h
+// Declares the random-access index over gzip-compressed traces, which lets a
+// trace be decompressed starting from (almost) any position.
+//
+// Every TRACE_INDEX_SPAN bytes of decompressed output, the index records an
+// access point at a deflate block boundary: the compressed and decompressed
+// offsets there, and the 32 KB of output before it, which the decompressor
+// needs as its dictionary. Decompression can then resume at the access point
+// just before any position instead of at the start of the trace.
+
+#ifndef __TRACEINDEX_H__
+#define __TRACEINDEX_H__
+
+#include "types.h"
+#include <stddef.h>
+#include <zlib.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 CONSTANTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+/** The magic bytes at the start of an index file. */
+#define TRACE_INDEX_MAGIC "MTRZ"
+
+/** The version number stored in the header of an index file. */
+#define TRACE_INDEX_VERSION 1
+
+/** The suffix appended to a trace's file name to name its index file. */
+#define TRACE_INDEX_SUFFIX ".zidx"
+
+/** The distance between access points in decompressed bytes. */
+#define TRACE_INDEX_SPAN (4 * 1024 * 1024)
+
+/** The size of the dictionary saved at each access point, in bytes. */
+#define TRACE_INDEX_WINDOW 32768
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA STRUCTURES                              //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The header at the start of an index file. It is followed by num_points
+ * TraceIndexPoint entries and then by the dictionary of each access point,
+ * TRACE_INDEX_WINDOW bytes each, in the same order.
+ */
+typedef struct TraceIndexHeader
+{
+    /* TRACE_INDEX_MAGIC, without the terminating NUL */
+    char magic[4];
+
+    /* TRACE_INDEX_VERSION */
+    uint32_t version;
+
+    /* size and modification time of the trace, to detect stale indexes */
+    uint64_t trace_size;
+    int64_t trace_mtime;
+
+    /* the distance between access points in decompressed bytes */
+    uint64_t span;
+
+    /* the number of access points */
+    uint64_t num_points;
+} TraceIndexHeader;
+
+/** One access point of an index. */
+typedef struct TraceIndexPoint
+{
+    /* offset in the decompressed trace */
+    uint64_t out;
+
+    /* offset of the first full byte of the block in the compressed trace */
+    uint64_t in;
+
+    /* number of bits of the block in the byte before in, or 0 */
+    uint32_t bits;
+    uint32_t reserved;
+} TraceIndexPoint;
+
+/** A raw inflate stream over a gzip-compressed trace. */
+typedef struct TraceInflater
+{
+    /* the compressed trace */
+    int fd;
+
+    /* the decompressor, and the compressed bytes read but not yet inflated */
+    z_stream strm;
+    uint8_t *in_buf;
+
+    /* whether the end of the compressed data has been reached */
+    bool done;
+} TraceInflater;
+
+///////////////////////////////////////////////////////////////////////////////
+//                            FUNCTION PROTOTYPES                            //
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Open a gzip-compressed trace for decompression starting at the given
+ * position. The trace's index file is used if it is up to date; otherwise it
+ * is (re)built first, which decompresses the whole trace once.
+ *
+ * Only the first gzip member of the trace is read.
+ *
+ * @param filename The name of the gzip-compressed trace.
+ * @param offset The offset in the decompressed trace to start at.
+ * @return An inflater positioned at the offset, or NULL on error.
+ */
+TraceInflater *traceindex_open_at(const char *filename, uint64_t offset);
+
+/**
+ * Decompress the next bytes of the trace.
+ *
+ * @param inf The inflater to read from.
+ * @param buf Where to write the decompressed bytes.
+ * @param len The number of bytes to decompress.
+ * @return The number of bytes decompressed (less than len only at the end
+ *         of the trace), or -1 on error.
+ */
+long traceindex_read(TraceInflater *inf, uint8_t *buf, size_t len);
+
+/**
+ * Close an inflater and release everything it holds.
+ *
+ * @param inf The inflater to close.
+ */
+void traceindex_close(TraceInflater *inf);
+
+#endif // __TRACEINDEX_H__